@@ -3,7 +3,7 @@
 :: This builds using MinGW-w64 for 32 and 64 bit (http://mingw-w64.sourceforge.net/)
 :: Make sure both mingw-w32\bin and mingw-w64\bin are in the PATH
 
-set FLAGS=-DMSCOMP_API_EXPORT -DMSCOMP_WITHOUT_LZX -O3 -static-libgcc -march=native -mtune=generic -Wall -fno-exceptions -fno-rtti -fomit-frame-pointer
+set FLAGS=-DMSCOMP_API_EXPORT -DMSCOMP_WITHOUT_LZX -O3 -static-libgcc -mtune=generic -Wall -fno-exceptions -fno-rtti -fomit-frame-pointer
 set FILES=src/*.cpp
 set OUT=MSCompression
 
@@ -1,4 +1,4 @@
-FLAGS="-DMSCOMP_API_EXPORT -DMSCOMP_WITHOUT_LZX -O3 -march=native -mtune=generic -Wall -fno-exceptions -fno-rtti -fomit-frame-pointer"
+FLAGS="-DMSCOMP_API_EXPORT -DMSCOMP_WITHOUT_LZX -O3 -mtune=generic -Wall -fno-exceptions -fno-rtti -fomit-frame-pointer -pthread"
 FILES="src/*.cpp"
 OUT="MSCompression"
 
@@ -9,3 +9,9 @@ echo Compiling static shared library...
 g++ ${FLAGS} -c ${FILES}
 ar -rcs lib${OUT}.a *.o
 rm -f *.o
+
+echo Compiling tests...
+g++ ${FLAGS} test/mscomp_test.cpp lib${OUT}.a -o mscomp_test
+
+echo Compiling benchmark...
+g++ ${FLAGS} test/mscomp_bench.cpp lib${OUT}.a -o mscomp_bench
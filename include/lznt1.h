@@ -48,16 +48,25 @@ EXTERN_C_START
 
 MSCOMPAPI MSCompStatus lznt1_compress(const_bytes in, size_t in_len, bytes out, size_t* out_len);
 MSCOMPAPI size_t lznt1_max_compressed_size(size_t in_len);
+MSCOMPAPI MSCompStatus lznt1_compress_ctx(mscomp_context* ctx, const_bytes in, size_t in_len, bytes out, size_t* out_len);
+MSCOMPAPI void lznt1_context_free(mscomp_context* ctx);
+MSCOMPAPI MSCompStatus lznt1_compressed_size(const_bytes in, size_t in_len, size_t* size);
 
 MSCOMPAPI MSCompStatus lznt1_decompress(const_bytes in, size_t in_len, bytes out, size_t* out_len);
+MSCOMPAPI MSCompStatus lznt1_decompress_slack(const_bytes in, size_t in_len, bytes out, size_t* out_len);
+MSCOMPAPI MSCompStatus lznt1_decompress_inplace(bytes buf, size_t in_len, size_t* out_len);
+MSCOMPAPI size_t lznt1_inplace_margin(size_t in_len);
+MSCOMPAPI MSCompStatus lznt1_validate(const_bytes in, size_t in_len, size_t* out_len);
 
 
 MSCOMPAPI MSCompStatus lznt1_deflate_init(mscomp_stream* stream);
 MSCOMPAPI MSCompStatus lznt1_deflate(mscomp_stream* stream, MSCompFlush flush);
+MSCOMPAPI MSCompStatus lznt1_deflate_reset(mscomp_stream* stream);
 MSCOMPAPI MSCompStatus lznt1_deflate_end(mscomp_stream* stream);
 
 MSCOMPAPI MSCompStatus lznt1_inflate_init(mscomp_stream* stream);
 MSCOMPAPI MSCompStatus lznt1_inflate(mscomp_stream* stream);
+MSCOMPAPI MSCompStatus lznt1_inflate_reset(mscomp_stream* stream);
 MSCOMPAPI MSCompStatus lznt1_inflate_end(mscomp_stream* stream);
 
 EXTERN_C_END
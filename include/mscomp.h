@@ -58,6 +58,67 @@ EXTERN_C_START
 // MSCOMP_ERRNO (-1), MSCOMP_ARG_ERROR (-2), MSCOMP_MEM_ERROR (-4), or MSCOMP_BUF_ERROR (-5)).
 MSCOMPAPI MSCompStatus ms_compress(MSCompFormat format, const_bytes in, size_t in_len, bytes out, size_t* out_len);
 
+///// MSCompStatus ms_context_create(mscomp_context** ctx) /////
+///// void ms_context_free(mscomp_context* ctx)           /////
+//
+// Create or free a reusable compression context. A context keeps the dictionaries and temporary
+// buffers that ms_compress would otherwise allocate and clear on every call. Each format's memory
+// is allocated the first time the context is used with that format and kept until it is freed.
+//
+// A context may only be used by one thread at a time.
+//
+// ms_context_create returns MSCOMP_OK (0) if successful or MSCOMP_ARG_ERROR (-2) or
+// MSCOMP_MEM_ERROR (-4). ms_context_free accepts NULL.
+MSCOMPAPI MSCompStatus ms_context_create(mscomp_context** ctx);
+MSCOMPAPI void ms_context_free(mscomp_context* ctx);
+
+///// MSCompStatus ms_context_create_with_allocator(mscomp_context** ctx, const mscomp_allocator* allocator) /////
+//
+// The same as ms_context_create except that the context and all memory used by it comes from the
+// given allocator (which is copied). If <allocator> is NULL the current global allocator is used.
+MSCOMPAPI MSCompStatus ms_context_create_with_allocator(mscomp_context** ctx, const mscomp_allocator* allocator);
+
+///// MSCompStatus ms_compress_ctx(         /////
+/////        mscomp_context* ctx,           /////
+/////        MSCompFormat format,           /////
+/////        const_bytes in, size_t in_len, /////
+/////        bytes out, size_t* out_len)    /////
+//
+// The same as ms_compress except the memory in <ctx> is reused. Only the parts of the dictionaries
+// that the previous input touched are cleared, so this is much faster than ms_compress for lots of
+// small inputs. The output is identical to ms_compress.
+//
+// Decompression does not need any setup so there is no context version of ms_decompress.
+MSCOMPAPI MSCompStatus ms_compress_ctx(mscomp_context* ctx, MSCompFormat format, const_bytes in, size_t in_len, bytes out, size_t* out_len);
+
+///// MSCompStatus ms_compress_auto(              /////
+/////        const_bytes in, size_t in_len,       /////
+/////        bytes out, size_t* out_len,          /////
+/////        const mscomp_auto_options* options,  /////
+/////        MSCompFormat* format)                /////
+//
+// Compress the input buffer with the format that best fits <options> and report the <format>
+// that was used so that it can be stored along with the data for decompression.
+//
+// Every available format is tried on samples of the input (see ms_estimate_compressed_size, data
+// too small to sample uses a single piece from its middle) to estimate its ratio and measure its
+// speed. The samples are fully compressed into a temporary buffer so the speed is that of
+// ms_compress. With MSCOMP_MAX_RATIO the format with the smallest output that compresses at least
+// <min_speed> MB/s is used. With MSCOMP_MAX_SPEED the fastest format with a ratio of at least
+// <min_ratio> is used, or the one with the smallest output if none reach it. MSCOMP_NONE is always
+// a candidate (as infinitely fast with a ratio of 1) so incompressible data is simply stored.
+//
+// The speeds are measured on this machine as it runs, so the same input may not always choose the
+// same format. Choosing takes about 1/<sample_ratio> of the time of compressing with each format.
+// Call this for each object or chunk that should be able to use a different format.
+//
+// <out> only needs to be as large as the input: if the chosen format's output does not fit the
+// data is stored with MSCOMP_NONE instead.
+//
+// The return values are the same as ms_compress, with MSCOMP_ARG_ERROR for invalid <options> (an
+// unknown objective or a negative or NaN floor).
+MSCOMPAPI MSCompStatus ms_compress_auto(const_bytes in, size_t in_len, bytes out, size_t* out_len, const mscomp_auto_options* options, MSCompFormat* format);
+
 ///////////////////////// Decompression ///////////////////////////////////////
 ///// MSCompStatus ms_decompress(           /////
 /////        MSCompFormat format,           /////
@@ -87,6 +148,71 @@ MSCOMPAPI MSCompStatus ms_compress(MSCompFormat format, const_bytes in, size_t i
 // or MSCOMP_BUF_ERROR (-5)).
 MSCOMPAPI MSCompStatus ms_decompress(MSCompFormat format, const_bytes in, size_t in_len, bytes out, size_t* out_len);
 
+///// MSCompStatus ms_decompress_slack(     /////
+/////        MSCompFormat format,           /////
+/////        const_bytes in, size_t in_len, /////
+/////        bytes out, size_t* out_len)    /////
+//
+// The same as ms_decompress except that the caller guarantees that there are at least
+// MSCOMP_DECOMPRESS_SLACK bytes after the end of the input buffer that can be read and after the
+// end of the output buffer that can be written. The contents of the slack after the input do not
+// matter and the slack after the output may be overwritten with garbage.
+//
+// This allows the decompressors to stay in their fast loops until the very end of the data instead
+// of switching to slower fully bounds-checked loops near the end of the buffers, which is a
+// significant part of the time spent for small buffers. The result is the same as ms_decompress
+// except that an LZNT1 output buffer that is too small is reported as MSCOMP_BUF_ERROR (-5), as it
+// is for the other formats, while ms_decompress reports it as MSCOMP_DATA_ERROR (-3).
+MSCOMPAPI MSCompStatus ms_decompress_slack(MSCompFormat format, const_bytes in, size_t in_len, bytes out, size_t* out_len);
+
+///// MSCompStatus ms_decompress_inplace(   /////
+/////        MSCompFormat format,           /////
+/////        bytes buf, size_t in_len,      /////
+/////        size_t* out_len)               /////
+//
+// Decompress data in-place, where the compressed data is at the end of the same buffer that the
+// decompressed data is written to. This only requires a single buffer which is slightly larger than
+// the decompressed data instead of separate input and output buffers.
+//
+// <buf> is the buffer and <out_len> initially points to the length of the entire buffer. The last
+// <in_len> bytes of the buffer are the compressed data. Upon success <out_len> contains the number
+// of decompressed bytes at the start of the buffer. The compressed data is overwritten.
+//
+// The buffer should be at least the decompressed size plus ms_inplace_margin(format, in_len) bytes
+// to guarantee that the output never overtakes the compressed data that has not been read yet.
+// With less room this may fail with MSCOMP_BUF_ERROR even when the decompressed data would fit.
+//
+// The return value is the same as ms_decompress except that MSCOMP_ARG_ERROR (-2) is also
+// returned if <in_len> is larger than the buffer.
+MSCOMPAPI MSCompStatus ms_decompress_inplace(MSCompFormat format, bytes buf, size_t in_len, size_t* out_len);
+
+///// size_t ms_inplace_margin(MSCompFormat format, size_t in_len) /////
+//
+// Calculate the number of bytes needed beyond the decompressed size when using
+// ms_decompress_inplace for <in_len> bytes of compressed data. This is an upper bound for data
+// produced by the compressors of this library (and any other data that expands no more than what
+// ms_max_compressed_size allows), for other data ms_decompress_inplace may return MSCOMP_BUF_ERROR
+// but never produces incorrect output.
+MSCOMPAPI size_t ms_inplace_margin(MSCompFormat format, size_t in_len);
+
+///// MSCompStatus ms_validate(             /////
+/////        MSCompFormat format,           /////
+/////        const_bytes in, size_t in_len, /////
+/////        size_t* out_len)               /////
+//
+// Check that data is a valid compressed stream and get its decompressed size without producing
+// any output. The chunk headers, Huffman tables, lengths, and every offset (against the number of
+// bytes that would have been output at that point) are checked exactly like ms_decompress does but
+// nothing is copied, so this is much cheaper than decompressing into a scratch buffer.
+//
+// Upon success <out_len> contains the number of bytes the data decompresses to and ms_decompress
+// with an output buffer of at least that size succeeds. If the function does not return
+// successfully, the value pointed to by <out_len> is undefined.
+//
+// The return value is MSCOMP_OK (0) if the data is valid, MSCOMP_DATA_ERROR (-3) if it is not, or
+// MSCOMP_ARG_ERROR (-2) if the format is not supported.
+MSCOMPAPI MSCompStatus ms_validate(MSCompFormat format, const_bytes in, size_t in_len, size_t* out_len);
+
 ///////////////////////// Max Compressed Size /////////////////////////////////
 ///// size_t ms_max_compressed_size(MSCompFormat format, size_t in_len) /////
 //
@@ -98,6 +224,69 @@ MSCOMPAPI MSCompStatus ms_decompress(MSCompFormat format, const_bytes in, size_t
 // The return value is some value >=in_len.
 MSCOMPAPI size_t ms_max_compressed_size(MSCompFormat format, size_t in_len);
 
+///////////////////////// Estimate Compressed Size ////////////////////////////
+///// MSCompStatus ms_estimate_compressed_size(  /////
+/////        MSCompFormat format,                /////
+/////        const_bytes in,                     /////
+/////        size_t in_len,                      /////
+/////        unsigned sample_ratio,              /////
+/////        size_t* size,                       /////
+/////        size_t* error)                      /////
+//
+// Calculate or estimate the length of the compressed data without writing it anywhere.
+//
+// <format> is one of MSCOMP_NONE (0), MSCOMP_LZNT1 (2), MSCOMP_XPRESS (3), or
+// MSCOMP_XPRESS_HUFF (4). <in> is the data that would be compressed and <in_len> is its length.
+//
+// When <sample_ratio> is 0 or 1 the data is fully parsed (with the same matches and Huffman codes
+// as ms_compress) and <size> is set to exactly what ms_compress would output. This is faster than
+// compressing since nothing is encoded or written but it still takes most of the time.
+//
+// Otherwise only 1 in <sample_ratio> 64 KB blocks are compressed (along with the data just before
+// them for Xpress and Xpress Huffman) and <size> is set to the estimated length. <error> is set to
+// twice the standard error of the estimate: usually the real length is within <size> +/- <error>
+// but it is less reliable when only a few blocks are sampled or the data changes a lot between
+// blocks. When there are fewer than 2 blocks to sample the exact length is calculated instead.
+//
+// <error> is always set to 0 for exact lengths.
+//
+// Returns MSCOMP_OK on success, MSCOMP_ARG_ERROR for an unsupported format, or MSCOMP_MEM_ERROR.
+MSCOMPAPI MSCompStatus ms_estimate_compressed_size(MSCompFormat format, const_bytes in, size_t in_len, unsigned sample_ratio, size_t* size, size_t* error);
+
+///////////////////////// Batches /////////////////////////////////////////////
+///// MSCompStatus ms_compress_batch(       /////
+/////        MSCompFormat format,           /////
+/////        mscomp_batch_item* items,      /////
+/////        size_t count,                  /////
+/////        unsigned threads)              /////
+///// MSCompStatus ms_decompress_batch(     /////
+/////        MSCompFormat format,           /////
+/////        mscomp_batch_item* items,      /////
+/////        size_t count,                  /////
+/////        unsigned threads)              /////
+//
+// Compress or decompress many independent buffers using the given format. Each item gives its own
+// input buffer and output buffer, with <out_len> being the size of the output buffer going in and
+// the number of bytes written coming out. Every item gets its own <status>, exactly what
+// ms_compress or ms_decompress would have returned for it, and the output of each item is identical
+// to what they would have produced.
+//
+// The items are shared between the calling thread and up to <threads>-1 tasks submitted to the
+// executor (see ms_set_executor). If <threads> is 0 then the number of processors is used and if it
+// is 1 everything is done on the calling thread. While compressing, each thread reuses a single
+// context (see ms_compress_ctx) for all of the items it handles so that many small items are much
+// faster than individual calls. Without MSCOMP_WITH_THREADS everything is done on the calling
+// thread.
+//
+// The contexts are created and freed on the calling thread, but compressing and decompressing still
+// allocate memory on every thread, so with more than one thread the allocator (see
+// ms_set_allocator) must be thread-safe. The arena allocator is not.
+//
+// Returns MSCOMP_OK if every item succeeded, MSCOMP_ARG_ERROR if the format or items are invalid
+// (in which case no item is touched), or otherwise the status of the first failed item.
+MSCOMPAPI MSCompStatus ms_compress_batch(MSCompFormat format, mscomp_batch_item* items, size_t count, unsigned threads);
+MSCOMPAPI MSCompStatus ms_decompress_batch(MSCompFormat format, mscomp_batch_item* items, size_t count, unsigned threads);
+
 ///////////////////////// Deflate [Compress] - Streaming //////////////////////
 ///// MSCompStatus ms_deflate_init(MSCompFormat format, mscomp_stream* stream) /////
 //
@@ -142,6 +331,20 @@ MSCOMPAPI MSCompStatus ms_deflate_init(MSCompFormat format, mscomp_stream* strea
 // MSCOMP_ERRNO (-1), MSCOMP_ARG_ERROR (-2), or MSCOMP_MEM_ERROR (-4)).
 MSCOMPAPI MSCompStatus ms_deflate(mscomp_stream* stream, MSCompFlush flush);
 
+///// MSCompStatus ms_deflate_reset(mscomp_stream* stream, MSCompFormat format) /////
+//
+// Restores a compression stream to the state it has right after ms_deflate_init without freeing
+// and reallocating its memory (including any dictionary). This is much faster than calling
+// ms_deflate_end and ms_deflate_init when compressing many separate messages. Any data that has not
+// been compressed yet is discarded.
+//
+// <format> must be the same format the stream currently has since compression streams own their
+// dictionaries and cannot switch formats.
+//
+// The return value is MSCOMP_OK (0) if successful or MSCOMP_ARG_ERROR (-2) in which case the stream
+// is unchanged.
+MSCOMPAPI MSCompStatus ms_deflate_reset(mscomp_stream* stream, MSCompFormat format);
+
 ///// MSCompStatus ms_deflate_end(mscomp_stream* stream) /////
 //
 // Closes a compression stream. This does not compress any more data, but frees any resources used
@@ -173,6 +376,19 @@ MSCOMPAPI MSCompStatus ms_deflate_end(mscomp_stream* stream);
 // MSCOMP_ERRNO (-1), MSCOMP_ARG_ERROR (-2), or MSCOMP_MEM_ERROR (-4)).
 MSCOMPAPI MSCompStatus ms_inflate_init(MSCompFormat format, mscomp_stream* stream);
 
+///// MSCompStatus ms_inflate_init_contiguous(MSCompFormat format, mscomp_stream* stream) /////
+//
+// The same as ms_inflate_init except that the caller promises that the output is contiguous: every
+// time ms_inflate is called the previous output is still directly before stream->out in memory
+// (at least the last 8 KB of it, or all of it if less has been output). This is true when always
+// using a single large output buffer, a ring buffer mapped twice in a row in virtual memory, or
+// when the last 8 KB of the output are copied to before the new output buffer.
+//
+// Matches then are copied directly within the caller's output instead of through an internal
+// history buffer, removing a second copy of every output byte. Formats that do not keep history
+// between calls decompress the same as with ms_inflate_init.
+MSCOMPAPI MSCompStatus ms_inflate_init_contiguous(MSCompFormat format, mscomp_stream* stream);
+
 ///// MSCompStatus ms_inflate(mscomp_stream* stream) /////
 //
 // Inflate as much as possible from a stream's input to its output.
@@ -197,6 +413,21 @@ MSCOMPAPI MSCompStatus ms_inflate_init(MSCompFormat format, mscomp_stream* strea
 // MSCOMP_ERRNO (-1), MSCOMP_ARG_ERROR (-2), or MSCOMP_MEM_ERROR (-4)).
 MSCOMPAPI MSCompStatus ms_inflate(mscomp_stream* stream);
 
+///// MSCompStatus ms_inflate_reset(mscomp_stream* stream, MSCompFormat format) /////
+//
+// Restores a decompression stream to the state it has right after ms_inflate_init (or
+// ms_inflate_init_contiguous if it was initialized that way and the format is unchanged) without
+// freeing and reallocating its memory. This is much faster than calling ms_inflate_end and
+// ms_inflate_init when decompressing many separate messages. Any data that has not been
+// decompressed yet is discarded.
+//
+// <format> may be different than the format the stream currently has as long as the state of the
+// new format fits in the same size class (currently LZNT1 and Xpress can be switched between).
+//
+// The return value is MSCOMP_OK (0) if successful or MSCOMP_ARG_ERROR (-2) in which case the stream
+// is unchanged.
+MSCOMPAPI MSCompStatus ms_inflate_reset(mscomp_stream* stream, MSCompFormat format);
+
 ///// MSCompStatus ms_inflate_end(mscomp_stream* stream) /////
 //
 // Closes a decompression stream. This does not decompress any more data, but frees any resources
@@ -212,6 +443,156 @@ MSCOMPAPI MSCompStatus ms_inflate(mscomp_stream* stream);
 // MSCOMP_ARG_ERROR (-2) or MSCOMP_DATA_ERROR (-3)).
 MSCOMPAPI MSCompStatus ms_inflate_end(mscomp_stream* stream);
 
+///////////////////////// Memory Allocation ///////////////////////////////////
+///// MSCompStatus ms_set_allocator(const mscomp_allocator* allocator) /////
+//
+// Sets the allocator used for stream states and the temporary memory of the one-shot functions
+// (contexts use the allocator they were created with). The allocator is copied. If <allocator> is
+// NULL then malloc, realloc, and free are used again (the default). Thread pools and their tasks
+// always use malloc and free.
+//
+// This must only be called while there is no memory allocated from the previous allocator in use
+// (no open streams and no one-shot functions running on other threads).
+//
+// The return value is MSCOMP_OK (0) or MSCOMP_ARG_ERROR (-2) if any of the functions are NULL.
+MSCOMPAPI MSCompStatus ms_set_allocator(const mscomp_allocator* allocator);
+
+///// MSCompStatus ms_arena_allocator(mscomp_allocator* allocator, void* buf, size_t size) /////
+//
+// Sets up a bump-arena allocator that gives out the memory of the caller's buffer. This gives a
+// hard limit on the memory used: once the buffer is used up allocations fail and MSCOMP_MEM_ERROR
+// is returned. Freed memory is only reused if it was the most recent allocation; calling this again
+// with the same buffer empties the arena. The arena is not thread-safe.
+//
+// As a guide, a context uses about 400 KB (Xpress), 1.4 MB (Xpress Huffman), or 1.2 MB plus a few
+// MB that grows with the data (LZNT1) on 64-bit systems.
+//
+// The return value is MSCOMP_OK (0) or MSCOMP_ARG_ERROR (-2) if the buffer is NULL or too small.
+MSCOMPAPI MSCompStatus ms_arena_allocator(mscomp_allocator* allocator, void* buf, size_t size);
+
+///// void ms_hugepage_allocator(mscomp_allocator* allocator) /////
+//
+// Sets up an allocator that maps large allocations (64 KB and larger, such as the dictionaries)
+// aligned to 2 MB and requests transparent huge pages for them, reducing TLB misses on the large
+// hash tables. Smaller allocations use malloc. On systems without transparent huge pages (anything
+// besides Linux) this is the same as the default allocator.
+MSCOMPAPI void ms_hugepage_allocator(mscomp_allocator* allocator);
+
+///////////////////////// Executors /////////////////////////////////////////
+///// MSCompStatus ms_set_executor(const mscomp_executor* executor) /////
+//
+// Sets the executor that all parallel work (currently ms_compress_batch and ms_decompress_batch)
+// is submitted to, for example to share an application's thread pool so that the total number of
+// threads is bounded. The executor is copied. If <executor> is NULL the built-in pool is used,
+// which is created the first time it is needed with one fewer thread than the number of processors
+// (the calling thread always helps). This is not thread-safe and should be done before any parallel
+// functions are used. Returns MSCOMP_ARG_ERROR if the submit function is NULL.
+MSCOMPAPI MSCompStatus ms_set_executor(const mscomp_executor* executor);
+
+///// MSCompStatus ms_pool_create(mscomp_executor* executor, unsigned threads) /////
+///// void ms_pool_free(mscomp_executor* executor)                             /////
+//
+// Creates a work-stealing thread pool with the given number of threads (0 for the number of
+// processors) and sets <executor> to submit tasks to it. Each thread has its own task queue and
+// takes tasks from the queues of the other threads when its own is empty. Tasks submitted from
+// within a task go to the queue of the thread running it, so related work stays together. The pool
+// can be given to ms_set_executor or used directly by the application.
+//
+// Freeing a pool waits for all queued tasks to finish. It must not be the current executor.
+// Without MSCOMP_WITH_THREADS the pool has no threads and never accepts tasks.
+MSCOMPAPI MSCompStatus ms_pool_create(mscomp_executor* executor, unsigned threads);
+MSCOMPAPI void ms_pool_free(mscomp_executor* executor);
+
+///////////////////////// Statistics ////////////////////////////////////////
+///// void ms_get_stats(mscomp_stats* stats, bool reset) /////
+//
+// Gets the statistics gathered by all of the compression and decompression done on the calling
+// thread (including streams) since the thread started or the last reset. To get the statistics of
+// a single call or stream reset the counters first. Work done on other threads, like the extra
+// threads of the batch functions, is counted by those threads. If <reset> is true the counters are
+// set to zero after being copied. <stats> may be NULL to only reset.
+//
+// The statistics are only gathered with MSCOMP_WITH_STATS, otherwise they are always zero.
+MSCOMPAPI void ms_get_stats(mscomp_stats* stats, bool reset);
+
+///// MSCompStatus ms_set_phase_hook(mscomp_phase_hook hook, void* opaque) /////
+//
+// Sets a function that is called with begin set to true at the start of each phase of compression
+// and decompression and with begin set to false at the end (see MSCompPhase), on the thread doing
+// the work. This is meant for profiling, for example mscomp_bench reads the hardware performance
+// counters at each call to break them down by phase. The hook must allow phases to be nested. A
+// NULL hook removes it. It must not be changed while other threads are compressing or
+// decompressing.
+//
+// Returns MSCOMP_OK, or MSCOMP_ARG_ERROR if the library was compiled without MSCOMP_WITH_PHASES.
+MSCOMPAPI MSCompStatus ms_set_phase_hook(mscomp_phase_hook hook, void* opaque);
+
+///// MSCompStatus ms_stream_set_trace(mscomp_stream* stream, mscomp_trace_func func, void* opaque) /////
+///// MSCompStatus ms_context_set_trace(mscomp_context* ctx, mscomp_trace_func func, void* opaque)    /////
+//
+// Sets a function that is called with <opaque> on the calling thread after each chunk the stream
+// or context completes, for example to build per-chunk latency histograms (see
+// mscomp_chunk_trace). Only LZNT1 (4 KB chunks) and Xpress Huffman (64 KB chunks) work in chunks,
+// the other formats never call it. A stream's function must be set after it is initialized and is
+// kept when the stream is reset. A NULL function removes it.
+//
+// Separately, when compiled with MSCOMP_WITH_USDT every chunk (including those of ms_compress and
+// ms_decompress) fires the USDT probes mscomp:chunk_start(format, compressing) and
+// mscomp:chunk_done(format, compressing, stored, in_len, out_len). For example:
+//   bpftrace -e 'usdt:./libMSCompression.so:mscomp:chunk_start { @start[tid] = nsecs; }
+//     usdt:./libMSCompression.so:mscomp:chunk_done /@start[tid]/ {
+//       @ns[arg0, arg1] = hist(nsecs - @start[tid]); delete(@start[tid]); }'
+//
+// Returns MSCOMP_OK, or MSCOMP_ARG_ERROR if the stream or context is NULL or if the library was
+// compiled without MSCOMP_WITH_TRACE.
+MSCOMPAPI MSCompStatus ms_stream_set_trace(mscomp_stream* stream, mscomp_trace_func func, void* opaque);
+MSCOMPAPI MSCompStatus ms_context_set_trace(mscomp_context* ctx, mscomp_trace_func func, void* opaque);
+
+///////////////////////// Checksums ///////////////////////////////////////////
+///// uint32_t ms_crc32c(uint32_t crc, const_bytes data, size_t len) /////
+//
+// Calculates the CRC32C (Castagnoli, as used by iSCSI, ext4, and others) of the data, continuing
+// from the <crc> of the data before it (0 to start). Uses the SSE4.2 or ARMv8 CRC32 instructions
+// when the processor has them.
+MSCOMPAPI uint32_t ms_crc32c(uint32_t crc, const_bytes data, size_t len);
+
+///// MSCompStatus ms_compress_checksum(          /////
+/////        MSCompFormat format,                 /////
+/////        const_bytes in, size_t in_len,       /////
+/////        bytes out, size_t* out_len,          /////
+/////        uint32_t* checksum)                  /////
+///// MSCompStatus ms_decompress_checksum(        /////
+/////        MSCompFormat format,                 /////
+/////        const_bytes in, size_t in_len,       /////
+/////        bytes out, size_t* out_len,          /////
+/////        uint32_t* checksum)                  /////
+//
+// The same as ms_compress and ms_decompress but also set <checksum> to the CRC32C of the
+// uncompressed data (the input when compressing and the output when decompressing) on success, so
+// the checksums from both sides can be compared directly.
+//
+// When compiled with MSCOMP_WITH_CHECKSUM each LZNT1 and Xpress Huffman chunk is checksummed right
+// after it is compressed or decompressed and Xpress input is checksummed as it is added to the
+// dictionary, so the data is still in the cache and is not read again. Xpress decompression and
+// MSCOMP_NONE checksum the data after it is done.
+MSCOMPAPI MSCompStatus ms_compress_checksum(MSCompFormat format, const_bytes in, size_t in_len, bytes out, size_t* out_len, uint32_t* checksum);
+MSCOMPAPI MSCompStatus ms_decompress_checksum(MSCompFormat format, const_bytes in, size_t in_len, bytes out, size_t* out_len, uint32_t* checksum);
+
+///// MSCompStatus ms_stream_set_checksum(mscomp_stream* stream, bool enable) /////
+//
+// Starts or stops keeping the CRC32C of the uncompressed data of a stream in its checksum field:
+// all of the input consumed by ms_deflate or all of the output produced by ms_inflate. Each call
+// checksums the data it just consumed or produced before returning. Checksumming must be enabled
+// after the stream is initialized and stays enabled when the stream is reset, which sets the
+// checksum back to 0.
+//
+// The checksum fields are only part of mscomp_stream when compiled with MSCOMP_WITH_STREAM_CHECKSUM
+// (disabled by default since they change the layout of mscomp_stream).
+//
+// Returns MSCOMP_OK, or MSCOMP_ARG_ERROR if the stream is NULL or if the library was compiled
+// without MSCOMP_WITH_STREAM_CHECKSUM.
+MSCOMPAPI MSCompStatus ms_stream_set_checksum(mscomp_stream* stream, bool enable);
+
 EXTERN_C_END
 
 #endif
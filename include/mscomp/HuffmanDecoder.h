@@ -62,6 +62,7 @@ public:
 		for (uint_fast8_t len = 1; len <= NumTableBits; ++len)
 		{
 			this->lims[len] = (last += (cnts[len] << (NumBitsMax - len)));
+			if (UNLIKELY(last > MaxValue)) { return false; } // over-subscribed, the table fill below would overrun lens
 			const uint_fast16_t limit = this->lims[len] >> (NumBitsMax - NumTableBits);
 			memset(this->lens+index, len, limit-index); index = limit;
 		}
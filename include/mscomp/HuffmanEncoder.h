@@ -55,10 +55,11 @@ private:
 }
 
 public:
-	const_bytes CreateCodes(uint32_t symbol_counts[NumSymbols]) // 17 kb stack (for NumSymbols == 0x200)
+	const_bytes CreateCodes(uint32_t symbol_counts[NumSymbols]) // 7 kb stack (for NumSymbols == 0x200)
 	{
 		// Creates Length-Limited Huffman Codes using an optimized version of the original Huffman algorithm
 		// Does not always produce optimal codes
+		PHASE_SCOPE(MSCOMP_PHASE_CREATE_CODES);
 		// Algorithm from "In-Place Calculation of Minimum-Redundancy Codes" by A Moffat and J Katajainen
 		// Code adapted from bzip2. See http://www.bzip.org/.
 		memset(this->codes, 0, sizeof(this->codes));
@@ -71,11 +72,13 @@ public:
 		for (;;)
 		{
 			// Build the initial heap
-			uint_fast16_t heap_len = 0, heap[NumSymbols + 2] = { 0 }; // heap of symbols, 1 to heap_len
+			uint_fast16_t heap_len = 0;
+			uint16_t heap[NumSymbols + 2] = { 0 }; // heap of symbols, 1 to heap_len
 			for (uint_fast16_t i = 1; i <= NumSymbols; ++i) { HEAP_PUSH(i); }
 
 			// Build the tree (its a bottom-up tree)
-			uint_fast16_t n_nodes = NumSymbols, parents[NumSymbols * 2]; // parents of nodes, 1 to n_nodes
+			uint_fast16_t n_nodes = NumSymbols;
+			uint16_t parents[NumSymbols * 2]; // parents of nodes, 1 to n_nodes
 			memset(parents, 0, sizeof(parents));
 			while (heap_len > 1)
 			{
@@ -126,10 +129,11 @@ public:
 		return this->lens;
 	}
 
-	const_bytes CreateCodesSlow(uint32_t symbol_counts[NumSymbols]) // 519 kb stack (for NumSymbols == 0x200)
+	const_bytes CreateCodesSlow(uint32_t symbol_counts[NumSymbols]) // 11 kb stack (for NumSymbols == 0x200)
 	{
 		// Creates Length-Limited Huffman Codes using the package-merge algorithm
 		// Always produces optimal codes but is significantly slower than the Huffman algorithm
+		PHASE_SCOPE(MSCOMP_PHASE_CREATE_CODES);
 		memset(this->codes, 0, sizeof(this->codes));
 		memset(this->lens,  0, sizeof(this->lens));
 
@@ -147,61 +151,70 @@ public:
 		else
 		{
 			///// Package-Merge Algorithm /////
-			typedef struct _collection // 516 bytes each
-			{
-				byte symbols[NumSymbols];
-				uint_fast16_t count;
-			} collection;
-			collection _cols[NumSymbols], *cols = _cols, _next_cols[NumSymbols], *next_cols = _next_cols; // 2*516*512 = 516 kb
-			uint_fast16_t cols_len = 0, next_cols_len = 0;
-
-			// Start at the lowest value row, adding new collection
+			// Each row merges the packages from the previous row with the symbols (both sorted by
+			// count) and pairs them up into the packages for the next row. If a row has an odd number
+			// of items the last one is dropped, reducing the lengths of all symbols within it.
+			// Instead of keeping which symbols are in every package, only whether each item of a row
+			// was a package or a symbol is recorded. Afterwards the dropped items are expanded back
+			// into their symbols by going through the rows in reverse.
+			uint32_t _counts[NumSymbols], _next_counts[NumSymbols], *counts = _counts, *next_counts = _next_counts; // 2*4*512 = 4 kb
+			uint32_t is_pkg[NumBitsMax][NumSymbols*2/32]; // 15*2*512/8 = 1.875 kb
+			uint_fast16_t n_items[NumBitsMax], cols_len = 0;
+
+			// Start at the lowest value row, adding new packages
 			for (uint_fast16_t j = 0; j < NumBitsMax; ++j)
 			{
-				uint_fast16_t cols_pos = 0, pos = 0;
+				uint_fast16_t cols_pos = 0, pos = 0, n = 0, next_cols_len = 0;
+				uint32_t* const row = is_pkg[j];
+				memset(row, 0, sizeof(is_pkg[j]));
 
-				// All but the last one/none get added to collections
+				// All but the last one/none get added to packages
 				while ((cols_len-cols_pos + len-pos) > 1)
 				{
-					memset(next_cols+next_cols_len, 0, sizeof(collection));
-					for (uint_fast16_t i = 0; i < 2; ++i) // hopefully unrolled...
+					uint32_t count = 0;
+					for (uint_fast16_t i = 0; i < 2; ++i, ++n) // hopefully unrolled...
 					{
-						if (pos >= len || (cols_pos < cols_len && cols[cols_pos].count < symbol_counts[syms_by_count[pos]]))
+						if (pos >= len || (cols_pos < cols_len && counts[cols_pos] < symbol_counts[syms_by_count[pos]]))
 						{
-							// Add cols[cols_pos]
-							next_cols[next_cols_len].count += cols[cols_pos].count;
-							for (uint_fast16_t s = 0; s < NumSymbols; ++s)
-							{
-								next_cols[next_cols_len].symbols[s] += cols[cols_pos].symbols[s];
-							}
-							++cols_pos;
+							// Add counts[cols_pos]
+							count += counts[cols_pos++];
+							row[n>>5] |= (uint32_t)1 << (n&31);
 						}
 						else
 						{
 							// Add syms[pos]
-							next_cols[next_cols_len].count += symbol_counts[syms_by_count[pos]];
-							++next_cols[next_cols_len].symbols[syms_by_count[pos]];
-							++pos;
+							count += symbol_counts[syms_by_count[pos++]];
 						}
 					}
-					++next_cols_len;
-				}
-			
-				// Leftover gets dropped
-				if (cols_pos < cols_len)
-				{
-					const byte* const syms = cols[cols_pos].symbols;
-					for (uint_fast16_t i = 0; i < NumSymbols; ++i) { this->lens[i] -= syms[i]; }
-				}
-				else if (pos < len)
-				{
-					--this->lens[syms_by_count[pos]];
+					next_counts[next_cols_len++] = count;
 				}
 
-				// Move the next_collections to the current collections
-				collection* temp = cols; cols = next_cols; next_cols = temp;
+				// Leftover gets dropped (it is the last item in the row)
+				if (cols_pos < cols_len) { row[n>>5] |= (uint32_t)1 << (n&31); ++n; }
+				else if (pos < len) { ++n; }
+				n_items[j] = n;
+
+				// Move the next packages to the current packages
+				uint32_t* temp = counts; counts = next_counts; next_counts = temp;
 				cols_len = next_cols_len;
-				next_cols_len = 0;
+			}
+
+			// Go back through the rows, expanding the dropped items into their symbols
+			// Package p of a row is made from items 2p and 2p+1 of the previous row
+			byte _dropped[NumSymbols*2], _prev_dropped[NumSymbols*2], *dropped = _dropped, *prev_dropped = _prev_dropped; // 2*2*512 = 2 kb
+			memset(dropped, 0, n_items[NumBitsMax-1]);
+			for (uint_fast16_t j = NumBitsMax; j-- > 0; )
+			{
+				const uint32_t* const row = is_pkg[j];
+				const uint_fast16_t n = n_items[j];
+				if (n & 1) { dropped[n-1] = 1; }
+				if (j) { memset(prev_dropped, 0, n_items[j-1]); }
+				for (uint_fast16_t i = 0, p = 0, s = 0; i < n; ++i)
+				{
+					if (row[i>>5] & ((uint32_t)1 << (i&31))) { if (dropped[i]) { prev_dropped[p<<1] = prev_dropped[(p<<1)+1] = 1; } ++p; }
+					else { this->lens[syms_by_count[s++]] -= dropped[i]; }
+				}
+				byte* temp = dropped; dropped = prev_dropped; prev_dropped = temp;
 			}
 
 
@@ -19,10 +19,11 @@
 // The dictionary system used for LZNT1 compression that favors speed over memory usage.
 // Most of the compression time is spent in the dictionary, particularly Find (72%) and Fill (19%).
 //
-// The base memory usage is 512 KB (or 768 KB on 64-bit systems). More memory is always allocated
-// but only as much as needed. For a series of 4 KB chunks (what LZNT1 uses), the extra consumed
-// memory averages about 715 KB (1430 KB on 64-bit) in test, but could theoretically grow to 1 GB
-// (2 GB on 64-bit)!
+// The base memory usage is 512 KB (or 1152 KB on 64-bit systems). More memory is always allocated
+// but only as much as needed. Positions are stored as 16-bit offsets from the start of the chunk
+// (chunks are at most 4 KB). For a series of 4 KB chunks (what LZNT1 uses), the extra consumed
+// memory averages about 360 KB in test, but could theoretically grow to 512 MB (65536 entries of
+// 4096 2-byte positions, half of the 1 GB it was with 32-bit pointers)!
 //
 // This implementation is about twice as fast as the SA version but consumes about 17-35x as much
 // memory on average (and could be tons more) and requires dynamic allocations.
@@ -35,63 +36,84 @@
 #ifndef MSCOMP_LZNT1_DICTIONARY_H
 #define MSCOMP_LZNT1_DICTIONARY_H
 
-class LZNT1Dictionary // 512+ KB (768+ KB on 64-bit systems)
+class LZNT1Dictionary // 512+ KB (1152+ KB on 64-bit systems)
 {
 private:
 	// An entry within the dictionary, using a dynamically resized array of positions
-	struct Entry // 6+ bytes (10+ bytes on 64-bit systems)
+	struct Entry // 6+ bytes (16+ bytes on 64-bit systems)
 	{
-		const_bytes* pos;
+		uint16_t* pos;
 		int16_t cap;
-		INLINE bool add(const const_rest_bytes data, const int16_t size)
+		INLINE bool add(const uint16_t off, const int16_t size, const mscomp_allocator* allocator)
 		{
 			if (size >= this->cap)
 			{
-				const_bytes *temp = (const_bytes*)realloc((bytes*)this->pos, (this->cap=(this->cap?(this->cap<<1):4))*sizeof(const_bytes));
+				const int16_t cap = (int16_t)(this->cap ? (this->cap<<1) : 4);
+				uint16_t *temp = (uint16_t*)MS_REALLOC(allocator, this->pos, this->cap*sizeof(uint16_t), cap*sizeof(uint16_t));
 				if (UNLIKELY(temp == NULL)) { return false; }
 				this->pos = temp;
+				this->cap = cap;
 			}
-			this->pos[size] = data;
+			this->pos[size] = off;
 			return true;
 		}
 	};
 
 	// The dictionary
-	const_bytes data;
-	Entry entries[0x100*0x100]; // 384/640 KB
+	mscomp_allocator allocator; // used for the entries
+	const_bytes data, end;
+	Entry entries[0x100*0x100]; // 384/1024 KB
 	int16_t sizes[0x100*0x100]; // 128 KB
 
 public:
-	INLINE LZNT1Dictionary()
+	INLINE LZNT1Dictionary(const mscomp_allocator* allocator = &ms_global_allocator) : allocator(*allocator)
 	{
 		// need to set pos to NULL and cap to 0
 		memset(this->entries, 0, 0x100*0x100*sizeof(Entry));
+		memset(this->sizes, 0, 0x100*0x100*sizeof(uint16_t));
+		this->data = this->end = NULL;
 	}
 
 	INLINE ~LZNT1Dictionary()
 	{
 		for (uint32_t idx = 0; idx < 0x100*0x100; ++idx)
 		{
-			free(this->entries[idx].pos);
+			MS_FREE(&this->allocator, this->entries[idx].pos, this->entries[idx].cap*sizeof(uint16_t));
 		}
 	}
 
 	// Fills the dictionary, ready to start a new chunk
-	// This should also be called before any Find
+	// This should also be called before any Find and must be followed by Clear once done with the chunk
 	bool Fill(const_rest_bytes data, const int_fast16_t len)
 	{
 		this->data = data;
 		Entry* const RESTRICT entries = this->entries;
 		int16_t* const RESTRICT sizes = this->sizes;
-		memset(sizes, 0, 0x100*0x100*sizeof(uint16_t));
 		uint16_t idx = data[0];
-		for (const_bytes end = data + len - 2; data < end; ++data)
+		this->end = data + len - 2;
+		for (uint16_t off = 0; off < len - 2; ++off)
 		{
-			idx = idx << 8 | data[1];
-			if (UNLIKELY(!entries[idx].add(data, sizes[idx]++))) { return false; }
+			idx = idx << 8 | data[off+1];
+			if (UNLIKELY(!entries[idx].add(off, sizes[idx]++, &this->allocator))) { return false; }
 		}
 		return true;
 	}
+
+	// Empties the dictionary after a chunk, keeping all allocated memory
+	// Only the sizes that were set by Fill are cleared so the data given to Fill must still be available
+	INLINE void Clear()
+	{
+		int16_t* const RESTRICT sizes = this->sizes;
+		const_bytes data = this->data;
+		if (data == NULL) { return; }
+		uint16_t idx = data[0];
+		for (const_bytes end = this->end; data < end; ++data)
+		{
+			idx = idx << 8 | data[1];
+			sizes[idx] = 0;
+		}
+		this->data = this->end = NULL;
+	}
 	
 WARNINGS_PUSH()
 WARNINGS_IGNORE_POTENTIAL_UNINIT_VALRIABLE_USED()
@@ -106,14 +128,16 @@ WARNINGS_IGNORE_POTENTIAL_UNINIT_VALRIABLE_USED()
 			const uint_fast16_t idx = data[0] << 8 | data[1];
 			const byte z = data[2];
 			const int_fast16_t size = this->sizes[idx] - 1;
-			const const_rest_bytes* RESTRICT pos = this->entries[idx].pos;
+			const uint16_t* RESTRICT pos = this->entries[idx].pos;
+			const uint16_t data_off = (uint16_t)(data - this->data);
 			int_fast16_t len = 0;
 			const_rest_bytes found;
 
 			// Do an exhaustive search (with the possible positions)
-			for (int_fast16_t j = 0; j < size && pos[j] < data; ++j)
+			for (int_fast16_t j = 0; j < size && pos[j] < data_off; ++j)
 			{
-				const const_rest_bytes ss = pos[j];
+				const const_rest_bytes ss = this->data + pos[j];
+				STATS_ADD(candidates, 1);
 				if (ss[2] == z)
 				{
 					int_fast16_t i = 3;
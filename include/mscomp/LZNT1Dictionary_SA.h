@@ -403,7 +403,8 @@ private:
 	//}
 
 public:
-	INLINE LZNT1Dictionary() { this->lcp[0] = 0; }
+	INLINE LZNT1Dictionary(const mscomp_allocator* = NULL) { this->lcp[0] = 0; } // never allocates
+	INLINE void Clear() { } // every Fill rebuilds the entire suffix array
 	INLINE void Fill(const_rest_bytes data, const int_fast16_t len)
 	{
 		this->data = data;
@@ -440,6 +441,7 @@ WARNINGS_IGNORE_POTENTIAL_UNINIT_VALRIABLE_USED()
 			int_fast16_t min_lcp = lcp[sa_inv];
 			if (min_lcp > 2) // if sa_inv == 0 then lcp[sa_inv] == 0
 			{
+				STATS_ADD(candidates, 1);
 				const int_fast16_t sa_i = sa[sa_inv-1];
 				if (sa_i < pos) { len = min_lcp; found = sa_i; }
 				else
@@ -448,6 +450,7 @@ WARNINGS_IGNORE_POTENTIAL_UNINIT_VALRIABLE_USED()
 					{
 						const int_fast16_t lcp_i = lcp[i+1];
 						if (lcp_i < min_lcp) { if (lcp_i <= 2) { break; } min_lcp = lcp_i; }
+						STATS_ADD(candidates, 1);
 						const int_fast16_t sa_i = sa[i];
 						if (sa_i < pos) { len = min_lcp; found = sa_i; break; }
 					}
@@ -460,6 +463,7 @@ WARNINGS_IGNORE_POTENTIAL_UNINIT_VALRIABLE_USED()
 				int_fast16_t min_lcp = lcp[sa_inv+1];
 				if (min_lcp > len)
 				{
+					STATS_ADD(candidates, 1);
 					const int_fast16_t sa_i = sa[sa_inv+1];
 					if (sa_i < pos) { len = min_lcp; found = sa_i; }
 					else
@@ -468,6 +472,7 @@ WARNINGS_IGNORE_POTENTIAL_UNINIT_VALRIABLE_USED()
 						{
 							const int_fast16_t lcp_i = lcp[i];
 							if (lcp_i < min_lcp) { if (lcp_i <= len) { break; } min_lcp = lcp_i; }
+							STATS_ADD(candidates, 1);
 							const int_fast16_t sa_i = sa[i];
 							if (sa_i < pos) { len = min_lcp; found = sa_i; break; }
 						}
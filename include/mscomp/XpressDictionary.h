@@ -37,30 +37,57 @@ template<> struct XpressDictionaryLevel<8> { const static uint32_t NiceLength =
 WARNINGS_PUSH()
 WARNINGS_IGNORE_ASSIGNMENT_OPERATOR_NOT_GENERATED()
 
-template<uint32_t MaxOffset, uint32_t ChunkSize = MaxOffset, unsigned HashBits = 15, unsigned Level = 3>
+template<uint32_t MaxOffset, uint32_t ChunkSize = MaxOffset, unsigned HashBits = 15, unsigned Level = 3, typename Position = uint32_t>
 class XpressDictionary
-	// when ChunkSize is 0x02000: 192 kb (or  384 kb on 64-bit) [Xpress]
-	// when ChunkSize is 0x10000: 640 kb (or 1280 kb on 64-bit) [Xpress Huffman]
+	// when ChunkSize is 0x02000 with 16-bit positions:  96 kb [Xpress]
+	// when ChunkSize is 0x10000 with 32-bit positions: 640 kb [Xpress Huffman]
+	// Small dictionaries (for small inputs) use fewer hash bits and a smaller chunk size, for
+	// example with 11 hash bits, a chunk size of 0x400, and 16-bit positions: 8 kb
 {
 	//TODO: CASSERT(IS_POW2(ChunkSize));
 	CASSERT(MaxOffset <= ChunkSize);
 	CASSERT(HashBits >= 8 && HashBits <= 16);
+	CASSERT((uint64_t)MaxOffset + ChunkSize < (uint64_t)(Position)~(Position)0); // a chunk must fit after a Slide
 
 private:
 	// Window properties
 	static const uint32_t WindowSize = ChunkSize << 1;
 	static const uint32_t WindowMask = WindowSize-1;
 	FORCE_INLINE uint32_t WindowPos(const_bytes x) const { return (uint32_t)((x - this->start) & WindowMask); } // { return (uint32_t)((x - this->start) % WindowSize); }
+	FORCE_INLINE uint32_t WindowPos(size_t p) const { return (uint32_t)((p - this->base) & WindowMask); }
 
 	// The hashing function, which works progressively
 	static const uint32_t HashSize = 1 << HashBits;
 	static const uint32_t HashMask = HashSize - 1;
 	static const unsigned HashShift = (HashBits+2)/3;
+	static const size_t MaxPosition = (Position)~(Position)0;
 	FORCE_INLINE static uint_fast16_t HashUpdate(const uint_fast16_t h, const byte c) { return ((h<<HashShift) ^ c) & HashMask; }
 
-	const const_bytes start, end, end2;
-	const_bytes table[HashSize];
-	const_bytes window[WindowSize];
+	// Positions are stored as offsets from base instead of pointers. Every Reset moves base past all
+	// of the previous positions plus MaxOffset so that they can never be found again. This way the
+	// table only needs to be cleared when base would overflow instead of every time.
+	//
+	// Positions are kept small (16 or 32 bits) to keep the dictionary in the cache. When a chunk
+	// would not fit anymore all positions are slid down so that the chunk starts at MaxOffset + 1
+	// (base may wrap around, all position math is done modulo size_t). Positions more than
+	// MaxOffset before the chunk become 0, which is never found.
+	const_bytes start, end, end2;
+	size_t base;
+	Position table[HashSize];
+	Position window[WindowSize];
+	FORCE_INLINE size_t Pos(const_bytes x) const { return (size_t)(x - this->start) + this->base; }
+
+	FORCE_INLINE static void Slide(Position* RESTRICT x, const uint32_t n, const Position delta)
+	{
+		for (uint32_t i = 0; i < n; ++i) { x[i] = (Position)((x[i] > delta) ? x[i] - delta : 0); } // saturating subtract
+	}
+	NOINLINE void Slide(const_bytes data)
+	{
+		const Position delta = (Position)(Pos(data) - (MaxOffset + 1));
+		Slide(this->table, HashSize, delta);
+		Slide(this->window, WindowSize, delta);
+		this->base -= delta;
+	}
 	
 #ifdef MSCOMP_WITH_UNALIGNED_ACCESS
 	INLINE static uint32_t GetMatchLength(const_bytes a, const_bytes b, const const_bytes end, const const_bytes end4)
@@ -90,9 +117,28 @@ private:
 public:
 	typedef XpressDictionaryLevel<Level> LevelConfig;
 
-	INLINE XpressDictionary(const const_bytes start, const const_bytes end) : start(start), end(end), end2(end - 2)
+	INLINE XpressDictionary(const const_bytes start, const const_bytes end) : start(start), end(end), end2(end - 2), base(MaxOffset + 1)
+	{
+		memset(this->table, 0, HashSize*sizeof(Position));
+	}
+
+	// Creates an empty dictionary that must be Reset before it is used
+	INLINE XpressDictionary() : start(NULL), end(NULL), end2(NULL), base(MaxOffset + 1)
 	{
-		memset(this->table, 0, HashSize*sizeof(const_bytes));
+		memset(this->table, 0, HashSize*sizeof(Position));
+	}
+
+	// Starts using the dictionary for new data, forgetting all of the previous data
+	INLINE void Reset(const const_bytes start, const const_bytes end)
+	{
+		const size_t base = Pos(this->end) + MaxOffset + 1;
+		if (UNLIKELY(base > MaxPosition - ChunkSize))
+		{
+			memset(this->table, 0, HashSize*sizeof(Position));
+			this->base = MaxOffset + 1;
+		}
+		else { this->base = base; }
+		this->start = start; this->end = end; this->end2 = end - 2;
 	}
 
 	INLINE const_bytes Fill(const_bytes data)
@@ -100,16 +146,32 @@ public:
 		// equivalent to Add(data, ChunkSize)
 		uint32_t pos = WindowPos(data); // either 0x00000 or ChunkSize
 		const const_bytes end = ((data + ChunkSize) < this->end2) ? data + ChunkSize : this->end2;
+		if (UNLIKELY(data >= end)) { return data; } // less than 3 bytes left so nothing to add (and data[1] may be past the end)
+		if (UNLIKELY(Pos(data) > MaxPosition - ChunkSize)) { this->Slide(data); }
 		uint_fast16_t hash = HashUpdate(data[0], data[1]);
-		while (data < end)
+		for (size_t p = Pos(data); data < end; ++data, ++p)
 		{
 			hash = HashUpdate(hash, data[2]);
 			this->window[pos++] = this->table[hash];
-			this->table[hash] = data++;
+			this->table[hash] = (Position)p;
 		}
 		return end;
 	}
 
+	// Equivalent to Fill(data) when the chunk is a single repeated byte: every position except the
+	// last two has the same hash and is chained to the position before it. Find never follows a
+	// chain more than MaxChain steps so only the end of the run can ever be found and the rest of
+	// the positions are skipped.
+	INLINE const_bytes FillRun(const_bytes data)
+	{
+		const const_bytes end = ((data + ChunkSize) < this->end2) ? data + ChunkSize : this->end2;
+		if (UNLIKELY(data >= end)) { return data; }
+		if (UNLIKELY(Pos(data) > MaxPosition - ChunkSize)) { this->Slide(data); }
+		if ((size_t)(end - data) > (size_t)LevelConfig::MaxChain + 2) { data = end - ((size_t)LevelConfig::MaxChain + 2); }
+		this->Add(data, end - data);
+		return end;
+	}
+
 	INLINE void Add(const_bytes data)
 	{
 		if (data < this->end2)
@@ -117,7 +179,7 @@ public:
 			// TODO: could make this more efficient by keeping track of the last hash
 			uint_fast16_t hash = HashUpdate(HashUpdate(data[0], data[1]), data[2]);
 			this->window[WindowPos(data)] = this->table[hash];
-			this->table[hash] = data++;
+			this->table[hash] = (Position)Pos(data);
 		}
 	}
 	
@@ -125,33 +187,35 @@ public:
 	{
 		uint32_t pos = WindowPos(data);
 		const const_bytes end = ((data + len) < this->end2) ? data + len : this->end2;
+		if (UNLIKELY(data >= end)) { return; }
 		uint_fast16_t hash = HashUpdate(data[0], data[1]);
-		while (data < end)
+		for (size_t p = Pos(data); data < end; ++data, ++p)
 		{
 			hash = HashUpdate(hash, data[2]);
 			this->window[pos++] = this->table[hash];
-			this->table[hash] = data++;
+			this->table[hash] = (Position)p;
 		}
 	}
 
-	INLINE uint32_t Find(const const_bytes data, uint32_t* offset) const
+	// Matches are only compared up to max_len bytes, but never fewer than NiceLength so that the
+	// same match is chosen no matter what max_len is (the returned length may still be longer)
+	INLINE uint32_t Find(const const_bytes data, uint32_t* offset, const uint32_t max_len = UINT32_MAX) const
 	{
-#if PNTR_BITS <= 32
-		const const_bytes end = this->end; // on 32-bit, + UINT32_MAX will always overflow
-#else
-		const const_bytes end = ((data + UINT32_MAX) < data || (data + UINT32_MAX) >= this->end) ? this->end : data + UINT32_MAX; // if overflow or past end use the end
-#endif
+		const size_t limit = MAX(max_len, LevelConfig::NiceLength), avail = this->end - data;
+		const size_t cap = (limit >= UINT32_MAX) ? UINT32_MAX : limit + 1; // GetMatchLength never reaches the end
+		const const_bytes end = (avail > cap) ? data + cap : this->end;
 #ifdef MSCOMP_WITH_UNALIGNED_ACCESS
-		const const_bytes xend = data - MaxOffset, end4 = end - 4;
+		const const_bytes end4 = end - 4;
 		const uint16_t prefix = *(uint16_t*)data;
 #else
-		const const_bytes xend = data - MaxOffset;
 		const byte prefix0 = data[0], prefix1 = data[1];
 #endif
-		const_bytes x;
+		const size_t pend = Pos(data) - MaxOffset; // never underflows since base > MaxOffset
 		uint32_t len = 2, chain_length = LevelConfig::MaxChain;
-		for (x = this->window[WindowPos(data)]; chain_length && x >= xend; x = this->window[WindowPos(x)], --chain_length)
+		for (size_t p = this->window[WindowPos(data)]; chain_length && p >= pend; p = this->window[WindowPos(p)], --chain_length)
 		{
+			const const_bytes x = this->start + (p - this->base);
+			STATS_ADD(chain_steps, 1);
 #ifdef MSCOMP_WITH_UNALIGNED_ACCESS
 			if (*(uint16_t*)x == prefix)
 			{
@@ -55,6 +55,106 @@
 #define MSCOMP_WITH_WARNING_MESSAGES
 #endif
 
+// CPU_DISPATCH - Runtime CPU dispatch
+// The hot loops are compiled multiple times for different instruction sets (generic, SSE4.2/POPCNT,
+// and AVX2/BMI2/LZCNT) and the best version is selected when the library is loaded. This allows a
+// single binary to be fast on new processors and still run on old ones. Currently only available
+// with GCC 6+ and Clang 14+ on ELF platforms (e.g. Linux) for x86, ignored everywhere else.
+#if !defined(MSCOMP_WITH_CPU_DISPATCH) && !defined(MSCOMP_WITHOUT_CPU_DISPATCH)
+#define MSCOMP_WITH_CPU_DISPATCH
+#endif
+
+// SMALL_STACK - Keep large working memory off of the stack
+// With this option the single-call compressors allocate their dictionaries with the global
+// allocator instead of putting them on the stack (up to 1 MB for LZNT1) so that they can run on
+// threads with small stacks (e.g. fibers, coroutines, and thread pool workers with 64 KB stacks).
+// This adds an allocation to every call. The compression contexts (ms_compress_ctx) and the
+// streaming functions never put dictionaries on the stack and need less than 32 KB of stack either
+// way, so they are the better choice when compressing many small inputs on small stacks. Disabled
+// by default.
+#if !defined(MSCOMP_WITH_SMALL_STACK) && !defined(MSCOMP_WITHOUT_SMALL_STACK)
+#define MSCOMP_WITHOUT_SMALL_STACK
+#endif
+
+// THREADS - Use multiple threads
+// Allows parallel work (e.g. ms_compress_batch and ms_decompress_batch) to be spread across the
+// threads of an executor and includes the built-in work-stealing thread pool. Requires pthreads on
+// non-Windows systems (e.g. link with -pthread). Without this option all work is done on the
+// calling thread.
+#if !defined(MSCOMP_WITH_THREADS) && !defined(MSCOMP_WITHOUT_THREADS)
+#define MSCOMP_WITH_THREADS
+#endif
+
+// STATS - Gather statistics
+// Counts what the compressors and decompressors do (matches, literals, dictionary searching, and
+// which decompression loops are used) for ms_get_stats, mainly to find out why some data is slow.
+// Adds a little overhead to the hot loops when enabled and none otherwise. Disabled by default.
+#if !defined(MSCOMP_WITH_STATS) && !defined(MSCOMP_WITHOUT_STATS)
+#define MSCOMP_WITHOUT_STATS
+#endif
+
+// PHASES - Phase markers
+// Calls the hook given to ms_set_phase_hook at the start and end of each phase of compression and
+// decompression (dictionary filling, match finding, Huffman code creation and encoding, and the
+// decoding loops) so profilers, like the hardware counters in mscomp_bench, can break down where
+// the time goes. Adds a check of the hook around each phase when enabled and nothing otherwise.
+// Disabled by default.
+#if !defined(MSCOMP_WITH_PHASES) && !defined(MSCOMP_WITHOUT_PHASES)
+#define MSCOMP_WITHOUT_PHASES
+#endif
+
+// TRACE - Chunk trace callbacks
+// Lets streams and contexts have a function that is called after each LZNT1 (4 KB) or Xpress
+// Huffman (64 KB) chunk with its sizes, if it was stored uncompressed, and the time it took (and
+// the time of each phase with MSCOMP_WITH_PHASES), see ms_stream_set_trace. Adds a check for the
+// function around each chunk when enabled and nothing otherwise. Disabled by default.
+#if !defined(MSCOMP_WITH_TRACE) && !defined(MSCOMP_WITHOUT_TRACE)
+#define MSCOMP_WITHOUT_TRACE
+#endif
+
+// CHECKSUM - Fused checksums
+// Computes the CRC32C of the uncompressed data along with compression and decompression (see
+// ms_compress_checksum) instead of in a separate pass. Adds a check around each chunk when enabled
+// and nothing otherwise. Enabled by default.
+#if !defined(MSCOMP_WITH_CHECKSUM) && !defined(MSCOMP_WITHOUT_CHECKSUM)
+#define MSCOMP_WITH_CHECKSUM
+#endif
+
+// STREAM_CHECKSUM - Stream checksums
+// Adds the checksumming and checksum fields to mscomp_stream so streams can keep the CRC32C of
+// their uncompressed data, see ms_stream_set_checksum. This changes the layout of mscomp_stream, so
+// everything using the library (including test/compressors.py) must agree on it. Adds a check to
+// each ms_deflate and ms_inflate call when enabled and nothing otherwise. Disabled by default.
+#if !defined(MSCOMP_WITH_STREAM_CHECKSUM) && !defined(MSCOMP_WITHOUT_STREAM_CHECKSUM)
+#define MSCOMP_WITHOUT_STREAM_CHECKSUM
+#endif
+
+// USDT - Static tracing probes
+// Adds the USDT probes mscomp:chunk_start and mscomp:chunk_done around each chunk, at the same
+// places as the trace callbacks, so tools like bpftrace can trace a running program without
+// rebuilding it. Each probe is a single nop until something attaches to it. Requires <sys/sdt.h>
+// (SystemTap SDT headers). Enabled by default when it is available.
+#if !defined(MSCOMP_WITH_USDT) && !defined(MSCOMP_WITHOUT_USDT)
+#if defined(__linux__) && defined(__has_include)
+#if __has_include(<sys/sdt.h>)
+#define MSCOMP_WITH_USDT
+#endif
+#endif
+#ifndef MSCOMP_WITH_USDT
+#define MSCOMP_WITHOUT_USDT
+#endif
+#endif
+
+// SKIP_INCOMPRESSIBLE - Skip match finding for incompressible data
+// Each chunk is quickly checked for repeats before the dictionary is used. LZNT1 chunks without
+// enough of them are stored uncompressed and Xpress Huffman chunks are encoded with only literals
+// right away. Match searching also backs off in places where no matches are found (like LZ4's
+// acceleration). This makes compressed, encrypted, and other random data several times faster to
+// compress at the cost of very slightly larger output for some data.
+#if !defined(MSCOMP_WITH_SKIP_INCOMPRESSIBLE) && !defined(MSCOMP_WITHOUT_SKIP_INCOMPRESSIBLE)
+#define MSCOMP_WITH_SKIP_INCOMPRESSIBLE
+#endif
+
 // LZNT1, XPRESS, XPRESS_HUFF, LZX
 // Enable/disable support for a specific algorithm.
 #if !defined(MSCOMP_WITH_LZNT1) && !defined(MSCOMP_WITHOUT_LZNT1)
@@ -60,6 +60,7 @@ typedef const byte const_byte;
 typedef const_byte* const_bytes;
 
 typedef struct _mscomp_internal_state mscomp_internal_state;
+typedef struct _mscomp_context mscomp_context;
 
 // Formats supported
 typedef enum _MSCompFormat {
@@ -84,6 +85,10 @@ typedef enum _MSCompStatus
 	MSCOMP_BUF_ERROR			= -5
 } MSCompStatus;
 
+// The number of bytes that must be readable after the input and writable after the output when
+// using the *_decompress_slack functions
+#define MSCOMP_DECOMPRESS_SLACK 512
+
 // Flush Codes
 typedef enum _MSCompFlush
 {
@@ -92,6 +97,101 @@ typedef enum _MSCompFlush
 	MSCOMP_FINISH    = 4
 } MSCompFlush;
 
+// Memory Allocator
+// All functions are given the opaque value. The realloc and free functions are also given the size
+// that the memory was allocated with so that allocators do not need to keep track of sizes.
+typedef struct _mscomp_allocator {
+	void* (*alloc)(void* opaque, size_t size);
+	void* (*realloc)(void* opaque, void* ptr, size_t old_size, size_t size);
+	void  (*free)(void* opaque, void* ptr, size_t size);
+	void* opaque;
+} mscomp_allocator;
+
+// Statistics
+// The counters gathered with MSCOMP_WITH_STATS, see ms_get_stats
+typedef struct _mscomp_stats {
+	// Compression
+	uint64_t matches;		// matches found and used
+	uint64_t literals;		// bytes not covered by a match
+	uint64_t chain_steps;	// positions visited in the Xpress dictionary hash chains
+	uint64_t candidates;	// positions checked by the LZNT1 dictionary
+	uint64_t no_matching;	// Xpress Huffman chunks redone without matches to stay under the max size
+							// (the matches and literals found before are still counted)
+	uint64_t run_chunks;	// chunks of a single repeated byte that skipped the dictionary
+	uint64_t incompressible;	// chunks with too few matches to search, see MSCOMP_WITH_SKIP_INCOMPRESSIBLE
+
+	// Decompression
+	uint64_t fast_bytes;	// bytes output by the fast loops with few bounds checks
+	uint64_t slow_bytes;	// bytes output by the fully checked loops near the ends of the buffers
+} mscomp_stats;
+
+// Phases
+// The parts of compression and decompression reported to the hook given to ms_set_phase_hook (only
+// with MSCOMP_WITH_PHASES). Phases can be nested, for example the Xpress dictionary is filled a
+// window at a time while finding matches.
+typedef enum _MSCompPhase {
+	MSCOMP_PHASE_FILL			= 0, // filling the dictionary
+	MSCOMP_PHASE_FIND			= 1, // finding matches and writing the matches and literals
+	MSCOMP_PHASE_CREATE_CODES	= 2, // creating the Huffman codes for a chunk
+	MSCOMP_PHASE_ENCODE			= 3, // writing the Huffman encoded symbols of a chunk
+	MSCOMP_PHASE_DECODE			= 4, // the decompression loops
+	MSCOMP_PHASE_COUNT			= 5
+} MSCompPhase;
+typedef void (*mscomp_phase_hook)(void* opaque, MSCompPhase phase, bool begin);
+
+// Chunk Trace
+// Describes a chunk that was just completed to the trace function of a stream or context (only
+// with MSCOMP_WITH_TRACE, see ms_stream_set_trace). The lengths include the chunk headers and
+// Huffman tables. The phase times are only gathered with MSCOMP_WITH_PHASES and the time of a
+// nested phase is also included in the phase around it.
+typedef struct _mscomp_chunk_trace {
+	MSCompFormat	format;
+	bool			compressing;
+	bool			stored;		// the chunk was stored uncompressed
+	size_t			in_len;
+	size_t			out_len;
+	uint64_t		ns;			// the time spent on the chunk, in nanoseconds
+	uint64_t		phase_ns[MSCOMP_PHASE_COUNT];
+} mscomp_chunk_trace;
+typedef void (*mscomp_trace_func)(void* opaque, const mscomp_chunk_trace* trace);
+
+// Task Executor
+// Lets the library run its parallel work on an existing thread pool. The submit function must
+// eventually call task(arg) once on any thread, returning true, or return false if the task cannot
+// be queued (the library then does the work itself). The library never blocks waiting for a task
+// that has not started yet, so it is safe to use the library from within the tasks of the same
+// executor and the executor does not need to provide any way to wait.
+typedef void (*mscomp_task)(void* arg);
+typedef struct _mscomp_executor {
+	bool (*submit)(void* opaque, mscomp_task task, void* arg);
+	void* opaque;
+} mscomp_executor;
+
+// Batch Item
+// One independent buffer for ms_compress_batch or ms_decompress_batch. The out_len is the size of
+// the output buffer going in and the number of bytes written coming out.
+typedef struct _mscomp_batch_item {
+	const_bytes		in;
+	size_t			in_len;
+	bytes			out;
+	size_t			out_len;
+	MSCompStatus	status;
+} mscomp_batch_item;
+
+// Automatic Format Selection
+// What ms_compress_auto optimizes for. Speeds are in MB/s (10^6 bytes of input per second) and
+// ratios are the input length divided by the output length.
+typedef enum _MSCompObjective {
+	MSCOMP_MAX_RATIO	= 0, // the smallest output from the formats that are at least min_speed
+	MSCOMP_MAX_SPEED	= 1  // the fastest format that is at least min_ratio
+} MSCompObjective;
+typedef struct _mscomp_auto_options {
+	MSCompObjective	objective;
+	double			min_speed;		// only used for MSCOMP_MAX_RATIO
+	double			min_ratio;		// only used for MSCOMP_MAX_SPEED
+	unsigned		sample_ratio;	// see ms_estimate_compressed_size, 0 for the default (16)
+} mscomp_auto_options;
+
 // Compression Stream Object
 typedef struct _mscomp_stream {
 	MSCompFormat	format;
@@ -111,6 +211,14 @@ typedef struct _mscomp_stream {
 #ifdef MSCOMP_WITH_WARNING_MESSAGES
 	char warning[256];
 #endif
+#ifdef MSCOMP_WITH_TRACE
+	mscomp_trace_func trace;	// see ms_stream_set_trace
+	void* trace_opaque;
+#endif
+#ifdef MSCOMP_WITH_STREAM_CHECKSUM
+	bool checksumming;			// see ms_stream_set_checksum
+	uint32_t checksum;			// CRC32C of the uncompressed data so far
+#endif
 
 	mscomp_internal_state* state;
 } mscomp_stream;
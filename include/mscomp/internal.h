@@ -176,6 +176,15 @@
 typedef byte* RESTRICT rest_bytes;
 typedef const_byte* RESTRICT const_rest_bytes;
 
+///// Get THREAD_LOCAL /////
+#if defined(_MSC_VER)
+#define THREAD_LOCAL __declspec(thread)
+#elif defined(__GNUC__)
+#define THREAD_LOCAL __thread
+#else
+#define THREAD_LOCAL
+#endif
+
 
 ///// Intrinsic and Built-in functions /////
 // The available compiler hints are:
@@ -345,6 +354,11 @@ typedef const_byte* RESTRICT const_rest_bytes;
 #define MIN(a, b) (((a) < (b)) ? (a) : (b))
 #define MAX(a, b) (((a) > (b)) ? (a) : (b))
 
+///// Check if data is a single repeated byte /////
+// Comparing the data to itself shifted by one byte runs at memory speed and stops at the first
+// difference, so it is cheap to try on any data
+FORCE_INLINE static bool is_run(const_bytes in, size_t len) { return len <= 1 || memcmp(in, in + 1, len - 1) == 0; }
+
 ///// Get SIZE_T format specifier /////
 #if defined(_WIN32) && (!defined(__USE_MINGW_ANSI_STDIO) || __USE_MINGW_ANSI_STDIO != 1)
 #define SSIZE_T_FMT "I"
@@ -369,6 +383,19 @@ typedef const_byte* RESTRICT const_rest_bytes;
 #define ENTRY_POINT
 #endif
 
+///// Runtime CPU dispatch /////
+// CPU_DISPATCH is placed on the functions containing the hot loops. They are compiled for several
+// instruction sets and the best one for the current processor is chosen at load time (using GNU
+// indirect functions). Everything inlined into them (FAST_COPY, count_leading_zeros, log2, Huffman
+// decoding, ...) is compiled along with them. It is not used if the whole library is already being
+// compiled for AVX2 (e.g. with -march=native on a new processor) since there would be no benefit.
+#if defined(MSCOMP_WITH_CPU_DISPATCH) && defined(__ELF__) && (defined(__x86_64__) || defined(__i386__)) && !defined(__AVX2__) && \
+	((defined(__clang__) && __clang_major__ >= 14) || (!defined(__clang__) && defined(__GNUC__) && __GNUC__ >= 6))
+#define CPU_DISPATCH __attribute__((target_clones("arch=haswell", "arch=nehalem", "default")))
+#else
+#define CPU_DISPATCH
+#endif
+
 ///// Warning disable support /////
 #if defined(_MSC_VER)
 #define WARNINGS_PUSH() __pragma(warning(push))
@@ -429,6 +456,239 @@ typedef const_byte* RESTRICT const_rest_bytes;
 #define INIT_STREAM_WARNING_MESSAGE(s)
 #endif
 
+#ifdef MSCOMP_WITH_TRACE
+#define INIT_STREAM_TRACE(s) s->trace = NULL; s->trace_opaque = NULL
+#else
+#define INIT_STREAM_TRACE(s)
+#endif
+
+///// Memory allocation /////
+// Streams and the one-shot functions use the global allocator (set with ms_set_allocator) while
+// contexts use the allocator they were created with
+extern mscomp_allocator ms_global_allocator;
+#define MS_ALLOC(a, size)					((a)->alloc((a)->opaque, (size)))
+#define MS_REALLOC(a, ptr, old_size, size)	((a)->realloc((a)->opaque, (ptr), (old_size), (size)))
+#define MS_FREE(a, ptr, size)				((a)->free((a)->opaque, (ptr), (size)))
+
+///// Statistics /////
+// The counters of the calling thread, see ms_get_stats. STATS_ADD(name, n) adds to one of the
+// counters and STATS_ONLY(x) includes x only when gathering statistics (e.g. for locals that are
+// used to calculate the counters). Both are nothing without MSCOMP_WITH_STATS.
+//
+// The decompressors keep the amount of output from their fast loop in a local (set when leaving the
+// loop) and use STATS_DECOMPRESSED(total, fast) once they succeed to split the output between the
+// fast_bytes and slow_bytes counters.
+#ifdef MSCOMP_WITH_STATS
+extern THREAD_LOCAL mscomp_stats ms_stats;
+#define STATS_ADD(name, n)				(ms_stats.name += (n))
+#define STATS_ONLY(...)					__VA_ARGS__
+#define STATS_DECOMPRESSED(total, fast)	(ms_stats.fast_bytes += (fast), ms_stats.slow_bytes += (total) - (fast))
+#else
+#define STATS_ADD(name, n)
+#define STATS_ONLY(...)
+#define STATS_DECOMPRESSED(total, fast)
+#endif
+
+///// Chunk Tracing /////
+// TRACE_CHUNK_START(format, compressing) goes right before a chunk is compressed or decompressed
+// and TRACE_CHUNK_DONE(format, compressing, stored, in_len, out_len) in the same block once it has
+// completed successfully. Together they call the trace function that is current on the calling
+// thread (MSCOMP_WITH_TRACE) and fire the USDT probes (MSCOMP_WITH_USDT). TRACE_ONLY(x) includes x
+// only when chunks are traced in either way (e.g. to remember where the chunk started).
+//
+// TRACE_SCOPE(func, opaque) makes the trace function of a stream or context the current one for
+// the rest of the block so that the chunk functions do not need to know where they are called from.
+#ifdef MSCOMP_WITH_USDT
+#include <sys/sdt.h>
+#define USDT_CHUNK_START(format, compressing) \
+	DTRACE_PROBE2(mscomp, chunk_start, (int)(format), (int)(compressing))
+#define USDT_CHUNK_DONE(format, compressing, stored, in_len, out_len) \
+	DTRACE_PROBE5(mscomp, chunk_done, (int)(format), (int)(compressing), (int)(stored), (size_t)(in_len), (size_t)(out_len))
+#else
+#define USDT_CHUNK_START(format, compressing)
+#define USDT_CHUNK_DONE(format, compressing, stored, in_len, out_len)
+#endif
+
+uint64_t ms_time_ns(); // a monotonic clock
+
+#ifdef MSCOMP_WITH_TRACE
+struct ms_trace_target { mscomp_trace_func func; void* opaque; };
+extern THREAD_LOCAL ms_trace_target ms_trace;
+extern THREAD_LOCAL uint64_t ms_trace_phase_ns[MSCOMP_PHASE_COUNT];
+void ms_trace_chunk(MSCompFormat format, bool compressing, bool stored, size_t in_len, size_t out_len, uint64_t start);
+FORCE_INLINE static uint64_t ms_trace_chunk_start()
+{
+	if (LIKELY(ms_trace.func == NULL)) { return 0; }
+	memset(ms_trace_phase_ns, 0, sizeof(ms_trace_phase_ns));
+	return ms_time_ns();
+}
+class TraceScope
+{
+	const ms_trace_target saved;
+public:
+	FORCE_INLINE TraceScope(mscomp_trace_func func, void* opaque) : saved(ms_trace) { ms_trace.func = func; ms_trace.opaque = opaque; }
+	FORCE_INLINE ~TraceScope() { ms_trace = this->saved; }
+};
+#define TRACE_SCOPE(func, opaque) const TraceScope _trace_scope(func, opaque)
+#define TRACE_CHUNK_START(format, compressing) \
+	USDT_CHUNK_START(format, compressing); \
+	const uint64_t _trace_start = ms_trace_chunk_start()
+#define TRACE_CHUNK_DONE(format, compressing, stored, in_len, out_len) \
+	USDT_CHUNK_DONE(format, compressing, stored, in_len, out_len); \
+	if (UNLIKELY(ms_trace.func != NULL)) { ms_trace_chunk(format, compressing, stored, in_len, out_len, _trace_start); }
+#else
+#define TRACE_SCOPE(func, opaque)
+#define TRACE_CHUNK_START(format, compressing) USDT_CHUNK_START(format, compressing)
+#define TRACE_CHUNK_DONE(format, compressing, stored, in_len, out_len) USDT_CHUNK_DONE(format, compressing, stored, in_len, out_len)
+#endif
+
+#if defined(MSCOMP_WITH_TRACE) || defined(MSCOMP_WITH_USDT)
+#define TRACE_ONLY(...) __VA_ARGS__
+#else
+#define TRACE_ONLY(...)
+#endif
+
+///// Checksums /////
+// CHECKSUM(data, len) goes where the uncompressed data of a chunk was just read (compressing) or
+// written (decompressing) and adds it to the checksum that is current on the calling thread, if
+// any. The chunks must be given in order and exactly once. CHECKSUM_SCOPE(state) makes a checksum
+// current for the rest of the block. Nothing without MSCOMP_WITH_CHECKSUM.
+#ifdef MSCOMP_WITH_CHECKSUM
+struct ms_checksum_state { uint32_t crc; size_t len; };
+extern THREAD_LOCAL ms_checksum_state* ms_checksum;
+void ms_checksum_update(const_bytes data, size_t len);
+class ChecksumScope
+{
+	ms_checksum_state* const saved;
+public:
+	FORCE_INLINE ChecksumScope(ms_checksum_state* state) : saved(ms_checksum) { ms_checksum = state; }
+	FORCE_INLINE ~ChecksumScope() { ms_checksum = this->saved; }
+};
+#define CHECKSUM_SCOPE(state) const ChecksumScope _checksum_scope(state)
+#define CHECKSUM(data, len) if (UNLIKELY(ms_checksum != NULL)) { ms_checksum_update((data), (len)); }
+#else
+#define CHECKSUM_SCOPE(state)
+#define CHECKSUM(data, len) (void)(data)
+#endif
+#ifdef MSCOMP_WITH_STREAM_CHECKSUM
+#define INIT_STREAM_CHECKSUM(s) s->checksumming = false; s->checksum = 0
+#define RESET_STREAM_CHECKSUM(s) s->checksum = 0
+#else
+#define INIT_STREAM_CHECKSUM(s)
+#define RESET_STREAM_CHECKSUM(s)
+#endif
+
+///// Phases /////
+// PHASE_SCOPE(phase) marks the rest of the enclosing block (including any early returns from it) as
+// the given MSCompPhase for the phase hook, see ms_set_phase_hook, and for the phase times of the
+// chunk traces. Nothing without MSCOMP_WITH_PHASES. It must come before any labels that are jumped
+// to in the block.
+#ifdef MSCOMP_WITH_PHASES
+extern mscomp_phase_hook ms_phase_hook;
+extern void* ms_phase_opaque;
+class PhaseScope
+{
+	const MSCompPhase phase;
+#ifdef MSCOMP_WITH_TRACE
+	const uint64_t start; // 0 when no chunk is being traced
+#endif
+public:
+	FORCE_INLINE PhaseScope(const MSCompPhase phase) : phase(phase)
+#ifdef MSCOMP_WITH_TRACE
+		, start(UNLIKELY(ms_trace.func != NULL) ? ms_time_ns() : 0)
+#endif
+	{
+		if (UNLIKELY(ms_phase_hook != NULL)) { ms_phase_hook(ms_phase_opaque, phase, true); }
+	}
+	FORCE_INLINE ~PhaseScope()
+	{
+		if (UNLIKELY(ms_phase_hook != NULL)) { ms_phase_hook(ms_phase_opaque, this->phase, false); }
+#ifdef MSCOMP_WITH_TRACE
+		if (UNLIKELY(this->start != 0)) { ms_trace_phase_ns[this->phase] += ms_time_ns() - this->start; }
+#endif
+	}
+};
+#define PHASE_SCOPE(phase)	const PhaseScope _phase_scope(phase)
+#else
+#define PHASE_SCOPE(phase)
+#endif
+
+///// Incompressible data /////
+// few_matches(in, len) is true when a chunk has so few repeats that searching it for matches is a
+// waste of time (like compressed or encrypted data). It does a quick LZ4-like pass with a small
+// hash table of 4-byte sequences and stops as soon as enough of the chunk is covered by matches, so
+// it is only slow (about 1 ns/byte) on the data it then saves from the dictionary. Chunks are at
+// most 64 KB.
+//
+// Acceleration backs off match searching in the places where nothing is found, like LZ4: after
+// every 2^ACCEL_SHIFT failed searches in a row one more position is skipped (as a literal) between
+// each search. Finding a match goes back to searching every position.
+//
+// Without MSCOMP_WITH_SKIP_INCOMPRESSIBLE few_matches is always false and nothing is skipped.
+#ifdef MSCOMP_WITH_SKIP_INCOMPRESSIBLE
+#define FEW_MATCHES_HASH_BITS	12
+#define FEW_MATCHES_MIN_LEN		0x100	// smaller chunks are always searched
+#define FEW_MATCHES_FRACTION	32		// chunks with less than 1/32 of their bytes in matches
+#define ACCEL_SHIFT				6
+FORCE_INLINE static bool few_matches(const_bytes in, size_t len)
+{
+	if (len < FEW_MATCHES_MIN_LEN) { return false; }
+	uint16_t table[1 << FEW_MATCHES_HASH_BITS]; // 8 kb
+	memset(table, 0, sizeof(table));
+	const const_bytes start = in, end = in + len, end4 = end - 4;
+	size_t needed = len / FEW_MATCHES_FRACTION;
+	while (in < end4)
+	{
+		const uint32_t x = GET_UINT32_RAW(in);
+		const uint_fast16_t h = (uint_fast16_t)((x * 0x9E3779B1u) >> (32 - FEW_MATCHES_HASH_BITS));
+		const const_bytes ref = start + table[h];
+		table[h] = (uint16_t)(in - start);
+		if (ref < in && GET_UINT32_RAW(ref) == x)
+		{
+			const const_bytes match = in;
+			for (in += 4; in < end && *in == ref[in - match]; ++in);
+			if ((size_t)(in - match) >= needed) { return false; }
+			needed -= in - match;
+		}
+		else { ++in; }
+	}
+	STATS_ADD(incompressible, 1);
+	return true;
+}
+class Acceleration
+{
+	uint32_t misses, skip;
+public:
+	FORCE_INLINE Acceleration() : misses(0), skip(0) { }
+	// True if the next position should not be searched
+	FORCE_INLINE bool Skip() { if (this->skip) { --this->skip; return true; } return false; }
+	// Records the result of a search, returning found
+	FORCE_INLINE bool Found(const bool found) { if (found) { this->misses = 0; } else { this->skip = ++this->misses >> ACCEL_SHIFT; } return found; }
+};
+#else
+#define few_matches(in, len) false
+class Acceleration
+{
+public:
+	FORCE_INLINE bool Skip() { return false; }
+	FORCE_INLINE bool Found(const bool found) { return found; }
+};
+#endif
+
+///// Reusable compression context /////
+// Each format allocates and owns its own slot the first time it is used with the context
+struct _mscomp_context
+{
+	mscomp_allocator allocator;
+	void* lznt1;
+	void* xpress;
+	void* xpress_huff;
+#ifdef MSCOMP_WITH_TRACE
+	mscomp_trace_func trace; // see ms_context_set_trace
+	void* trace_opaque;
+#endif
+};
+
 ///// Stream initialization and checking /////
 #define INIT_STREAM(s, c, f) \
 	if (UNLIKELY(s == NULL)) { SET_ERROR(s, "Error: Invalid stream provided"); return MSCOMP_ARG_ERROR; } \
@@ -436,13 +696,31 @@ typedef const_byte* RESTRICT const_rest_bytes;
 	s->in = NULL; s->out = NULL; \
 	s->in_avail = 0; s->out_avail = 0; \
 	s->in_total = 0; s->out_total = 0; \
-	INIT_STREAM_ERROR_MESSAGE(s); INIT_STREAM_WARNING_MESSAGE(s); \
+	INIT_STREAM_ERROR_MESSAGE(s); INIT_STREAM_WARNING_MESSAGE(s); INIT_STREAM_TRACE(s); INIT_STREAM_CHECKSUM(s); \
 	s->state = NULL
 #define CHECK_STREAM(s, c, f) \
 	if (UNLIKELY(s == NULL || s->format != f || s->compressing != c || s->in == NULL || s->out == NULL)) { SET_ERROR(s, "Error: Invalid stream provided"); return MSCOMP_ARG_ERROR; }
 #define CHECK_STREAM_PLUS(s, c, f, x) \
 	if (UNLIKELY(s == NULL || s->format != f || s->compressing != c || s->in == NULL || s->out == NULL || (x))) { SET_ERROR(s, "Error: Invalid stream provided"); return MSCOMP_ARG_ERROR; }
 
+///// Stream state allocation and reset /////
+// States are allocated in 4 KB size classes and all of them start with a size_t of the number of
+// bytes allocated. This allows a stream to be reset to another format whose state fits in the same
+// memory (only if the old state does not own any other memory, given by can_switch).
+#define STATE_SIZE_CLASS(n) (((n) + 0xFFF) & ~(size_t)0xFFF)
+#define ALLOC_STATE(s, state, ERROR) \
+	mscomp_internal_state* RESTRICT state = (mscomp_internal_state*)MS_ALLOC(&ms_global_allocator, STATE_SIZE_CLASS(sizeof(mscomp_internal_state))); \
+	if (UNLIKELY(state == NULL)) { SET_ERROR(s, ERROR); return MSCOMP_MEM_ERROR; } \
+	state->size = STATE_SIZE_CLASS(sizeof(mscomp_internal_state))
+#define FREE_STATE(state) MS_FREE(&ms_global_allocator, state, state->size)
+#define RESET_STREAM(s, c, f, can_switch) \
+	if (UNLIKELY(s == NULL || s->compressing != c || s->state == NULL || (s->format != f && (!(can_switch) || *(size_t*)s->state < sizeof(mscomp_internal_state))))) { SET_ERROR(s, "Error: Invalid stream provided"); return MSCOMP_ARG_ERROR; } \
+	s->format = f; \
+	s->in = NULL; s->out = NULL; \
+	s->in_avail = 0; s->out_avail = 0; \
+	s->in_total = 0; s->out_total = 0; \
+	INIT_STREAM_ERROR_MESSAGE(s); INIT_STREAM_WARNING_MESSAGE(s); RESET_STREAM_CHECKSUM(s)
+
 #define ADVANCE_IN(s, x)      s->in  += (x);          s->in_total  += (x);          s->in_avail -= (x)
 #define ADVANCE_IN_TO_END(s)  s->in  += s->in_avail;  s->in_total  += s->in_avail;  s->in_avail  = 0
 #define ADVANCE_OUT(s, x)     s->out += (x);          s->out_total += (x);          s->out_avail -= (x)
@@ -496,10 +774,13 @@ typedef const_byte* RESTRICT const_rest_bytes;
 #if defined(MSCOMP_WITH_UNALIGNED_ACCESS)
 // COPY_32 - Copy a 32-bit value from the pointer in to the pointer out
 #define COPY_32(out, in)    *(uint32_t*)(out) = *(uint32_t*)(in)
+// COPY_64 - Copy a 64-bit value from the pointer in to the pointer out
+#define COPY_64(out, in)    *(uint64_t*)(out) = *(uint64_t*)(in)
 // COPY_4x32 - Copy 4 32-bit values from the pointer in to the pointer out
 #define COPY_4x32(out, in)  COPY_4x(((uint32_t*)(out)), ((uint32_t*)(in)))
 #else
 #define COPY_32(out, in)    COPY_4x((byte*)(out), (byte*)(in))
+#define COPY_64(out, in)    COPY_32(out, in); COPY_32(((byte*)(out))+4, ((byte*)(in))+4)
 #define COPY_4x32(out, in)  COPY_32(((uint32_t*)(out)), ((uint32_t*)(in))); COPY_32(((uint32_t*)(out))+1, ((uint32_t*)(in))+1); COPY_32(((uint32_t*)(out))+2, ((uint32_t*)(in))+2); COPY_32(((uint32_t*)(out))+3, ((uint32_t*)(in))+3)
 #endif
 
@@ -510,6 +791,15 @@ typedef const_byte* RESTRICT const_rest_bytes;
 #define COPY_128_FAST(out, in) COPY_4x32(out, in)
 #endif
 
+// COPY_256_FAST - Copy a 256-bit value from the pointer in to the pointer out
+// A fixed-size memcpy lets the compiler use the widest moves available (two SSE moves or a single
+// AVX move depending on the CPU_DISPATCH target)
+#if defined(MSCOMP_WITH_UNALIGNED_ACCESS)
+#define COPY_256_FAST(out, in) memcpy((out), (in), 32)
+#else
+#define COPY_256_FAST(out, in) COPY_128_FAST(out, in); COPY_128_FAST((out)+16, (in)+16)
+#endif
+
 #define FAST_COPY_ROOM 16
 
 ///// Copies data very fast from a buffer to itself /////
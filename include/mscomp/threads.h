@@ -0,0 +1,159 @@
+// ms-compress: implements Microsoft compression algorithms
+// Copyright (C) 2012  Jeffrey Bush  jeff@coderforlife.com
+//
+// This library is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This library is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+
+/////////////////// Threads ////////////////////////////////////////////////////
+// Minimal portable threads, locks, and atomics used by the thread pool, along with ms_parallel
+// which runs work through the executor (see ms_set_executor). Without MSCOMP_WITH_THREADS creating
+// a thread always fails and the locks do nothing, so callers must always be able to do all of the
+// work themselves.
+
+#ifndef MSCOMP_THREADS_H
+#define MSCOMP_THREADS_H
+#include "internal.h"
+
+#ifdef MSCOMP_WITH_THREADS
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#include <windows.h>
+#else
+#include <pthread.h>
+#include <unistd.h>
+#endif
+#endif
+
+///// Threads /////
+// Thread functions are declared as THREAD_FUNC(name, arg) { ...; THREAD_RETURN; }
+#if defined(MSCOMP_WITH_THREADS) && defined(_WIN32)
+typedef HANDLE ms_thread;
+#define THREAD_FUNC(name, arg)	static DWORD WINAPI name(LPVOID arg)
+#define THREAD_RETURN			return 0
+typedef LPTHREAD_START_ROUTINE ms_thread_func;
+FORCE_INLINE static bool thread_start(ms_thread* t, ms_thread_func f, void* arg) { return (*t = CreateThread(NULL, 0, f, arg, 0, NULL)) != NULL; }
+FORCE_INLINE static void thread_join(ms_thread t) { WaitForSingleObject(t, INFINITE); CloseHandle(t); }
+#elif defined(MSCOMP_WITH_THREADS)
+typedef pthread_t ms_thread;
+#define THREAD_FUNC(name, arg)	static void* name(void* arg)
+#define THREAD_RETURN			return NULL
+typedef void* (*ms_thread_func)(void*);
+FORCE_INLINE static bool thread_start(ms_thread* t, ms_thread_func f, void* arg) { return pthread_create(t, NULL, f, arg) == 0; }
+FORCE_INLINE static void thread_join(ms_thread t) { pthread_join(t, NULL); }
+#else
+typedef int ms_thread;
+#define THREAD_FUNC(name, arg)	static void* name(void* arg)
+#define THREAD_RETURN			return NULL
+typedef void* (*ms_thread_func)(void*);
+FORCE_INLINE static bool thread_start(ms_thread* /*t*/, ms_thread_func /*f*/, void* /*arg*/) { return false; }
+FORCE_INLINE static void thread_join(ms_thread /*t*/) { }
+#endif
+
+///// Locks and Condition Variables /////
+#if defined(MSCOMP_WITH_THREADS) && defined(_WIN32)
+typedef SRWLOCK ms_mutex;
+typedef CONDITION_VARIABLE ms_cond;
+FORCE_INLINE static void mutex_init(ms_mutex* m) { InitializeSRWLock(m); }
+FORCE_INLINE static void mutex_destroy(ms_mutex* /*m*/) { }
+FORCE_INLINE static void mutex_lock(ms_mutex* m) { AcquireSRWLockExclusive(m); }
+FORCE_INLINE static void mutex_unlock(ms_mutex* m) { ReleaseSRWLockExclusive(m); }
+FORCE_INLINE static void cond_init(ms_cond* c) { InitializeConditionVariable(c); }
+FORCE_INLINE static void cond_destroy(ms_cond* /*c*/) { }
+FORCE_INLINE static void cond_wait(ms_cond* c, ms_mutex* m) { SleepConditionVariableSRW(c, m, INFINITE, 0); }
+FORCE_INLINE static void cond_signal(ms_cond* c) { WakeConditionVariable(c); }
+FORCE_INLINE static void cond_broadcast(ms_cond* c) { WakeAllConditionVariable(c); }
+#elif defined(MSCOMP_WITH_THREADS)
+typedef pthread_mutex_t ms_mutex;
+typedef pthread_cond_t ms_cond;
+FORCE_INLINE static void mutex_init(ms_mutex* m) { pthread_mutex_init(m, NULL); }
+FORCE_INLINE static void mutex_destroy(ms_mutex* m) { pthread_mutex_destroy(m); }
+FORCE_INLINE static void mutex_lock(ms_mutex* m) { pthread_mutex_lock(m); }
+FORCE_INLINE static void mutex_unlock(ms_mutex* m) { pthread_mutex_unlock(m); }
+FORCE_INLINE static void cond_init(ms_cond* c) { pthread_cond_init(c, NULL); }
+FORCE_INLINE static void cond_destroy(ms_cond* c) { pthread_cond_destroy(c); }
+FORCE_INLINE static void cond_wait(ms_cond* c, ms_mutex* m) { pthread_cond_wait(c, m); }
+FORCE_INLINE static void cond_signal(ms_cond* c) { pthread_cond_signal(c); }
+FORCE_INLINE static void cond_broadcast(ms_cond* c) { pthread_cond_broadcast(c); }
+#else
+typedef int ms_mutex;
+typedef int ms_cond;
+FORCE_INLINE static void mutex_init(ms_mutex* /*m*/) { }
+FORCE_INLINE static void mutex_destroy(ms_mutex* /*m*/) { }
+FORCE_INLINE static void mutex_lock(ms_mutex* /*m*/) { }
+FORCE_INLINE static void mutex_unlock(ms_mutex* /*m*/) { }
+FORCE_INLINE static void cond_init(ms_cond* /*c*/) { }
+FORCE_INLINE static void cond_destroy(ms_cond* /*c*/) { }
+FORCE_INLINE static void cond_wait(ms_cond* /*c*/, ms_mutex* /*m*/) { }
+FORCE_INLINE static void cond_signal(ms_cond* /*c*/) { }
+FORCE_INLINE static void cond_broadcast(ms_cond* /*c*/) { }
+#endif
+
+///// Once /////
+// Functions to be run once are declared as ONCE_FUNC(name) { ...; ONCE_RETURN; }
+#if defined(MSCOMP_WITH_THREADS) && defined(_WIN32)
+typedef INIT_ONCE ms_once;
+#define MS_ONCE_INIT			INIT_ONCE_STATIC_INIT
+#define ONCE_FUNC(name)			static BOOL CALLBACK name(PINIT_ONCE, PVOID, PVOID*)
+#define ONCE_RETURN				return TRUE
+#define run_once(o, f)			InitOnceExecuteOnce((o), (f), NULL, NULL)
+#elif defined(MSCOMP_WITH_THREADS)
+typedef pthread_once_t ms_once;
+#define MS_ONCE_INIT			PTHREAD_ONCE_INIT
+#define ONCE_FUNC(name)			static void name()
+#define ONCE_RETURN				return
+#define run_once(o, f)			pthread_once((o), (f))
+#else
+typedef bool ms_once;
+#define MS_ONCE_INIT			false
+#define ONCE_FUNC(name)			static void name()
+#define ONCE_RETURN				return
+#define run_once(o, f)			do { if (!*(o)) { *(o) = true; f(); } } while (0)
+#endif
+
+// The number of processors available, at least 1
+INLINE static unsigned cpu_count()
+{
+#if defined(MSCOMP_WITH_THREADS) && defined(_WIN32)
+	SYSTEM_INFO info;
+	GetSystemInfo(&info);
+	return info.dwNumberOfProcessors ? (unsigned)info.dwNumberOfProcessors : 1;
+#elif defined(MSCOMP_WITH_THREADS) && defined(_SC_NPROCESSORS_ONLN)
+	const long n = sysconf(_SC_NPROCESSORS_ONLN);
+	return n > 0 ? (unsigned)n : 1;
+#else
+	return 1;
+#endif
+}
+
+///// Atomics /////
+// ATOMIC_FETCH_ADD(p, x) adds x to the size_t pointed to by p and returns the previous value
+#if defined(_MSC_VER) && defined(_WIN64)
+#include <intrin.h>
+#define ATOMIC_FETCH_ADD(p, x)	((size_t)_InterlockedExchangeAdd64((volatile __int64*)(p), (__int64)(x)))
+#elif defined(_MSC_VER)
+#include <intrin.h>
+#define ATOMIC_FETCH_ADD(p, x)	((size_t)_InterlockedExchangeAdd((volatile long*)(p), (long)(x)))
+#else
+#define ATOMIC_FETCH_ADD(p, x)	__sync_fetch_and_add((p), (x))
+#endif
+
+///// Parallel Work /////
+// Runs func(arg) on the calling thread and also submits up to tasks-1 copies of it to the executor.
+// The copies may run at the same time so func must claim its own work (e.g. with
+// ATOMIC_FETCH_ADD) and return once there is none left. This returns once every copy that started
+// has finished. Copies that have not started by the time the calling thread finishes are cancelled
+// instead of waited for so this never deadlocks, even when called from an executor task.
+void ms_parallel(void (*func)(void* arg), void* arg, unsigned tasks);
+
+#endif
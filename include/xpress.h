@@ -46,15 +46,25 @@ EXTERN_C_START
 
 MSCOMPAPI MSCompStatus xpress_compress(const_bytes in, size_t in_len, bytes out, size_t* out_len);
 MSCOMPAPI size_t xpress_max_compressed_size(size_t in_len);
+MSCOMPAPI MSCompStatus xpress_compress_ctx(mscomp_context* ctx, const_bytes in, size_t in_len, bytes out, size_t* out_len);
+MSCOMPAPI void xpress_context_free(mscomp_context* ctx);
+MSCOMPAPI MSCompStatus xpress_compressed_size(const_bytes in, size_t in_len, size_t* size);
 
 MSCOMPAPI MSCompStatus xpress_decompress(const_bytes in, size_t in_len, bytes out, size_t* out_len);
+MSCOMPAPI MSCompStatus xpress_decompress_slack(const_bytes in, size_t in_len, bytes out, size_t* out_len);
+MSCOMPAPI MSCompStatus xpress_decompress_inplace(bytes buf, size_t in_len, size_t* out_len);
+MSCOMPAPI size_t xpress_inplace_margin(size_t in_len);
+MSCOMPAPI MSCompStatus xpress_validate(const_bytes in, size_t in_len, size_t* out_len);
 
 MSCOMPAPI MSCompStatus xpress_deflate_init(mscomp_stream* stream);
 MSCOMPAPI MSCompStatus xpress_deflate(mscomp_stream* stream, MSCompFlush flush);
+MSCOMPAPI MSCompStatus xpress_deflate_reset(mscomp_stream* stream);
 MSCOMPAPI MSCompStatus xpress_deflate_end(mscomp_stream* stream);
 
 MSCOMPAPI MSCompStatus xpress_inflate_init(mscomp_stream* stream);
+MSCOMPAPI MSCompStatus xpress_inflate_init_contiguous(mscomp_stream* stream);
 MSCOMPAPI MSCompStatus xpress_inflate(mscomp_stream* stream);
+MSCOMPAPI MSCompStatus xpress_inflate_reset(mscomp_stream* stream);
 MSCOMPAPI MSCompStatus xpress_inflate_end(mscomp_stream* stream);
 
 EXTERN_C_END
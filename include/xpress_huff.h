@@ -45,15 +45,24 @@ EXTERN_C_START
 
 MSCOMPAPI MSCompStatus xpress_huff_compress(const_bytes in, size_t in_len, bytes out, size_t* out_len);
 MSCOMPAPI size_t xpress_huff_max_compressed_size(size_t in_len);
+MSCOMPAPI MSCompStatus xpress_huff_compress_ctx(mscomp_context* ctx, const_bytes in, size_t in_len, bytes out, size_t* out_len);
+MSCOMPAPI void xpress_huff_context_free(mscomp_context* ctx);
+MSCOMPAPI MSCompStatus xpress_huff_compressed_size(const_bytes in, size_t in_len, size_t* size);
 
 MSCOMPAPI MSCompStatus xpress_huff_decompress(const_bytes in, size_t in_len, bytes out, size_t* out_len);
+MSCOMPAPI MSCompStatus xpress_huff_decompress_slack(const_bytes in, size_t in_len, bytes out, size_t* out_len);
+MSCOMPAPI MSCompStatus xpress_huff_decompress_inplace(bytes buf, size_t in_len, size_t* out_len);
+MSCOMPAPI size_t xpress_huff_inplace_margin(size_t in_len);
+MSCOMPAPI MSCompStatus xpress_huff_validate(const_bytes in, size_t in_len, size_t* out_len);
 
 //MSCOMPAPI MSCompStatus xpress_huff_deflate_init(mscomp_stream* stream);
 //MSCOMPAPI MSCompStatus xpress_huff_deflate(mscomp_stream* stream, MSCompFlush flush);
+//MSCOMPAPI MSCompStatus xpress_huff_deflate_reset(mscomp_stream* stream);
 //MSCOMPAPI MSCompStatus xpress_huff_deflate_end(mscomp_stream* stream);
 
 //MSCOMPAPI MSCompStatus xpress_huff_inflate_init(mscomp_stream* stream);
 //MSCOMPAPI MSCompStatus xpress_huff_inflate(mscomp_stream* stream);
+//MSCOMPAPI MSCompStatus xpress_huff_inflate_reset(mscomp_stream* stream);
 //MSCOMPAPI MSCompStatus xpress_huff_inflate_end(mscomp_stream* stream);
 
 EXTERN_C_END
@@ -0,0 +1,160 @@
+// ms-compress: implements Microsoft compression algorithms
+// Copyright (C) 2012  Jeffrey Bush  jeff@coderforlife.com
+//
+// This library is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This library is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+
+/////////////////// Memory Allocators /////////////////////////////////////////
+// The default allocator (malloc/realloc/free), the bump-arena allocator, and the huge page
+// allocator. See mscomp.h for function descriptions.
+
+#include "../include/mscomp/internal.h"
+#include "../include/mscomp.h"
+
+#if defined(__linux__)
+#include <sys/mman.h>
+#ifdef MADV_HUGEPAGE
+#define HUGE_PAGES
+#endif
+#endif
+
+////////////////////////////// Default Allocator ///////////////////////////////////////////////////
+static void* default_alloc(void* /*opaque*/, size_t size) { return malloc(size); }
+static void* default_realloc(void* /*opaque*/, void* ptr, size_t /*old_size*/, size_t size) { return realloc(ptr, size); }
+static void default_free(void* /*opaque*/, void* ptr, size_t /*size*/) { free(ptr); }
+
+mscomp_allocator ms_global_allocator = { default_alloc, default_realloc, default_free, NULL };
+
+MSCOMPAPI MSCompStatus ms_set_allocator(const mscomp_allocator* allocator)
+{
+	if (allocator == NULL)
+	{
+		ms_global_allocator.alloc   = default_alloc;
+		ms_global_allocator.realloc = default_realloc;
+		ms_global_allocator.free    = default_free;
+		ms_global_allocator.opaque  = NULL;
+		return MSCOMP_OK;
+	}
+	if (allocator->alloc == NULL || allocator->realloc == NULL || allocator->free == NULL) { return MSCOMP_ARG_ERROR; }
+	ms_global_allocator = *allocator;
+	return MSCOMP_OK;
+}
+
+
+////////////////////////////// Bump-Arena Allocator ////////////////////////////////////////////////
+// The arena header is kept at the start of the buffer itself. Memory is only given back when it is
+// the most recent allocation, which is also the only allocation that can be grown in place.
+#define ARENA_ALIGN			16
+#define ARENA_ROUND(n)		(((n) + ARENA_ALIGN - 1) & ~(size_t)(ARENA_ALIGN - 1))
+
+struct arena { bytes top, end, last; };
+
+static void* arena_alloc(void* opaque, size_t size)
+{
+	arena* a = (arena*)opaque;
+	size = ARENA_ROUND(size);
+	if (size > (size_t)(a->end - a->top)) { return NULL; }
+	a->last = a->top;
+	a->top += size;
+	return a->last;
+}
+static void* arena_realloc(void* opaque, void* ptr, size_t old_size, size_t size)
+{
+	arena* a = (arena*)opaque;
+	if (ptr != NULL && ptr == a->last)
+	{
+		size = ARENA_ROUND(size);
+		if (size > (size_t)(a->end - a->last)) { return NULL; }
+		a->top = a->last + size;
+		return ptr;
+	}
+	void* p = arena_alloc(opaque, size);
+	if (p && ptr) { memcpy(p, ptr, MIN(old_size, size)); }
+	return p;
+}
+static void arena_free(void* opaque, void* ptr, size_t /*size*/)
+{
+	arena* a = (arena*)opaque;
+	if (ptr != NULL && ptr == a->last) { a->top = a->last; a->last = NULL; }
+}
+
+MSCOMPAPI MSCompStatus ms_arena_allocator(mscomp_allocator* allocator, void* buf, size_t size)
+{
+	if (allocator == NULL || buf == NULL) { return MSCOMP_ARG_ERROR; }
+	const uintptr_t start = ARENA_ROUND((uintptr_t)buf), end = (uintptr_t)buf + size;
+	if (end < (uintptr_t)buf || start + ARENA_ROUND(sizeof(arena)) > end) { return MSCOMP_ARG_ERROR; }
+	arena* a = (arena*)start;
+	a->top  = (bytes)(start + ARENA_ROUND(sizeof(arena)));
+	a->end  = (bytes)end;
+	a->last = NULL;
+	allocator->alloc   = arena_alloc;
+	allocator->realloc = arena_realloc;
+	allocator->free    = arena_free;
+	allocator->opaque  = a;
+	return MSCOMP_OK;
+}
+
+
+////////////////////////////// Huge Page Allocator /////////////////////////////////////////////////
+// Large allocations are mapped directly, aligned to huge pages, and marked with MADV_HUGEPAGE so
+// that transparent huge pages can back them. Small allocations (like the LZNT1 dictionary entries)
+// use malloc since they would waste most of a page.
+#ifdef HUGE_PAGES
+#define HUGE_PAGE_SIZE		0x200000
+#define HUGE_PAGE_MIN		0x10000
+#define HUGE_PAGE_ROUND(n)	(((n) + HUGE_PAGE_SIZE - 1) & ~(size_t)(HUGE_PAGE_SIZE - 1))
+
+static void* hugepage_alloc(void* /*opaque*/, size_t size)
+{
+	if (size < HUGE_PAGE_MIN) { return malloc(size); }
+	const size_t len = HUGE_PAGE_ROUND(size), map_len = len + HUGE_PAGE_SIZE;
+	if (UNLIKELY(len < size || map_len < len)) { return NULL; }
+
+	// Map an extra huge page so that the start can be aligned to a huge page then unmap the excess
+	const bytes map = (bytes)mmap(NULL, map_len, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+	if (map == (bytes)MAP_FAILED) { return NULL; }
+	const bytes p = (bytes)HUGE_PAGE_ROUND((uintptr_t)map);
+	if (p != map) { munmap(map, p - map); }
+	if (p + len != map + map_len) { munmap(p + len, map + map_len - (p + len)); }
+	madvise(p, len, MADV_HUGEPAGE); // only a hint, so failures are ignored
+	return p;
+}
+static void hugepage_free(void* /*opaque*/, void* ptr, size_t size)
+{
+	if (size < HUGE_PAGE_MIN) { free(ptr); }
+	else if (ptr != NULL) { munmap(ptr, HUGE_PAGE_ROUND(size)); }
+}
+static void* hugepage_realloc(void* opaque, void* ptr, size_t old_size, size_t size)
+{
+	if (old_size < HUGE_PAGE_MIN && size < HUGE_PAGE_MIN) { return realloc(ptr, size); }
+	void* p = hugepage_alloc(opaque, size);
+	if (p && ptr) { memcpy(p, ptr, MIN(old_size, size)); hugepage_free(opaque, ptr, old_size); }
+	return p;
+}
+#endif
+
+MSCOMPAPI void ms_hugepage_allocator(mscomp_allocator* allocator)
+{
+	if (allocator == NULL) { return; }
+#ifdef HUGE_PAGES
+	allocator->alloc   = hugepage_alloc;
+	allocator->realloc = hugepage_realloc;
+	allocator->free    = hugepage_free;
+#else
+	allocator->alloc   = default_alloc;
+	allocator->realloc = default_realloc;
+	allocator->free    = default_free;
+#endif
+	allocator->opaque  = NULL;
+}
@@ -0,0 +1,344 @@
+// ms-compress: implements Microsoft compression algorithms
+// Copyright (C) 2012  Jeffrey Bush  jeff@coderforlife.com
+//
+// This library is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This library is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+
+/////////////////// Executors //////////////////////////////////////////////////
+// The work-stealing thread pool, the global executor, and ms_parallel which all parallel work goes
+// through. See mscomp.h for the public function descriptions and threads.h for ms_parallel.
+//
+// All of this memory comes from malloc and free instead of the global allocator since a pool lives
+// across calls and a cancelled ms_parallel task may free its memory after the call has returned,
+// both of which can be after the allocator was changed (or its arena was freed).
+
+#include "../include/mscomp/internal.h"
+#include "../include/mscomp/threads.h"
+#include "../include/mscomp.h"
+
+////////////////////////////// Work-Stealing Pool //////////////////////////////////////////////////
+// Every thread has its own queue. The owning thread pushes and pops tasks at the back of its queue
+// (so the most recent, and most likely cached, work is done first) while the other threads steal
+// the oldest tasks from the front. Tasks submitted from outside of the pool are spread across the
+// queues. Idle threads sleep until the number of queued tasks is non-zero.
+#ifdef MSCOMP_WITH_THREADS
+#define POOL_QUEUE_MIN	16
+
+struct pool_task { mscomp_task task; void* arg; };
+
+struct pool_queue
+{
+	ms_mutex lock;
+	pool_task* tasks; // ring buffer
+	size_t cap, front, count;
+};
+
+struct pool;
+struct pool_worker { pool* p; unsigned index; };
+
+struct pool
+{
+	ms_mutex lock; // protects queued and stopping, used with wake
+	ms_cond wake;
+	size_t queued; // the number of tasks in all of the queues, may briefly be more
+	bool stopping;
+	size_t next; // the queue that the next task from outside of the pool goes to
+	unsigned nthreads;
+	ms_thread* threads;
+	pool_queue* queues;
+	pool_worker* workers;
+};
+
+static THREAD_LOCAL pool_worker* current_worker = NULL;
+
+static bool queue_push(pool_queue* q, mscomp_task task, void* arg)
+{
+	mutex_lock(&q->lock);
+	if (q->count == q->cap)
+	{
+		// Grow the ring buffer, unwrapping it in the process
+		const size_t cap = q->cap ? q->cap * 2 : POOL_QUEUE_MIN;
+		pool_task* tasks = (pool_task*)malloc(cap * sizeof(pool_task));
+		if (UNLIKELY(tasks == NULL)) { mutex_unlock(&q->lock); return false; }
+		for (size_t i = 0; i < q->count; ++i) { tasks[i] = q->tasks[(q->front + i) % q->cap]; }
+		free(q->tasks);
+		q->tasks = tasks;
+		q->cap = cap;
+		q->front = 0;
+	}
+	pool_task* t = q->tasks + (q->front + q->count++) % q->cap;
+	t->task = task;
+	t->arg = arg;
+	mutex_unlock(&q->lock);
+	return true;
+}
+static bool queue_pop_back(pool_queue* q, pool_task* t)
+{
+	mutex_lock(&q->lock);
+	const bool found = q->count != 0;
+	if (found) { *t = q->tasks[(q->front + --q->count) % q->cap]; }
+	mutex_unlock(&q->lock);
+	return found;
+}
+static bool queue_pop_front(pool_queue* q, pool_task* t)
+{
+	mutex_lock(&q->lock);
+	const bool found = q->count != 0;
+	if (found) { *t = q->tasks[q->front]; q->front = (q->front + 1) % q->cap; --q->count; }
+	mutex_unlock(&q->lock);
+	return found;
+}
+static void queue_free(pool_queue* q)
+{
+	free(q->tasks);
+	mutex_destroy(&q->lock);
+}
+
+static bool pool_take(pool* p, unsigned index, pool_task* t)
+{
+	bool found = queue_pop_back(p->queues + index, t);
+	for (unsigned i = 1; !found && i < p->nthreads; ++i) { found = queue_pop_front(p->queues + (index + i) % p->nthreads, t); }
+	if (found) { mutex_lock(&p->lock); --p->queued; mutex_unlock(&p->lock); }
+	return found;
+}
+
+THREAD_FUNC(pool_thread, arg)
+{
+	pool_worker* w = (pool_worker*)arg;
+	pool* p = w->p;
+	current_worker = w;
+	for (;;)
+	{
+		pool_task t;
+		if (pool_take(p, w->index, &t)) { t.task(t.arg); continue; }
+		mutex_lock(&p->lock);
+		while (p->queued == 0 && !p->stopping) { cond_wait(&p->wake, &p->lock); }
+		const bool done = p->queued == 0; // only when stopping, all remaining tasks are run first
+		mutex_unlock(&p->lock);
+		if (done) { break; }
+	}
+	THREAD_RETURN;
+}
+
+static bool pool_submit(void* opaque, mscomp_task task, void* arg)
+{
+	pool* p = (pool*)opaque;
+	const pool_worker* w = current_worker;
+	const unsigned index = (w && w->p == p) ? w->index : (unsigned)(ATOMIC_FETCH_ADD(&p->next, 1) % p->nthreads);
+
+	// The count goes up first so that a thread never sees the task without it being counted
+	mutex_lock(&p->lock);
+	++p->queued;
+	mutex_unlock(&p->lock);
+	const bool queued = queue_push(p->queues + index, task, arg);
+	mutex_lock(&p->lock);
+	if (queued) { cond_signal(&p->wake); } else { --p->queued; }
+	mutex_unlock(&p->lock);
+	return queued;
+}
+
+static void pool_stop(pool* p, unsigned nthreads)
+{
+	mutex_lock(&p->lock);
+	p->stopping = true;
+	cond_broadcast(&p->wake);
+	mutex_unlock(&p->lock);
+	for (unsigned i = 0; i < nthreads; ++i) { thread_join(p->threads[i]); }
+	for (unsigned i = 0; i < p->nthreads; ++i) { queue_free(p->queues + i); }
+	cond_destroy(&p->wake);
+	mutex_destroy(&p->lock);
+	free(p->workers);
+	free(p->queues);
+	free(p->threads);
+	free(p);
+}
+
+MSCOMPAPI MSCompStatus ms_pool_create(mscomp_executor* executor, unsigned threads)
+{
+	if (executor == NULL) { return MSCOMP_ARG_ERROR; }
+	if (threads == 0) { threads = cpu_count(); }
+	pool* p = (pool*)malloc(sizeof(pool));
+	if (p == NULL) { return MSCOMP_MEM_ERROR; }
+	memset(p, 0, sizeof(pool));
+	p->threads = (ms_thread*)malloc(threads * sizeof(ms_thread));
+	p->queues = (pool_queue*)malloc(threads * sizeof(pool_queue));
+	p->workers = (pool_worker*)malloc(threads * sizeof(pool_worker));
+	if (p->threads == NULL || p->queues == NULL || p->workers == NULL)
+	{
+		free(p->threads);
+		free(p->queues);
+		free(p->workers);
+		free(p);
+		return MSCOMP_MEM_ERROR;
+	}
+	mutex_init(&p->lock);
+	cond_init(&p->wake);
+	p->nthreads = threads;
+	for (unsigned i = 0; i < threads; ++i)
+	{
+		memset(p->queues + i, 0, sizeof(pool_queue));
+		mutex_init(&p->queues[i].lock);
+		p->workers[i].p = p;
+		p->workers[i].index = i;
+	}
+	for (unsigned i = 0; i < threads; ++i)
+	{
+		if (!thread_start(p->threads + i, pool_thread, p->workers + i)) { pool_stop(p, i); return MSCOMP_MEM_ERROR; }
+	}
+	executor->submit = pool_submit;
+	executor->opaque = p;
+	return MSCOMP_OK;
+}
+MSCOMPAPI void ms_pool_free(mscomp_executor* executor)
+{
+	if (executor == NULL || executor->submit != pool_submit || executor->opaque == NULL) { return; }
+	pool* p = (pool*)executor->opaque;
+	pool_stop(p, p->nthreads);
+	executor->submit = NULL;
+	executor->opaque = NULL;
+}
+
+#else
+static bool pool_submit(void* /*opaque*/, mscomp_task /*task*/, void* /*arg*/) { return false; }
+MSCOMPAPI MSCompStatus ms_pool_create(mscomp_executor* executor, unsigned /*threads*/)
+{
+	if (executor == NULL) { return MSCOMP_ARG_ERROR; }
+	executor->submit = pool_submit;
+	executor->opaque = NULL;
+	return MSCOMP_OK;
+}
+MSCOMPAPI void ms_pool_free(mscomp_executor* executor)
+{
+	if (executor == NULL || executor->submit != pool_submit) { return; }
+	executor->submit = NULL;
+}
+#endif
+
+
+////////////////////////////// Global Executor /////////////////////////////////////////////////////
+// A NULL submit function means the built-in pool, which is only created once it is needed
+static mscomp_executor global_executor = { NULL, NULL };
+
+#ifdef MSCOMP_WITH_THREADS
+static mscomp_executor builtin_pool = { NULL, NULL };
+static ms_once builtin_pool_once = MS_ONCE_INIT;
+
+ONCE_FUNC(builtin_pool_create)
+{
+	// The calling thread always helps so one fewer thread is needed, if the pool cannot be created
+	// then everything will be done on the calling thread
+	const unsigned threads = cpu_count() - 1;
+	if (threads == 0 || ms_pool_create(&builtin_pool, threads) != MSCOMP_OK) { builtin_pool.submit = NULL; }
+	ONCE_RETURN;
+}
+#endif
+
+MSCOMPAPI MSCompStatus ms_set_executor(const mscomp_executor* executor)
+{
+	if (executor == NULL) { global_executor.submit = NULL; global_executor.opaque = NULL; return MSCOMP_OK; }
+	if (executor->submit == NULL) { return MSCOMP_ARG_ERROR; }
+	global_executor = *executor;
+	return MSCOMP_OK;
+}
+
+
+////////////////////////////// Parallel Work ///////////////////////////////////////////////////////
+// Each submitted copy gets a slot that it must claim before running. Once the calling thread is
+// done it claims every slot it can, cancelling those copies, and only waits for the copies that
+// already claimed their slots and are running. Copies that were cancelled still run eventually but
+// do nothing except release their reference, the last reference frees everything.
+#ifdef MSCOMP_WITH_THREADS
+struct parallel;
+struct parallel_slot { size_t claimed; parallel* p; };
+
+struct parallel
+{
+	void (*func)(void* arg);
+	void* arg;
+	size_t refs; // the calling thread plus every submitted copy
+	ms_mutex lock; // protects finished, used with done
+	ms_cond done;
+	size_t finished; // the number of copies that have finished running func
+	parallel_slot slots[1];
+};
+
+static void parallel_release(parallel* p)
+{
+	if (ATOMIC_FETCH_ADD(&p->refs, (size_t)-1) == 1)
+	{
+		cond_destroy(&p->done);
+		mutex_destroy(&p->lock);
+		free(p);
+	}
+}
+
+static void parallel_task(void* arg)
+{
+	parallel_slot* s = (parallel_slot*)arg;
+	parallel* p = s->p;
+	if (ATOMIC_FETCH_ADD(&s->claimed, 1) == 0)
+	{
+		p->func(p->arg);
+		mutex_lock(&p->lock);
+		++p->finished;
+		cond_signal(&p->done);
+		mutex_unlock(&p->lock);
+	}
+	parallel_release(p);
+}
+#endif
+
+void ms_parallel(void (*func)(void* arg), void* arg, unsigned tasks)
+{
+#ifdef MSCOMP_WITH_THREADS
+	const mscomp_executor* e = &global_executor;
+	if (e->submit == NULL) { run_once(&builtin_pool_once, builtin_pool_create); e = &builtin_pool; }
+	if (tasks > 1 && e->submit)
+	{
+		const size_t n = tasks - 1, size = sizeof(parallel) + (n - 1) * sizeof(parallel_slot);
+		parallel* p = (parallel*)malloc(size);
+		if (p != NULL)
+		{
+			p->func = func;
+			p->arg = arg;
+			p->refs = 1;
+			mutex_init(&p->lock);
+			cond_init(&p->done);
+			p->finished = 0;
+			size_t submitted = 0;
+			for (; submitted < n; ++submitted)
+			{
+				parallel_slot* s = p->slots + submitted;
+				s->claimed = 0;
+				s->p = p;
+				ATOMIC_FETCH_ADD(&p->refs, 1);
+				if (!e->submit(e->opaque, parallel_task, s)) { ATOMIC_FETCH_ADD(&p->refs, (size_t)-1); break; }
+			}
+
+			func(arg);
+
+			size_t started = 0;
+			for (size_t i = 0; i < submitted; ++i) { if (ATOMIC_FETCH_ADD(&p->slots[i].claimed, 1) != 0) { ++started; } }
+			mutex_lock(&p->lock);
+			while (p->finished < started) { cond_wait(&p->done, &p->lock); }
+			mutex_unlock(&p->lock);
+			parallel_release(p);
+			return;
+		}
+	}
+#else
+	(void)tasks;
+#endif
+	func(arg);
+}
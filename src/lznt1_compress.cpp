@@ -27,7 +27,8 @@
 size_t lznt1_max_compressed_size(size_t in_len) { return in_len + 3 + 2 * ((in_len + CHUNK_SIZE - 1) / CHUNK_SIZE); }
 
 struct _mscomp_internal_state
-{ // 8,218 - 8,238 bytes (+padding) + dictionary memory
+{ // 8,222 - 8,246 bytes (+padding) + dictionary memory
+	size_t size; // see ALLOC_STATE
 	bool finished; // means fully finished
 	LZNT1Dictionary d;
 	byte in[CHUNK_SIZE];
@@ -46,14 +47,27 @@ struct _mscomp_internal_state
 
 
 /////////////////// Compression Functions /////////////////////////////////////
-FORCE_INLINE static uint_fast16_t lznt1_compress_chunk(const_rest_bytes const in, const uint_fast16_t in_len, rest_bytes const out, const size_t out_len, LZNT1Dictionary* RESTRICT d)
+FORCE_INLINE static uint_fast16_t lznt1_encode_chunk(const_rest_bytes const in, const uint_fast16_t in_len, rest_bytes const out, const size_t out_len, LZNT1Dictionary* RESTRICT d)
 {
 	uint_fast16_t in_pos = 0, out_pos = 0, rem = in_len, pow2 = 0x10, mask3 = 0x1002, shift = 12;
+
+	// A chunk that is a single repeated byte (like a zero page) does not use the dictionary at all
+	// and every match is the longest allowed one back to the start of the chunk (which is exactly
+	// what the dictionary would find)
+	const bool run = is_run(in, in_len);
+	if (run) { STATS_ADD(run_chunks, 1); }
+	else if (few_matches(in, in_len)) { return in_len; } // store it
+	else
+	{
+		PHASE_SCOPE(MSCOMP_PHASE_FILL);
 #ifdef MSCOMP_WITH_LZNT1_SA_DICT
-	d->Fill(in, in_len);
+		d->Fill(in, in_len);
 #else
-	if (UNLIKELY(!d->Fill(in, in_len))) { return 0; }
+		if (UNLIKELY(!d->Fill(in, in_len))) { return 0; }
 #endif
+	}
+	PHASE_SCOPE(MSCOMP_PHASE_FIND);
+	Acceleration accel;
 
 	while (LIKELY(out_pos < out_len && rem))
 	{
@@ -65,9 +79,13 @@ FORCE_INLINE static uint_fast16_t lznt1_compress_chunk(const_rest_bytes const in
 
 			while (pow2 < in_pos) { pow2 <<= 1; mask3 = (mask3>>1)+1; --shift; }
 
-			int_fast16_t off, len = d->Find(in+in_pos, MIN(rem, mask3), &off);
+			int_fast16_t off, len;
+			if (run) { len = (in_pos && rem >= 3) ? MIN(rem, mask3) : 0; off = in_pos; }
+			else if (accel.Skip()) { len = 0; }
+			else { len = d->Find(in+in_pos, MIN(rem, mask3), &off); accel.Found(len > 0); }
 			if (len > 0)
 			{
+				STATS_ADD(matches, 1);
 				// Write symbol that is a combination of offset and length
 				const uint16_t sym = (uint16_t)(((off-1) << shift) | (len-3));
 				SET_UINT16(bytes+pos, sym);
@@ -77,6 +95,7 @@ FORCE_INLINE static uint_fast16_t lznt1_compress_chunk(const_rest_bytes const in
 			}
 			else
 			{
+				STATS_ADD(literals, 1);
 				// Copy directly
 				bytes[pos++] = in[in_pos++];
 				--rem;
@@ -92,10 +111,17 @@ FORCE_INLINE static uint_fast16_t lznt1_compress_chunk(const_rest_bytes const in
 	// Return insufficient buffer or the compressed size
 	return rem ? in_len : out_pos;
 }
-static bool lznt1_compress_chunk_write(mscomp_stream* RESTRICT const stream, const_rest_bytes const in, const uint_fast16_t in_len)
+FORCE_INLINE static uint_fast16_t lznt1_compress_chunk(const_rest_bytes const in, const uint_fast16_t in_len, rest_bytes const out, const size_t out_len, LZNT1Dictionary* RESTRICT d)
+{
+	const uint_fast16_t out_size = lznt1_encode_chunk(in, in_len, out, out_len, d);
+	d->Clear(); // the chunk may not be around when the next one is filled
+	return out_size;
+}
+CPU_DISPATCH static bool lznt1_compress_chunk_write(mscomp_stream* RESTRICT const stream, const_rest_bytes const in, const uint_fast16_t in_len)
 {
 	mscomp_internal_state* RESTRICT state = stream->state;
 	bool out_buffering = stream->out_avail < in_len+2u;
+	TRACE_CHUNK_START(MSCOMP_LZNT1, true);
 	rest_bytes out = out_buffering ? state->out : stream->out;
 
 	// Compress the chunk
@@ -131,14 +157,14 @@ static bool lznt1_compress_chunk_write(mscomp_stream* RESTRICT const stream, con
 		ADVANCE_OUT(stream, out_size);
 	}
 
+	TRACE_CHUNK_DONE(MSCOMP_LZNT1, true, flags == 0x3000, in_len, out_size);
 	return true;
 }
 MSCompStatus lznt1_deflate_init(mscomp_stream* RESTRICT const stream)
 {
 	INIT_STREAM(stream, true, MSCOMP_LZNT1);
 
-	mscomp_internal_state* RESTRICT state = (mscomp_internal_state*)malloc(sizeof(mscomp_internal_state));
-	if (UNLIKELY(state == NULL)) { SET_ERROR(stream, "LZNT1 Compression Error: Unable to allocate buffer memory"); return MSCOMP_MEM_ERROR; }
+	ALLOC_STATE(stream, state, "LZNT1 Compression Error: Unable to allocate buffer memory");
 	state->finished  = false;
 	state->in_needed = 0;
 	state->in_avail  = 0;
@@ -149,9 +175,23 @@ MSCompStatus lznt1_deflate_init(mscomp_stream* RESTRICT const stream)
 	stream->state = state;
 	return MSCOMP_OK;
 }
+MSCompStatus lznt1_deflate_reset(mscomp_stream* RESTRICT const stream)
+{
+	RESET_STREAM(stream, true, MSCOMP_LZNT1, false); // the dictionary is kept (it is always left cleared after each chunk)
+
+	mscomp_internal_state* RESTRICT state = stream->state;
+	state->finished  = false;
+	state->in_needed = 0;
+	state->in_avail  = 0;
+	state->out_pos   = 0;
+	state->out_avail = 0;
+
+	return MSCOMP_OK;
+}
 ENTRY_POINT MSCompStatus lznt1_deflate(mscomp_stream* RESTRICT const stream, const MSCompFlush flush)
 {
 	CHECK_STREAM_PLUS(stream, true, MSCOMP_LZNT1, stream->state == NULL || stream->state->finished);
+	TRACE_SCOPE(stream->trace, stream->trace_opaque);
 
 	mscomp_internal_state* RESTRICT state = stream->state;
 
@@ -224,24 +264,25 @@ MSCompStatus lznt1_deflate_end(mscomp_stream* RESTRICT stream)
 
 	// Cleanup
 	state->d.~LZNT1Dictionary();
-	free(state);
+	FREE_STATE(state);
 	stream->state = NULL;
 
 	return status;
 }
 #ifdef MSCOMP_WITH_OPT_COMPRESS
-ENTRY_POINT MSCompStatus lznt1_compress(const_rest_bytes in, size_t in_len, rest_bytes out, size_t* RESTRICT _out_len)
+FORCE_INLINE static MSCompStatus lznt1_compress_all(const_rest_bytes in, size_t in_len, rest_bytes out, size_t* RESTRICT _out_len, LZNT1Dictionary* RESTRICT d)
 {
 	const size_t out_len = *_out_len;
 	size_t out_pos = 0, in_pos = 0;
-	LZNT1Dictionary d; // requires 512-768 KB of stack space   or   ~24kb of stack space (+ up to ~17kb during Fill())
 
 	while (out_pos < out_len-1 && in_pos < in_len)
 	{
 		// Compress the next chunk
+		TRACE_CHUNK_START(MSCOMP_LZNT1, true);
 		const uint_fast16_t in_size = (uint_fast16_t)MIN(in_len-in_pos, 0x1000);
-		uint_fast16_t out_size = lznt1_compress_chunk(in+in_pos, in_size, out+out_pos+2, out_len-out_pos-2, &d), flags;
+		uint_fast16_t out_size = lznt1_compress_chunk(in+in_pos, in_size, out+out_pos+2, out_len-out_pos-2, d), flags;
 		RETURN_IF_NOT_SA_DICT_AND_OUT_ZERO(MSCOMP_MEM_ERROR);
+		CHECKSUM(in+in_pos, in_size);
 		if (out_size < in_size) // chunk is compressed
 		{
 			flags = 0xB000;
@@ -257,6 +298,7 @@ ENTRY_POINT MSCompStatus lznt1_compress(const_rest_bytes in, size_t in_len, rest
 		// Save header
 		const uint16_t header = (uint16_t)(flags | (out_size-1));
 		SET_UINT16(out+out_pos, header);
+		TRACE_CHUNK_DONE(MSCOMP_LZNT1, true, flags == 0x3000, in_size, out_size+2);
 
 		// Increment positions
 		out_pos += out_size+2;
@@ -271,8 +313,72 @@ ENTRY_POINT MSCompStatus lznt1_compress(const_rest_bytes in, size_t in_len, rest
 	*_out_len = out_pos;
 	return MSCOMP_OK;
 }
+ENTRY_POINT CPU_DISPATCH MSCompStatus lznt1_compress(const_rest_bytes in, size_t in_len, rest_bytes out, size_t* RESTRICT _out_len)
+{
+#ifdef MSCOMP_WITH_SMALL_STACK
+	LZNT1Dictionary* RESTRICT d = (LZNT1Dictionary*)MS_ALLOC(&ms_global_allocator, sizeof(LZNT1Dictionary));
+	if (UNLIKELY(d == NULL)) { return MSCOMP_MEM_ERROR; }
+	new (d) LZNT1Dictionary();
+	const MSCompStatus status = lznt1_compress_all(in, in_len, out, _out_len, d);
+	d->~LZNT1Dictionary();
+	MS_FREE(&ms_global_allocator, d, sizeof(LZNT1Dictionary));
+	return status;
+#else
+	LZNT1Dictionary d; // requires 512-1152 KB of stack space   or   ~24kb of stack space (+ up to ~17kb during Fill())
+	return lznt1_compress_all(in, in_len, out, _out_len, &d);
+#endif
+}
+ENTRY_POINT CPU_DISPATCH MSCompStatus lznt1_compress_ctx(mscomp_context* RESTRICT ctx, const_rest_bytes in, size_t in_len, rest_bytes out, size_t* RESTRICT _out_len)
+{
+	// The dictionary (and all of the memory it has allocated) is kept in the context
+	TRACE_SCOPE(ctx->trace, ctx->trace_opaque);
+	LZNT1Dictionary* RESTRICT d = (LZNT1Dictionary*)ctx->lznt1;
+	if (UNLIKELY(d == NULL))
+	{
+		d = (LZNT1Dictionary*)MS_ALLOC(&ctx->allocator, sizeof(LZNT1Dictionary));
+		if (UNLIKELY(d == NULL)) { return MSCOMP_MEM_ERROR; }
+		ctx->lznt1 = new (d) LZNT1Dictionary(&ctx->allocator);
+	}
+	return lznt1_compress_all(in, in_len, out, _out_len, d);
+}
 #else
 ALL_AT_ONCE_WRAPPER_COMPRESS(lznt1)
+MSCompStatus lznt1_compress_ctx(mscomp_context* /*ctx*/, const_bytes in, size_t in_len, bytes out, size_t* _out_len) { return lznt1_compress(in, in_len, out, _out_len); }
+#endif
+FORCE_INLINE static MSCompStatus lznt1_compressed_size_all(const_rest_bytes in, size_t in_len, size_t* RESTRICT size, LZNT1Dictionary* RESTRICT d)
+{
+	// Same as lznt1_compress_all except that every chunk is encoded into the same scratch buffer
+	byte out[CHUNK_SIZE];
+	size_t total = 0;
+	for (size_t in_pos = 0; in_pos < in_len; in_pos += CHUNK_SIZE)
+	{
+		const uint_fast16_t in_size = (uint_fast16_t)MIN(in_len-in_pos, CHUNK_SIZE);
+		const uint_fast16_t out_size = lznt1_compress_chunk(in+in_pos, in_size, out, in_size, d);
+		RETURN_IF_NOT_SA_DICT_AND_OUT_ZERO(MSCOMP_MEM_ERROR);
+		total += 2 + MIN(out_size, in_size);
+	}
+	*size = total;
+	return MSCOMP_OK;
+}
+ENTRY_POINT CPU_DISPATCH MSCompStatus lznt1_compressed_size(const_rest_bytes in, size_t in_len, size_t* RESTRICT size)
+{
+#ifdef MSCOMP_WITH_SMALL_STACK
+	LZNT1Dictionary* RESTRICT d = (LZNT1Dictionary*)MS_ALLOC(&ms_global_allocator, sizeof(LZNT1Dictionary));
+	if (UNLIKELY(d == NULL)) { return MSCOMP_MEM_ERROR; }
+	new (d) LZNT1Dictionary();
+	const MSCompStatus status = lznt1_compressed_size_all(in, in_len, size, d);
+	d->~LZNT1Dictionary();
+	MS_FREE(&ms_global_allocator, d, sizeof(LZNT1Dictionary));
+	return status;
+#else
+	LZNT1Dictionary d;
+	return lznt1_compressed_size_all(in, in_len, size, &d);
 #endif
+}
+void lznt1_context_free(mscomp_context* ctx)
+{
+	LZNT1Dictionary* d = (LZNT1Dictionary*)ctx->lznt1;
+	if (d) { d->~LZNT1Dictionary(); MS_FREE(&ctx->allocator, d, sizeof(LZNT1Dictionary)); ctx->lznt1 = NULL; }
+}
 
 #endif
@@ -24,7 +24,8 @@
 #define CHUNK_SIZE 0x1000 // to be compatible with all known forms of Windows
 
 struct _mscomp_internal_state
-{ // 8,214 - 8,230 bytes (+padding)
+{ // 8,218 - 8,238 bytes (+padding)
+	size_t size; // see ALLOC_STATE
 	bool end_of_stream;
 	byte in[CHUNK_SIZE+2];
 	size_t in_needed, in_avail;
@@ -34,44 +35,139 @@ struct _mscomp_internal_state
 
 
 /////////////////// Decompression Functions ///////////////////////////////////
-static MSCompStatus lznt1_decompress_chunk(const_rest_bytes in, const const_bytes in_end, rest_bytes out, const const_bytes out_end, size_t* RESTRICT _out_len)
+// Describes the sequence of symbols in a flag byte: the lowest nibble is the number of offset/length
+// symbols (m) then the following m+1 nibbles are the number of literals before each offset/length
+// symbol and after the last one.
+static const uint64_t flag_runs[256] =
 {
-	const const_bytes                  in_endx  = in_end -0x11; // 1 + 8 * 2 from the end
-	const const_bytes out_start = out, out_endx = out_end-8*FAST_COPY_ROOM;
+	0x00000000080ull, 0x00000000701ull, 0x00000000611ull, 0x00000006002ull, 0x00000000521ull, 0x00000005102ull, 0x00000005012ull, 0x00000050003ull,
+	0x00000000431ull, 0x00000004202ull, 0x00000004112ull, 0x00000041003ull, 0x00000004022ull, 0x00000040103ull, 0x00000040013ull, 0x00000400004ull,
+	0x00000000341ull, 0x00000003302ull, 0x00000003212ull, 0x00000032003ull, 0x00000003122ull, 0x00000031103ull, 0x00000031013ull, 0x00000310004ull,
+	0x00000003032ull, 0x00000030203ull, 0x00000030113ull, 0x00000301004ull, 0x00000030023ull, 0x00000300104ull, 0x00000300014ull, 0x00003000005ull,
+	0x00000000251ull, 0x00000002402ull, 0x00000002312ull, 0x00000023003ull, 0x00000002222ull, 0x00000022103ull, 0x00000022013ull, 0x00000220004ull,
+	0x00000002132ull, 0x00000021203ull, 0x00000021113ull, 0x00000211004ull, 0x00000021023ull, 0x00000210104ull, 0x00000210014ull, 0x00002100005ull,
+	0x00000002042ull, 0x00000020303ull, 0x00000020213ull, 0x00000202004ull, 0x00000020123ull, 0x00000201104ull, 0x00000201014ull, 0x00002010005ull,
+	0x00000020033ull, 0x00000200204ull, 0x00000200114ull, 0x00002001005ull, 0x00000200024ull, 0x00002000105ull, 0x00002000015ull, 0x00020000006ull,
+	0x00000000161ull, 0x00000001502ull, 0x00000001412ull, 0x00000014003ull, 0x00000001322ull, 0x00000013103ull, 0x00000013013ull, 0x00000130004ull,
+	0x00000001232ull, 0x00000012203ull, 0x00000012113ull, 0x00000121004ull, 0x00000012023ull, 0x00000120104ull, 0x00000120014ull, 0x00001200005ull,
+	0x00000001142ull, 0x00000011303ull, 0x00000011213ull, 0x00000112004ull, 0x00000011123ull, 0x00000111104ull, 0x00000111014ull, 0x00001110005ull,
+	0x00000011033ull, 0x00000110204ull, 0x00000110114ull, 0x00001101005ull, 0x00000110024ull, 0x00001100105ull, 0x00001100015ull, 0x00011000006ull,
+	0x00000001052ull, 0x00000010403ull, 0x00000010313ull, 0x00000103004ull, 0x00000010223ull, 0x00000102104ull, 0x00000102014ull, 0x00001020005ull,
+	0x00000010133ull, 0x00000101204ull, 0x00000101114ull, 0x00001011005ull, 0x00000101024ull, 0x00001010105ull, 0x00001010015ull, 0x00010100006ull,
+	0x00000010043ull, 0x00000100304ull, 0x00000100214ull, 0x00001002005ull, 0x00000100124ull, 0x00001001105ull, 0x00001001015ull, 0x00010010006ull,
+	0x00000100034ull, 0x00001000205ull, 0x00001000115ull, 0x00010001006ull, 0x00001000025ull, 0x00010000106ull, 0x00010000016ull, 0x00100000007ull,
+	0x00000000071ull, 0x00000000602ull, 0x00000000512ull, 0x00000005003ull, 0x00000000422ull, 0x00000004103ull, 0x00000004013ull, 0x00000040004ull,
+	0x00000000332ull, 0x00000003203ull, 0x00000003113ull, 0x00000031004ull, 0x00000003023ull, 0x00000030104ull, 0x00000030014ull, 0x00000300005ull,
+	0x00000000242ull, 0x00000002303ull, 0x00000002213ull, 0x00000022004ull, 0x00000002123ull, 0x00000021104ull, 0x00000021014ull, 0x00000210005ull,
+	0x00000002033ull, 0x00000020204ull, 0x00000020114ull, 0x00000201005ull, 0x00000020024ull, 0x00000200105ull, 0x00000200015ull, 0x00002000006ull,
+	0x00000000152ull, 0x00000001403ull, 0x00000001313ull, 0x00000013004ull, 0x00000001223ull, 0x00000012104ull, 0x00000012014ull, 0x00000120005ull,
+	0x00000001133ull, 0x00000011204ull, 0x00000011114ull, 0x00000111005ull, 0x00000011024ull, 0x00000110105ull, 0x00000110015ull, 0x00001100006ull,
+	0x00000001043ull, 0x00000010304ull, 0x00000010214ull, 0x00000102005ull, 0x00000010124ull, 0x00000101105ull, 0x00000101015ull, 0x00001010006ull,
+	0x00000010034ull, 0x00000100205ull, 0x00000100115ull, 0x00001001006ull, 0x00000100025ull, 0x00001000106ull, 0x00001000016ull, 0x00010000007ull,
+	0x00000000062ull, 0x00000000503ull, 0x00000000413ull, 0x00000004004ull, 0x00000000323ull, 0x00000003104ull, 0x00000003014ull, 0x00000030005ull,
+	0x00000000233ull, 0x00000002204ull, 0x00000002114ull, 0x00000021005ull, 0x00000002024ull, 0x00000020105ull, 0x00000020015ull, 0x00000200006ull,
+	0x00000000143ull, 0x00000001304ull, 0x00000001214ull, 0x00000012005ull, 0x00000001124ull, 0x00000011105ull, 0x00000011015ull, 0x00000110006ull,
+	0x00000001034ull, 0x00000010205ull, 0x00000010115ull, 0x00000101006ull, 0x00000010025ull, 0x00000100106ull, 0x00000100016ull, 0x00001000007ull,
+	0x00000000053ull, 0x00000000404ull, 0x00000000314ull, 0x00000003005ull, 0x00000000224ull, 0x00000002105ull, 0x00000002015ull, 0x00000020006ull,
+	0x00000000134ull, 0x00000001205ull, 0x00000001115ull, 0x00000011006ull, 0x00000001025ull, 0x00000010106ull, 0x00000010016ull, 0x00000100007ull,
+	0x00000000044ull, 0x00000000305ull, 0x00000000215ull, 0x00000002006ull, 0x00000000125ull, 0x00000001106ull, 0x00000001016ull, 0x00000010007ull,
+	0x00000000035ull, 0x00000000206ull, 0x00000000116ull, 0x00000001007ull, 0x00000000026ull, 0x00000000107ull, 0x00000000017ull, 0x00000000008ull
+};
+
+#define DECODE_FLAG_BYTE(SHIFT, UPDATE, ERROR, SLOW_COPY) \
+{ /*
+	Decodes all 8 symbols of a flag byte using flag_runs. Each run of literals is copied with a single
+	wild 8-byte copy and only the offset/length symbols cause branches.
+
+	Arguments:
+		SHIFT        The number of bits used for the length, either a constant or shift
+		UPDATE       Code that updates pow2, mask, and shift if necessary, blank if they are constant
+		ERROR        Code to execute for an invalid offset, must return or jump
+		SLOW_COPY    Code to execute when near the end of the output during a copy, must return or jump
+
+	This makes use of the following local variables:
+		in        in/out  input array of bytes, updated to the next byte to read
+		out       in/out  output array of bytes, updated to the next byte to write
+		out_endx  in      8*FAST_COPY_ROOM from out_end
+		flags     in/out  the flag byte, when jumping to CHECKED_COPY it is converted to the remaining flags
+		runs      in      the entry from flag_runs for the flag byte
+	*/ \
+	uint_fast8_t m = (uint_fast8_t)(runs & 0xF), t = (uint_fast8_t)((runs >> 4) & 0xF); \
+	COPY_64(out, in); out += t; in += t; runs >>= 8; \
+	while (m--) \
+	{ \
+		UPDATE; \
+		const uint16_t sym = GET_UINT16(in); in += 2; \
+		len = (sym&((1<<(SHIFT))-1))+3; \
+		off = (sym>>(SHIFT))+1; \
+		const_rest_bytes o = out-off; \
+		if (UNLIKELY(o < out_start)) { ERROR; } \
+		FAST_COPY_SHORT(out, o, len, off, out_endx, \
+				flags = (byte)((flags >> (t+1)) | (0x80 >> t)); \
+				SLOW_COPY); \
+		const uint_fast8_t n = (uint_fast8_t)(runs & 0xF); \
+		COPY_64(out, in); out += n; in += n; t += n + 1; runs >>= 4; \
+	} \
+}
+#define UPDATE_POW2() while (UNLIKELY(out > pow2_target)) { pow2 <<= 1; pow2_target = out_start + pow2; mask >>= 1; --shift; } // Update the current power of two available bytes
+#define DECODE_FRAGMENT(ERROR, SLOW_COPY) \
+{ \
+	UPDATE_POW2(); \
+	uint64_t runs = flag_runs[flags = *in++]; \
+	/* The number of bits for the length only changes at powers of two of the output position so */ \
+	/* once the entire fragment is known to stay below the next power of two it is a constant */ \
+	if (shift == 4)                                         { DECODE_FLAG_BYTE(4,     ,              ERROR, SLOW_COPY); } \
+	else if (shift == 5 && out + 8*(0x1F+3) <= pow2_target) { DECODE_FLAG_BYTE(5,     ,              ERROR, SLOW_COPY); } \
+	else                                                    { DECODE_FLAG_BYTE(shift, UPDATE_POW2(), ERROR, SLOW_COPY); } \
+}
+
+#define IN_NEAR_END  0x19               // 1 + 8 * 2 + 8 from the end
+#define OUT_NEAR_END 8*FAST_COPY_ROOM  // both must be no more than MSCOMP_DECOMPRESS_SLACK
+template<bool Slack>
+static FORCE_INLINE MSCompStatus lznt1_decode_chunk(const_rest_bytes in, const const_bytes in_end, rest_bytes out, const const_bytes out_end, size_t* RESTRICT _out_len)
+{
+	// With slack the near-end pointers are relative to the end of the slack instead of the data
+	const const_bytes                  in_endx  = Slack ? in_end +(MSCOMP_DECOMPRESS_SLACK-IN_NEAR_END)  : in_end -IN_NEAR_END;
+	const const_bytes out_start = out, out_endx = Slack ? out_end+(MSCOMP_DECOMPRESS_SLACK-OUT_NEAR_END) : out_end-OUT_NEAR_END;
 	byte flags, flagged;
 	
 	uint_fast16_t pow2 = 0x10, mask = 0xFFF, shift = 12;
 	const_bytes pow2_target = out_start + 0x10;
 	uint_fast16_t len, off;
+	STATS_ONLY(size_t fast_len = 0;)
+	PHASE_SCOPE(MSCOMP_PHASE_DECODE);
 
 	// Most of the decompression happens here
 	// Very few bounds checks are done but we can only go to near the end and not the end
-	while (LIKELY(in < in_endx && out < out_endx))
+	if (Slack)
 	{
-		// Handle a fragment
-		flagged = (flags = *in++) & 0x01;
-		flags = (flags >> 1) | 0x80;
-		do
+		// Decompress entire fragments all the way to the end of the data, any fragment that goes past
+		// the end (into the slack) or has a problem is undone and redone in the slower loop below
+		const_bytes in_frag = in;
+		bytes out_frag = out;
+		while (LIKELY(in < in_end && out < out_end))
 		{
-			if (flagged)  // Offset/length symbol
+			in_frag = in; out_frag = out;
+			DECODE_FRAGMENT(goto ROLLBACK, goto ROLLBACK);
+			if (UNLIKELY(in > in_end || out > out_end))
 			{
-				// Offset/length symbol
-				while (UNLIKELY(out > pow2_target)) { pow2 <<= 1; pow2_target = out_start + pow2; mask >>= 1; --shift; } // Update the current power of two available bytes
-				uint16_t sym = GET_UINT16(in);
-				in += 2;
-				len = (sym&mask)+3;
-				off = (sym>>shift)+1;
-				const_rest_bytes o = out-off;
-				if (UNLIKELY(o < out_start)) { /*SET_ERROR(stream, "LZNT1 Decompression Error: Invalid data: Illegal offset (%p-%u < %p)", out, off, out_start);*/ return MSCOMP_DATA_ERROR; }
-				FAST_COPY_SHORT(out, o, len, off, out_endx,
-						if (UNLIKELY(out + len > out_end)) { return (out - out_start) + len > CHUNK_SIZE ? MSCOMP_DATA_ERROR : MSCOMP_BUF_ERROR; }
-						goto CHECKED_COPY);
+ROLLBACK:		in = in_frag; out = out_frag;
+				pow2 = 0x10; mask = 0xFFF; shift = 12; pow2_target = out_start + 0x10;
+				break;
 			}
-			else { *out++ = *in++; } // Copy byte directly
-			flagged = flags & 0x01;
-			flags >>= 1;
-		} while (LIKELY(flags));
+		}
+	}
+	else
+	{
+		while (LIKELY(in < in_endx && out < out_endx))
+		{
+			DECODE_FRAGMENT(return MSCOMP_DATA_ERROR,
+				if (UNLIKELY(out + len > out_end)) { return (out - out_start) + len > CHUNK_SIZE ? MSCOMP_DATA_ERROR : MSCOMP_BUF_ERROR; }
+				STATS_ONLY(fast_len = out - out_start;)
+				goto CHECKED_COPY);
+		}
 	}
+	STATS_ONLY(fast_len = out - out_start;)
 	
 	// Slower decompression but with full bounds checking
 	while (LIKELY(in < in_end))
@@ -81,12 +177,12 @@ static MSCompStatus lznt1_decompress_chunk(const_rest_bytes in, const const_byte
 		flags = (flags >> 1) | 0x80;
 		do
 		{
-			if (in == in_end) { *_out_len = out - out_start; return MSCOMP_OK; }
+			if (in == in_end) { STATS_DECOMPRESSED(out - out_start, fast_len); *_out_len = out - out_start; return MSCOMP_OK; }
 			else if (flagged) // Offset/length symbol
 			{
 				// Offset/length symbol
 				if (UNLIKELY(in + 2 > in_end)) { /*SET_ERROR(stream, "LZNT1 Decompression Error: Invalid data: Unable to read 2 bytes for offset/length");*/ return MSCOMP_DATA_ERROR; }
-				while (UNLIKELY(out > pow2_target)) { pow2 <<= 1; pow2_target = out_start + pow2; mask >>= 1; --shift; } // Update the current power of two available bytes
+				UPDATE_POW2();
 				{
 					const uint16_t sym = GET_UINT16(in);
 					off = (sym>>shift)+1;
@@ -108,7 +204,7 @@ static MSCompStatus lznt1_decompress_chunk(const_rest_bytes in, const const_byte
 CHECKED_COPY:		for (end = out + len; out < end; ++out) { *out = *(out-off); }
 				}
 			}
-			//else if (out == out_end) { printf("D %p %p %zu\n", out, out_end, out_end-out_start); return MSCOMP_BUF_ERROR; }
+			else if (UNLIKELY(out == out_end)) { return (out - out_start) >= CHUNK_SIZE ? MSCOMP_DATA_ERROR : MSCOMP_BUF_ERROR; }
 			else { *out++ = *in++; } // Copy byte directly
 			flagged = flags & 0x01;
 			flags >>= 1;
@@ -116,9 +212,14 @@ CHECKED_COPY:		for (end = out + len; out < end; ++out) { *out = *(out-off); }
 	}
 
 	if (UNLIKELY(in != in_end)) { /*SET_ERROR(stream, "LZNT1 Decompression Error: Invalid data: Unable to read byte for flags");*/ return MSCOMP_DATA_ERROR; }
+	STATS_DECOMPRESSED(out - out_start, fast_len);
 	*_out_len = out - out_start;
 	return MSCOMP_OK;
 }
+CPU_DISPATCH static MSCompStatus lznt1_decompress_chunk(const_rest_bytes in, const const_bytes in_end, rest_bytes out, const const_bytes out_end, size_t* RESTRICT _out_len)
+{
+	return lznt1_decode_chunk<false>(in, in_end, out, out_end, _out_len);
+}
 MSCompStatus lznt1_decompress_chunk_read(mscomp_stream* RESTRICT const stream, const_rest_bytes const in, size_t* RESTRICT const in_len)
 {
 	mscomp_internal_state* RESTRICT state = stream->state;
@@ -150,12 +251,13 @@ MSCompStatus lznt1_decompress_chunk_read(mscomp_stream* RESTRICT const stream, c
 	//   However in NT 3.51, NT 4 SP1, XP SP2, Win 7 SP1 the actual chunk size is always 4096 and the unknown flags are always 011 (0x3)
 	// The online description says it must always be 3.
 	if (UNLIKELY((header & 0x7000) != 0x3000)) { SET_ERROR(stream, "LZNT1 Decompression Error: Invalid header signature: %x", (unsigned int)((header >> 12) & 0x7)); return MSCOMP_DATA_ERROR; }
+	TRACE_CHUNK_START(MSCOMP_LZNT1, false);
+	size_t out_size;
 	if (header & 0x8000) // read compressed chunk
 	{
 		if (stream->out_avail < CHUNK_SIZE)
 		{
 			// buffer decompression
-			size_t out_size;
 			MSCompStatus status = lznt1_decompress_chunk(in+2, in+in_size, state->out, state->out+CHUNK_SIZE, &out_size);
 			if (UNLIKELY(status != MSCOMP_OK))
 			{
@@ -164,6 +266,7 @@ MSCompStatus lznt1_decompress_chunk_read(mscomp_stream* RESTRICT const stream, c
 #endif
 				return MSCOMP_DATA_ERROR;
 			}
+			CHECKSUM(state->out, out_size);
 			const size_t copy = MIN(out_size, stream->out_avail);
 			memcpy(stream->out, state->out, copy);
 			state->out_pos   = copy;
@@ -173,7 +276,6 @@ MSCompStatus lznt1_decompress_chunk_read(mscomp_stream* RESTRICT const stream, c
 		else
 		{
 			// direct decompress
-			size_t out_size;
 			MSCompStatus status = lznt1_decompress_chunk(in+2, in+in_size, stream->out, stream->out+CHUNK_SIZE, &out_size);
 			if (UNLIKELY(status != MSCOMP_OK))
 			{
@@ -182,12 +284,14 @@ MSCompStatus lznt1_decompress_chunk_read(mscomp_stream* RESTRICT const stream, c
 #endif
 				return MSCOMP_DATA_ERROR;
 			}
+			CHECKSUM(stream->out, out_size);
 			ADVANCE_OUT(stream, out_size);
 		}
 	}
 	else // read uncompressed chunk
 	{
-		const size_t out_size = in_size-2;
+		out_size = in_size-2;
+		CHECKSUM(in + 2, out_size);
 		if (stream->out_avail < out_size)
 		{
 			// chunk is longer than the available output space
@@ -205,14 +309,14 @@ MSCompStatus lznt1_decompress_chunk_read(mscomp_stream* RESTRICT const stream, c
 		}
 	}
 
+	TRACE_CHUNK_DONE(MSCOMP_LZNT1, false, !(header & 0x8000), in_size, out_size);
 	return MSCOMP_OK;
 }
 MSCompStatus lznt1_inflate_init(mscomp_stream* RESTRICT stream)
 {
 	INIT_STREAM(stream, false, MSCOMP_LZNT1);
 
-	mscomp_internal_state* RESTRICT state = (mscomp_internal_state*)malloc(sizeof(mscomp_internal_state));
-	if (UNLIKELY(state == NULL)) { SET_ERROR(stream, "LZNT1 Decompression Error: Unable to allocate buffer memory"); return MSCOMP_MEM_ERROR; }
+	ALLOC_STATE(stream, state, "LZNT1 Decompression Error: Unable to allocate buffer memory");
 	state->end_of_stream = false;
 	state->in_needed = 0;
 	state->in_avail  = 0;
@@ -222,9 +326,23 @@ MSCompStatus lznt1_inflate_init(mscomp_stream* RESTRICT stream)
 	stream->state = state;
 	return MSCOMP_OK;
 }
+MSCompStatus lznt1_inflate_reset(mscomp_stream* RESTRICT stream)
+{
+	RESET_STREAM(stream, false, MSCOMP_LZNT1, true);
+
+	mscomp_internal_state* RESTRICT state = stream->state;
+	state->end_of_stream = false;
+	state->in_needed = 0;
+	state->in_avail  = 0;
+	state->out_pos   = 0;
+	state->out_avail = 0;
+
+	return MSCOMP_OK;
+}
 ENTRY_POINT MSCompStatus lznt1_inflate(mscomp_stream* RESTRICT stream)
 {
 	CHECK_STREAM_PLUS(stream, false, MSCOMP_LZNT1, stream->state == NULL);
+	TRACE_SCOPE(stream->trace, stream->trace_opaque);
 
 	mscomp_internal_state* RESTRICT state = stream->state;
 
@@ -275,7 +393,7 @@ MSCompStatus lznt1_inflate_end(mscomp_stream* RESTRICT stream)
 	MSCompStatus status = MSCOMP_OK;
 	if (UNLIKELY(stream->in_avail || state->in_avail || state->out_avail)) { SET_ERROR(stream, "LZNT1 Decompression Error: End prematurely called"); status = MSCOMP_DATA_ERROR; }
 
-	free(state);
+	FREE_STATE(state);
 	stream->state = NULL;
 
 	return status;
@@ -327,5 +445,121 @@ ENTRY_POINT MSCompStatus lznt1_decompress(const_rest_bytes in, size_t in_len, re
 #else
 ALL_AT_ONCE_WRAPPER_DECOMPRESS(lznt1)
 #endif
+template<bool Slack, bool InPlace>
+static FORCE_INLINE MSCompStatus lznt1_decompress_chunks(const_bytes in, size_t in_len, bytes out, size_t* RESTRICT _out_len)
+{
+	const const_bytes in_end  = in  + in_len;
+	const const_bytes out_end = out + *_out_len, out_start = out;
+
+	// Go through every chunk, decompressing directly to the output
+	while (in + 2 <= in_end)
+	{
+		// Read chunk header
+		const uint16_t header = GET_UINT16(in);
+		in += 2;
+		if (UNLIKELY(header == 0))
+		{
+			if (UNLIKELY(in != in_end)) { return MSCOMP_DATA_ERROR; } // End-of-stream found with data left
+			break;
+		}
+		const uint_fast16_t in_size = (header & 0x0FFF)+1;
+		if (UNLIKELY(in + in_size > in_end) || UNLIKELY((header & 0x7000) != 0x3000)) { return MSCOMP_DATA_ERROR; }
+		TRACE_CHUNK_START(MSCOMP_LZNT1, false);
+
+		// See lznt1_decompress_chunk_read for the meaning of the flags
+		size_t out_size = 0;
+		if (header & 0x8000) // read compressed chunk
+		{
+			// The chunk is limited to CHUNK_SIZE but the slack after it is either the following chunk
+			// or the slack after the entire output
+			// When in-place the chunk must also fit entirely before its own input
+			const const_bytes out_end_chunk = MIN(InPlace ? in : out_end, out+CHUNK_SIZE);
+			const MSCompStatus status = Slack ? lznt1_decode_chunk<true>(in, in+in_size, out, out_end_chunk, &out_size) :
+			                                    lznt1_decompress_chunk  (in, in+in_size, out, out_end_chunk, &out_size);
+			if (UNLIKELY(status != MSCOMP_OK)) { return status; }
+		}
+		else // read uncompressed chunk
+		{
+			// When in-place the output is never after the input so the move is always safe
+			out_size = in_size;
+			if (UNLIKELY(out + out_size > out_end)) { return MSCOMP_BUF_ERROR; }
+			if (InPlace) { memmove(out, in, out_size); } else { memcpy(out, in, out_size); }
+		}
+		TRACE_CHUNK_DONE(MSCOMP_LZNT1, false, !(header & 0x8000), in_size+2, out_size);
+		CHECKSUM(out, out_size);
+		out += out_size;
+		in  += in_size;
+	}
+
+	if (UNLIKELY(in != in_end)) { return MSCOMP_DATA_ERROR; }
+	*_out_len = out - out_start;
+	return MSCOMP_OK;
+}
+ENTRY_POINT CPU_DISPATCH MSCompStatus lznt1_decompress_slack(const_rest_bytes in, size_t in_len, rest_bytes out, size_t* RESTRICT _out_len)
+{
+	return lznt1_decompress_chunks<true, false>(in, in_len, out, _out_len);
+}
+ENTRY_POINT MSCompStatus lznt1_decompress_inplace(bytes buf, size_t in_len, size_t* RESTRICT _out_len)
+{
+	if (UNLIKELY(in_len > *_out_len)) { return MSCOMP_ARG_ERROR; }
+	return lznt1_decompress_chunks<false, true>(buf + *_out_len - in_len, in_len, buf, _out_len);
+}
+size_t lznt1_inplace_margin(size_t in_len) { return MIN(in_len, CHUNK_SIZE) + 2 * (in_len / (CHUNK_SIZE + 2) + 2); } // a compressed chunk must fit before its own input and every uncompressed chunk adds 2 bytes
+
+// Validation walks the chunks and symbols exactly like lznt1_decompress_chunks and
+// lznt1_decode_chunk but only keeps track of the position within the chunk
+static MSCompStatus lznt1_validate_chunk(const_rest_bytes in, const const_bytes in_end, size_t* RESTRICT _out_len)
+{
+	uint_fast16_t pos = 0, pow2 = 0x10, mask = 0xFFF, shift = 12;
+	while (LIKELY(in < in_end))
+	{
+		byte flags = *in++;
+		for (uint_fast8_t i = 0; i < 8; ++i, flags >>= 1)
+		{
+			if (in == in_end) { *_out_len = pos; return MSCOMP_OK; }
+			else if (flags & 0x01) // Offset/length symbol
+			{
+				if (UNLIKELY(in + 2 > in_end)) { return MSCOMP_DATA_ERROR; }
+				while (UNLIKELY(pos > pow2)) { pow2 <<= 1; mask >>= 1; --shift; }
+				const uint16_t sym = GET_UINT16(in); in += 2;
+				const uint_fast16_t off = (sym>>shift)+1, len = (sym&mask)+3;
+				if (UNLIKELY(off > pos) || UNLIKELY(pos + len > CHUNK_SIZE)) { return MSCOMP_DATA_ERROR; }
+				pos += len;
+			}
+			else if (UNLIKELY(pos == CHUNK_SIZE)) { return MSCOMP_DATA_ERROR; }
+			else { ++pos; ++in; } // Literal byte
+		}
+	}
+	*_out_len = pos;
+	return MSCOMP_OK;
+}
+ENTRY_POINT MSCompStatus lznt1_validate(const_bytes in, size_t in_len, size_t* RESTRICT _out_len)
+{
+	const const_bytes in_end = in + in_len;
+	size_t out_len = 0;
+	while (in + 2 <= in_end)
+	{
+		const uint16_t header = GET_UINT16(in);
+		in += 2;
+		if (UNLIKELY(header == 0))
+		{
+			if (UNLIKELY(in != in_end)) { return MSCOMP_DATA_ERROR; } // End-of-stream found with data left
+			break;
+		}
+		const uint_fast16_t in_size = (header & 0x0FFF)+1;
+		if (UNLIKELY(in + in_size > in_end) || UNLIKELY((header & 0x7000) != 0x3000)) { return MSCOMP_DATA_ERROR; }
+		size_t out_size = in_size;
+		if (header & 0x8000)
+		{
+			const MSCompStatus status = lznt1_validate_chunk(in, in+in_size, &out_size);
+			if (UNLIKELY(status != MSCOMP_OK)) { return status; }
+		}
+		out_len += out_size;
+		in += in_size;
+	}
+	if (UNLIKELY(in != in_end)) { return MSCOMP_DATA_ERROR; }
+	*_out_len = out_len;
+	return MSCOMP_OK;
+}
 
 #endif
@@ -16,12 +16,15 @@
 
 
 #include "../include/mscomp/internal.h"
+#include "../include/mscomp/threads.h"
 #include "../include/mscomp.h"
 
 #include "../include/lznt1.h"
 #include "../include/xpress.h"
 #include "../include/xpress_huff.h"
 
+#include <math.h>
+
 // First we give some simple no-compression 'compression' functions
 MSCompStatus copy(const_bytes in, size_t in_len, bytes out, size_t* _out_len)
 {
@@ -31,6 +34,15 @@ MSCompStatus copy(const_bytes in, size_t in_len, bytes out, size_t* _out_len)
 	return MSCOMP_OK;
 }
 size_t copy_max_size(size_t in_len) { return in_len; }
+MSCompStatus copy_ctx(mscomp_context* /*ctx*/, const_bytes in, size_t in_len, bytes out, size_t* _out_len) { return copy(in, in_len, out, _out_len); }
+MSCompStatus copy_inplace(bytes buf, size_t in_len, size_t* _out_len)
+{
+	if (in_len > *_out_len) { return MSCOMP_ARG_ERROR; }
+	memmove(buf, buf + *_out_len - in_len, in_len);
+	*_out_len = in_len;
+	return MSCOMP_OK;
+}
+size_t copy_inplace_margin(size_t /*in_len*/) { return 0; }
 MSCompStatus copy_xxflate_init(mscomp_stream* stream) { INIT_STREAM(stream, true, MSCOMP_NONE); return MSCOMP_OK; }
 MSCompStatus copy_deflate(mscomp_stream* stream, MSCompFlush flush)
 {
@@ -58,6 +70,13 @@ MSCompStatus copy_inflate(mscomp_stream* stream)
 	stream->in_avail  -= n;
 	return MSCOMP_OK;
 }
+MSCompStatus copy_xxflate_reset(mscomp_stream* stream)
+{
+	// Both directions use the same stream, which is marked as compressing by copy_xxflate_init
+	if (UNLIKELY(stream == NULL || stream->format != MSCOMP_NONE || !stream->compressing)) { SET_ERROR(stream, "Error: Invalid stream provided"); return MSCOMP_ARG_ERROR; }
+	INIT_STREAM(stream, true, MSCOMP_NONE);
+	return MSCOMP_OK;
+}
 MSCompStatus copy_xxflate_end(mscomp_stream* stream) { CHECK_STREAM(stream, true, MSCOMP_NONE); return MSCOMP_OK; }
 
 
@@ -99,6 +118,19 @@ MSCOMPAPI size_t ms_max_compressed_size(MSCompFormat format, size_t in_len)
 	return max_compressed_sizers[format](in_len);
 }
 
+typedef MSCompStatus (*compressed_size_func)(const_bytes in, size_t in_len, size_t* size);
+
+MSCompStatus copy_compressed_size(const_bytes /*in*/, size_t in_len, size_t* size) { *size = in_len; return MSCOMP_OK; }
+
+static compressed_size_func compressed_sizers[] =
+{
+	copy_compressed_size,
+	NULL,
+	IF_WITH_LZNT1(lznt1_compressed_size),
+	IF_WITH_XPRESS(xpress_compressed_size),
+	IF_WITH_XPRESS_HUFF(xpress_huff_compressed_size),
+};
+
 typedef MSCompStatus (*compress_func)(const_bytes in, size_t in_len, bytes out, size_t* out_len);
 
 static compress_func compressors[] =
@@ -110,12 +142,205 @@ static compress_func compressors[] =
 	IF_WITH_XPRESS_HUFF(xpress_huff_compress),
 };
 
+// The amount of data before each sampled block that is compressed along with it to fill the window
+// so that the samples are compressed like they would be in the middle of the data (LZNT1 chunks
+// are independent and do not need any)
+#define SAMPLE_BLOCK_SIZE 0x10000
+static const size_t sample_histories[] = { 0, 0, 0, 0x2000, 0x10000 };
+
+// Gets the compressed size of a sample, compressing it into the scratch buffer when there is one so
+// that the real compressor can be timed instead of just the size pass
+static MSCompStatus sample_size(MSCompFormat format, const_bytes in, size_t in_len, bytes scratch, size_t* size)
+{
+	if (!scratch) { return compressed_sizers[format](in, in_len, size); }
+	*size = max_compressed_sizers[format](in_len);
+	return compressors[format](in, in_len, scratch, size);
+}
+
+// The work is the number of bytes that were actually given to the compressor. The scratch buffer
+// (if not NULL) must fit the compressed history and block of a sample.
+static MSCompStatus estimate(MSCompFormat format, const_bytes in, size_t in_len, unsigned sample_ratio, bytes scratch, size_t* size, size_t* error, size_t* work)
+{
+	const compressed_size_func sizer = compressed_sizers[format];
+	const size_t history = sample_histories[format], blocks = (in_len + SAMPLE_BLOCK_SIZE - 1) / SAMPLE_BLOCK_SIZE;
+	*error = 0;
+	if (sample_ratio <= 1 || blocks / sample_ratio < 2) { *work = in_len; return sizer(in, in_len, size); }
+
+	// Compress every sample_ratio-th block and scale up the ratio of the samples (a ratio estimator).
+	// Each sample is the size of the block with its history minus the size of the history alone.
+	// The error is twice the standard error of that ratio, so about 95% of estimates are within it.
+	size_t k = 0, sampled_len = 0, sampled_size = 0, total = 0;
+	double sum_c2 = 0, sum_cn = 0, sum_n2 = 0;
+	for (size_t i = sample_ratio / 2; i < blocks; i += sample_ratio, ++k)
+	{
+		const const_bytes block = in + i * SAMPLE_BLOCK_SIZE;
+		const size_t n = MIN(in_len - i * SAMPLE_BLOCK_SIZE, SAMPLE_BLOCK_SIZE); // i >= 1 so history is always available
+		size_t c, h = 0;
+		MSCompStatus status = sample_size(format, block - history, history + n, scratch, &c);
+		if (UNLIKELY(status != MSCOMP_OK)) { return status; }
+		if (history && UNLIKELY((status = sample_size(format, block - history, history, scratch, &h)) != MSCOMP_OK)) { return status; }
+		c = (c > h) ? c - h : 0;
+		sampled_len += n; sampled_size += c; total += 2 * history + n;
+		sum_c2 += (double)c * c; sum_cn += (double)c * n; sum_n2 += (double)n * n;
+	}
+	const double ratio = (double)sampled_size / sampled_len, mean_n = (double)sampled_len / k;
+	const double s2 = MAX(sum_c2 - 2 * ratio * sum_cn + ratio * ratio * sum_n2, 0.0) / (k - 1); // variance of c - ratio*n
+	const double var = s2 / (mean_n * mean_n) / k * (1.0 - (double)k / blocks);
+	*size = (size_t)(ratio * in_len + 0.5);
+	*error = (size_t)(2 * sqrt(var) * in_len + 0.5);
+	*work = total;
+	return MSCOMP_OK;
+}
+
+MSCOMPAPI MSCompStatus ms_estimate_compressed_size(MSCompFormat format, const_bytes in, size_t in_len, unsigned sample_ratio, size_t* size, size_t* error)
+{
+	if ((unsigned)format >= ARRAYSIZE(compressed_sizers) || !compressed_sizers[format] || size == NULL || error == NULL) { return MSCOMP_ARG_ERROR; }
+	size_t work;
+	return estimate(format, in, in_len, sample_ratio, NULL, size, error, &work);
+}
+
 MSCOMPAPI MSCompStatus ms_compress(MSCompFormat format, const_bytes in, size_t in_len, bytes out, size_t* out_len)
 {
 	if ((unsigned)format >= ARRAYSIZE(compressors) || !compressors[format]) { return MSCOMP_ARG_ERROR; }
 	return compressors[format](in, in_len, out, out_len);
 }
 
+MSCOMPAPI MSCompStatus ms_compress_checksum(MSCompFormat format, const_bytes in, size_t in_len, bytes out, size_t* out_len, uint32_t* checksum)
+{
+	if ((unsigned)format >= ARRAYSIZE(compressors) || !compressors[format] || checksum == NULL) { return MSCOMP_ARG_ERROR; }
+#ifdef MSCOMP_WITH_CHECKSUM
+	// The chunks are checksummed as they are compressed, anything that was not (like MSCOMP_NONE)
+	// is checksummed afterwards
+	ms_checksum_state state = { 0, 0 };
+	CHECKSUM_SCOPE(&state);
+	const MSCompStatus status = compressors[format](in, in_len, out, out_len);
+	if (status == MSCOMP_OK) { *checksum = (state.len == in_len) ? state.crc : ms_crc32c(0, in, in_len); }
+#else
+	const MSCompStatus status = compressors[format](in, in_len, out, out_len);
+	if (status == MSCOMP_OK) { *checksum = ms_crc32c(0, in, in_len); }
+#endif
+	return status;
+}
+
+// Automatic Format Selection
+
+#define AUTO_SAMPLE_RATIO	16
+#define AUTO_MIN_SAMPLE		0x4000
+
+MSCOMPAPI MSCompStatus ms_compress_auto(const_bytes in, size_t in_len, bytes out, size_t* out_len, const mscomp_auto_options* options, MSCompFormat* format)
+{
+	if (out_len == NULL || options == NULL || format == NULL || (unsigned)options->objective > MSCOMP_MAX_SPEED ||
+		!(options->min_speed >= 0.0) || !(options->min_ratio >= 0.0)) { return MSCOMP_ARG_ERROR; } // the negations also catch NaNs
+	const unsigned sample_ratio = options->sample_ratio ? options->sample_ratio : AUTO_SAMPLE_RATIO;
+	const bool sampled = sample_ratio > 1 && (in_len + SAMPLE_BLOCK_SIZE - 1) / SAMPLE_BLOCK_SIZE / sample_ratio >= 2;
+	const size_t piece = MIN(in_len, MAX(in_len / sample_ratio, AUTO_MIN_SAMPLE)); // when not sampled
+
+	// The samples are really compressed (into a scratch buffer) so the speeds are of the compressors
+	// that will be used and not the faster size passes
+	size_t scratch_len = 0;
+	for (unsigned f = MSCOMP_LZNT1; f < ARRAYSIZE(compressors); ++f)
+	{
+		if (compressors[f]) { scratch_len = MAX(scratch_len, max_compressed_sizers[f](sampled ? sample_histories[f] + SAMPLE_BLOCK_SIZE : piece)); }
+	}
+	bytes scratch = NULL;
+	if (scratch_len && (scratch = (bytes)MS_ALLOC(&ms_global_allocator, scratch_len)) == NULL) { return MSCOMP_MEM_ERROR; }
+
+	// Storing the data is always possible and is considered infinitely fast
+	MSCompFormat best = MSCOMP_NONE;
+	double best_ratio = 1.0, best_speed = HUGE_VAL;
+	for (unsigned f = MSCOMP_LZNT1; f < ARRAYSIZE(compressors); ++f)
+	{
+		if (!compressors[f]) { continue; }
+
+		// Estimate the size and measure the speed of the format on samples of the data. Data that
+		// is too small for ms_estimate_compressed_size to sample uses a single piece from the middle.
+		size_t size, error, work;
+		MSCompStatus status;
+		const uint64_t start = ms_time_ns();
+		if (sampled) { status = estimate((MSCompFormat)f, in, in_len, sample_ratio, scratch, &size, &error, &work); }
+		else
+		{
+			work = piece;
+			status = sample_size((MSCompFormat)f, in + (in_len - work) / 2, work, scratch, &size);
+			if (work) { size = (size_t)((double)size * in_len / work + 0.5); }
+		}
+		const uint64_t ns = ms_time_ns() - start;
+		if (UNLIKELY(status != MSCOMP_OK)) { if (scratch) { MS_FREE(&ms_global_allocator, scratch, scratch_len); } return status; }
+		const double ratio = size ? (double)in_len / size : HUGE_VAL;
+		const double speed = ns ? work * 1000.0 / ns : HUGE_VAL; // MB/s
+
+		// Pick the best format that meets the floor, or the one closest to the floor if none do
+		if (options->objective == MSCOMP_MAX_RATIO)
+		{
+			if (speed >= options->min_speed && ratio > best_ratio) { best = (MSCompFormat)f; best_ratio = ratio; best_speed = speed; }
+		}
+		else
+		{
+			const bool ok = ratio >= options->min_ratio, best_ok = best_ratio >= options->min_ratio;
+			if ((ok && (!best_ok || speed > best_speed)) || (!ok && !best_ok && ratio > best_ratio)) { best = (MSCompFormat)f; best_ratio = ratio; best_speed = speed; }
+		}
+	}
+
+	if (scratch) { MS_FREE(&ms_global_allocator, scratch, scratch_len); }
+
+	// Compress with the chosen format, storing the data if it does not fit after all
+	MSCompStatus status = MSCOMP_BUF_ERROR;
+	const size_t len = *out_len;
+	if (best != MSCOMP_NONE && (status = compressors[best](in, in_len, out, out_len)) == MSCOMP_BUF_ERROR && in_len <= len) { *out_len = len; best = MSCOMP_NONE; }
+	if (best == MSCOMP_NONE) { status = copy(in, in_len, out, out_len); }
+	*format = best;
+	return status;
+}
+
+// Reusable Compression Contexts
+
+typedef MSCompStatus (*compress_ctx_func)(mscomp_context* ctx, const_bytes in, size_t in_len, bytes out, size_t* out_len);
+typedef void (*context_free_func)(mscomp_context* ctx);
+
+static compress_ctx_func compressors_ctx[] =
+{
+	copy_ctx,
+	NULL,
+	IF_WITH_LZNT1(lznt1_compress_ctx),
+	IF_WITH_XPRESS(xpress_compress_ctx),
+	IF_WITH_XPRESS_HUFF(xpress_huff_compress_ctx),
+};
+
+static context_free_func context_freers[] =
+{
+	NULL,
+	NULL,
+	IF_WITH_LZNT1(lznt1_context_free),
+	IF_WITH_XPRESS(xpress_context_free),
+	IF_WITH_XPRESS_HUFF(xpress_huff_context_free),
+};
+
+MSCOMPAPI MSCompStatus ms_context_create(mscomp_context** ctx) { return ms_context_create_with_allocator(ctx, NULL); }
+MSCOMPAPI MSCompStatus ms_context_create_with_allocator(mscomp_context** ctx, const mscomp_allocator* allocator)
+{
+	if (ctx == NULL) { return MSCOMP_ARG_ERROR; }
+	if (allocator == NULL) { allocator = &ms_global_allocator; }
+	else if (allocator->alloc == NULL || allocator->realloc == NULL || allocator->free == NULL) { return MSCOMP_ARG_ERROR; }
+	mscomp_context* c = (mscomp_context*)MS_ALLOC(allocator, sizeof(mscomp_context));
+	if (c == NULL) { return MSCOMP_MEM_ERROR; }
+	memset(c, 0, sizeof(mscomp_context));
+	c->allocator = *allocator;
+	*ctx = c;
+	return MSCOMP_OK;
+}
+MSCOMPAPI void ms_context_free(mscomp_context* ctx)
+{
+	if (ctx == NULL) { return; }
+	for (size_t i = 0; i < ARRAYSIZE(context_freers); ++i) { if (context_freers[i]) { context_freers[i](ctx); } }
+	const mscomp_allocator allocator = ctx->allocator;
+	MS_FREE(&allocator, ctx, sizeof(mscomp_context));
+}
+MSCOMPAPI MSCompStatus ms_compress_ctx(mscomp_context* ctx, MSCompFormat format, const_bytes in, size_t in_len, bytes out, size_t* out_len)
+{
+	if (ctx == NULL || (unsigned)format >= ARRAYSIZE(compressors_ctx) || !compressors_ctx[format]) { return MSCOMP_ARG_ERROR; }
+	return compressors_ctx[format](ctx, in, in_len, out, out_len);
+}
+
 static compress_func decompressors[] =
 {
 	copy,
@@ -131,6 +356,267 @@ MSCOMPAPI MSCompStatus ms_decompress(MSCompFormat format, const_bytes in, size_t
 	return decompressors[format](in, in_len, out, out_len);
 }
 
+MSCOMPAPI MSCompStatus ms_decompress_checksum(MSCompFormat format, const_bytes in, size_t in_len, bytes out, size_t* out_len, uint32_t* checksum)
+{
+	if ((unsigned)format >= ARRAYSIZE(decompressors) || !decompressors[format] || checksum == NULL) { return MSCOMP_ARG_ERROR; }
+#ifdef MSCOMP_WITH_CHECKSUM
+	// The chunks are checksummed as they are decompressed, anything that was not (like Xpress,
+	// which has no chunks) is checksummed afterwards
+	ms_checksum_state state = { 0, 0 };
+	CHECKSUM_SCOPE(&state);
+	const MSCompStatus status = decompressors[format](in, in_len, out, out_len);
+	if (status == MSCOMP_OK) { *checksum = (state.len == *out_len) ? state.crc : ms_crc32c(0, out, *out_len); }
+#else
+	const MSCompStatus status = decompressors[format](in, in_len, out, out_len);
+	if (status == MSCOMP_OK) { *checksum = ms_crc32c(0, out, *out_len); }
+#endif
+	return status;
+}
+
+static compress_func decompressors_slack[] =
+{
+	copy,
+	NULL,
+	IF_WITH_LZNT1(lznt1_decompress_slack),
+	IF_WITH_XPRESS(xpress_decompress_slack),
+	IF_WITH_XPRESS_HUFF(xpress_huff_decompress_slack),
+};
+
+MSCOMPAPI MSCompStatus ms_decompress_slack(MSCompFormat format, const_bytes in, size_t in_len, bytes out, size_t* out_len)
+{
+	if ((unsigned)format >= ARRAYSIZE(decompressors_slack) || !decompressors_slack[format]) { return MSCOMP_ARG_ERROR; }
+	return decompressors_slack[format](in, in_len, out, out_len);
+}
+
+typedef MSCompStatus (*inplace_func)(bytes buf, size_t in_len, size_t* out_len);
+
+static inplace_func decompressors_inplace[] =
+{
+	copy_inplace,
+	NULL,
+	IF_WITH_LZNT1(lznt1_decompress_inplace),
+	IF_WITH_XPRESS(xpress_decompress_inplace),
+	IF_WITH_XPRESS_HUFF(xpress_huff_decompress_inplace),
+};
+
+MSCOMPAPI MSCompStatus ms_decompress_inplace(MSCompFormat format, bytes buf, size_t in_len, size_t* out_len)
+{
+	if ((unsigned)format >= ARRAYSIZE(decompressors_inplace) || !decompressors_inplace[format]) { return MSCOMP_ARG_ERROR; }
+	return decompressors_inplace[format](buf, in_len, out_len);
+}
+
+static max_compressed_size_func inplace_margins[] =
+{
+	copy_inplace_margin,
+	NULL,
+	IF_WITH_LZNT1(lznt1_inplace_margin),
+	IF_WITH_XPRESS(xpress_inplace_margin),
+	IF_WITH_XPRESS_HUFF(xpress_huff_inplace_margin),
+};
+
+MSCOMPAPI size_t ms_inplace_margin(MSCompFormat format, size_t in_len)
+{
+	if ((unsigned)format >= ARRAYSIZE(inplace_margins) || !inplace_margins[format]) { return (size_t)-1; }
+	return inplace_margins[format](in_len);
+}
+
+typedef MSCompStatus (*validate_func)(const_bytes in, size_t in_len, size_t* out_len);
+
+static validate_func validators[] =
+{
+	copy_compressed_size, // stored data is always valid and is its own size
+	NULL,
+	IF_WITH_LZNT1(lznt1_validate),
+	IF_WITH_XPRESS(xpress_validate),
+	IF_WITH_XPRESS_HUFF(xpress_huff_validate),
+};
+
+MSCOMPAPI MSCompStatus ms_validate(MSCompFormat format, const_bytes in, size_t in_len, size_t* out_len)
+{
+	if ((unsigned)format >= ARRAYSIZE(validators) || !validators[format] || out_len == NULL) { return MSCOMP_ARG_ERROR; }
+	return validators[format](in, in_len, out_len);
+}
+
+// Batch Compression and Decompression
+// The calling thread and every executor task repeatedly claim the next unclaimed item until there
+// are none left, so threads that get small items simply end up doing more of them.
+
+struct batch
+{
+	mscomp_batch_item* items;
+	size_t count;
+	size_t next; // the next unclaimed item, shared between the threads
+	compress_func func;
+	compress_ctx_func func_ctx; // when compressing, used if the thread gets a context
+	mscomp_context** ctxs; // one for each thread, created and freed by the calling thread
+	size_t ctx_count;
+	size_t next_ctx; // the next unclaimed context, shared between the threads
+};
+
+static void batch_run(void* arg)
+{
+	batch* b = (batch*)arg;
+	const size_t c = b->ctx_count ? ATOMIC_FETCH_ADD(&b->next_ctx, 1) : 0;
+	mscomp_context* ctx = c < b->ctx_count ? b->ctxs[c] : NULL;
+	size_t i;
+	while ((i = ATOMIC_FETCH_ADD(&b->next, 1)) < b->count)
+	{
+		mscomp_batch_item* item = b->items + i;
+		item->status = ctx ?
+			b->func_ctx(ctx, item->in, item->in_len, item->out, &item->out_len) :
+			b->func(item->in, item->in_len, item->out, &item->out_len);
+	}
+}
+
+static MSCompStatus batch_all(batch* b, unsigned threads)
+{
+	if (threads == 0) { threads = cpu_count(); }
+	if (threads > b->count) { threads = (unsigned)b->count; }
+
+	// The contexts are created before running any tasks so the allocator is not used for them
+	// concurrently, a task that does not get a context uses the plain function
+	if (threads && b->func_ctx && (b->ctxs = (mscomp_context**)MS_ALLOC(&ms_global_allocator, threads * sizeof(mscomp_context*))) != NULL)
+	{
+		while (b->ctx_count < threads && ms_context_create(b->ctxs + b->ctx_count) == MSCOMP_OK) { ++b->ctx_count; }
+	}
+	ms_parallel(batch_run, b, threads);
+	if (b->ctxs)
+	{
+		for (size_t i = 0; i < b->ctx_count; ++i) { ms_context_free(b->ctxs[i]); }
+		MS_FREE(&ms_global_allocator, b->ctxs, threads * sizeof(mscomp_context*));
+	}
+	for (size_t i = 0; i < b->count; ++i) { if (b->items[i].status != MSCOMP_OK) { return b->items[i].status; } }
+	return MSCOMP_OK;
+}
+
+MSCOMPAPI MSCompStatus ms_compress_batch(MSCompFormat format, mscomp_batch_item* items, size_t count, unsigned threads)
+{
+	if ((unsigned)format >= ARRAYSIZE(compressors) || !compressors[format] || (items == NULL && count)) { return MSCOMP_ARG_ERROR; }
+	batch b = { items, count, 0, compressors[format], compressors_ctx[format], NULL, 0, 0 };
+	return batch_all(&b, threads);
+}
+
+MSCOMPAPI MSCompStatus ms_decompress_batch(MSCompFormat format, mscomp_batch_item* items, size_t count, unsigned threads)
+{
+	if ((unsigned)format >= ARRAYSIZE(decompressors) || !decompressors[format] || (items == NULL && count)) { return MSCOMP_ARG_ERROR; }
+	batch b = { items, count, 0, decompressors[format], NULL, NULL, 0, 0 };
+	return batch_all(&b, threads);
+}
+
+// Statistics
+
+#ifdef MSCOMP_WITH_STATS
+THREAD_LOCAL mscomp_stats ms_stats;
+#endif
+
+MSCOMPAPI void ms_get_stats(mscomp_stats* stats, bool reset)
+{
+#ifdef MSCOMP_WITH_STATS
+	if (stats) { *stats = ms_stats; }
+	if (reset) { memset(&ms_stats, 0, sizeof(mscomp_stats)); }
+#else
+	if (stats) { memset(stats, 0, sizeof(mscomp_stats)); }
+	(void)reset;
+#endif
+}
+
+// Phases
+
+#ifdef MSCOMP_WITH_PHASES
+mscomp_phase_hook ms_phase_hook = NULL;
+void* ms_phase_opaque = NULL;
+#endif
+
+MSCOMPAPI MSCompStatus ms_set_phase_hook(mscomp_phase_hook hook, void* opaque)
+{
+#ifdef MSCOMP_WITH_PHASES
+	ms_phase_hook = hook;
+	ms_phase_opaque = opaque;
+	return MSCOMP_OK;
+#else
+	(void)hook; (void)opaque;
+	return MSCOMP_ARG_ERROR;
+#endif
+}
+
+// Timing
+
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#include <windows.h>
+uint64_t ms_time_ns()
+{
+	LARGE_INTEGER freq, count;
+	QueryPerformanceFrequency(&freq);
+	QueryPerformanceCounter(&count);
+	return (uint64_t)(count.QuadPart / freq.QuadPart * 1000000000 + count.QuadPart % freq.QuadPart * 1000000000 / freq.QuadPart);
+}
+#else
+#include <time.h>
+uint64_t ms_time_ns()
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint64_t)ts.tv_sec * 1000000000 + (uint64_t)ts.tv_nsec;
+}
+#endif
+
+// Chunk Tracing
+
+#ifdef MSCOMP_WITH_TRACE
+THREAD_LOCAL ms_trace_target ms_trace;
+THREAD_LOCAL uint64_t ms_trace_phase_ns[MSCOMP_PHASE_COUNT];
+
+void ms_trace_chunk(MSCompFormat format, bool compressing, bool stored, size_t in_len, size_t out_len, uint64_t start)
+{
+	mscomp_chunk_trace trace;
+	trace.format = format;
+	trace.compressing = compressing;
+	trace.stored = stored;
+	trace.in_len = in_len;
+	trace.out_len = out_len;
+	trace.ns = ms_time_ns() - start;
+	memcpy(trace.phase_ns, ms_trace_phase_ns, sizeof(trace.phase_ns));
+	ms_trace.func(ms_trace.opaque, &trace);
+}
+#endif
+
+MSCOMPAPI MSCompStatus ms_stream_set_trace(mscomp_stream* stream, mscomp_trace_func func, void* opaque)
+{
+	if (stream == NULL) { return MSCOMP_ARG_ERROR; }
+#ifdef MSCOMP_WITH_TRACE
+	stream->trace = func;
+	stream->trace_opaque = opaque;
+	return MSCOMP_OK;
+#else
+	(void)func; (void)opaque;
+	return MSCOMP_ARG_ERROR;
+#endif
+}
+MSCOMPAPI MSCompStatus ms_stream_set_checksum(mscomp_stream* stream, bool enable)
+{
+	if (stream == NULL) { return MSCOMP_ARG_ERROR; }
+#ifdef MSCOMP_WITH_STREAM_CHECKSUM
+	stream->checksumming = enable;
+	return MSCOMP_OK;
+#else
+	(void)enable;
+	return MSCOMP_ARG_ERROR;
+#endif
+}
+MSCOMPAPI MSCompStatus ms_context_set_trace(mscomp_context* ctx, mscomp_trace_func func, void* opaque)
+{
+	if (ctx == NULL) { return MSCOMP_ARG_ERROR; }
+#ifdef MSCOMP_WITH_TRACE
+	ctx->trace = func;
+	ctx->trace_opaque = opaque;
+	return MSCOMP_OK;
+#else
+	(void)func; (void)opaque;
+	return MSCOMP_ARG_ERROR;
+#endif
+}
+
 // Streaming Compression and Decompression Functions
 
 typedef MSCompStatus (*stream_func)(mscomp_stream* stream);
@@ -154,6 +640,15 @@ static stream_flush_func deflaters[] =
 	// TODO: IF_WITH_XPRESS_HUFF(xpress_huff_deflate),
 };
 
+static stream_func deflaters_reset[] =
+{
+	copy_xxflate_reset,
+	NULL,
+	IF_WITH_LZNT1(lznt1_deflate_reset),
+	IF_WITH_XPRESS(xpress_deflate_reset),
+	// TODO: IF_WITH_XPRESS_HUFF(xpress_huff_deflate_reset),
+};
+
 static stream_func deflaters_end[] =
 {
 	copy_xxflate_end,
@@ -171,8 +666,23 @@ MSCompStatus ms_deflate_init(MSCompFormat format, mscomp_stream* stream)
 MSCompStatus ms_deflate(mscomp_stream* stream, MSCompFlush flush)
 {
 	if (stream == NULL || (unsigned)stream->format >= ARRAYSIZE(deflaters) || !deflaters[stream->format]) { SET_ERROR(stream, "Error: Invalid stream provided"); return MSCOMP_ARG_ERROR; }
+#ifdef MSCOMP_WITH_STREAM_CHECKSUM
+	if (stream->checksumming)
+	{
+		// Checksum the input that was consumed while it is still in the cache
+		const const_bytes in = stream->in;
+		const MSCompStatus status = deflaters[stream->format](stream, flush);
+		if (stream->in != in) { stream->checksum = ms_crc32c(stream->checksum, in, stream->in - in); }
+		return status;
+	}
+#endif
 	return deflaters[stream->format](stream, flush);
 }
+MSCompStatus ms_deflate_reset(mscomp_stream* stream, MSCompFormat format)
+{
+	if (stream == NULL || (unsigned)format >= ARRAYSIZE(deflaters_reset) || !deflaters_reset[format]) { SET_ERROR(stream, "Error: Invalid format provided"); return MSCOMP_ARG_ERROR; }
+	return deflaters_reset[format](stream);
+}
 MSCompStatus ms_deflate_end(mscomp_stream* stream)
 {
 	if (stream == NULL || (unsigned)stream->format >= ARRAYSIZE(deflaters_end) || !deflaters_end[stream->format]) { SET_ERROR(stream, "Error: Invalid stream provided"); return MSCOMP_ARG_ERROR; }
@@ -188,6 +698,15 @@ static stream_func inflaters_init[] =
 	// TODO: IF_WITH_XPRESS_HUFF(xpress_huff_inflate_init),
 };
 
+static stream_func inflaters_init_contiguous[] =
+{
+	copy_xxflate_init,
+	NULL,
+	IF_WITH_LZNT1(lznt1_inflate_init), // LZNT1 chunks never look back past the start of the chunk
+	IF_WITH_XPRESS(xpress_inflate_init_contiguous),
+	// TODO: IF_WITH_XPRESS_HUFF(xpress_huff_inflate_init_contiguous),
+};
+
 static stream_func inflaters[] =
 {
 	copy_inflate,
@@ -197,6 +716,15 @@ static stream_func inflaters[] =
 	// TODO: IF_WITH_XPRESS_HUFF(xpress_huff_inflate),
 };
 
+static stream_func inflaters_reset[] =
+{
+	copy_xxflate_reset,
+	NULL,
+	IF_WITH_LZNT1(lznt1_inflate_reset),
+	IF_WITH_XPRESS(xpress_inflate_reset),
+	// TODO: IF_WITH_XPRESS_HUFF(xpress_huff_inflate_reset),
+};
+
 static stream_func inflaters_end[] =
 {
 	copy_xxflate_end,
@@ -211,11 +739,31 @@ MSCompStatus ms_inflate_init(MSCompFormat format, mscomp_stream* stream)
 	if ((unsigned)format >= ARRAYSIZE(inflaters_init) || !inflaters_init[format]) { SET_ERROR(stream, "Error: Invalid format provided"); return MSCOMP_ARG_ERROR; }
 	return inflaters_init[format](stream);
 }
+MSCompStatus ms_inflate_init_contiguous(MSCompFormat format, mscomp_stream* stream)
+{
+	if ((unsigned)format >= ARRAYSIZE(inflaters_init_contiguous) || !inflaters_init_contiguous[format]) { SET_ERROR(stream, "Error: Invalid format provided"); return MSCOMP_ARG_ERROR; }
+	return inflaters_init_contiguous[format](stream);
+}
 MSCompStatus ms_inflate(mscomp_stream* stream)
 {
 	if (stream == NULL || (unsigned)stream->format >= ARRAYSIZE(inflaters) || !inflaters[stream->format]) { SET_ERROR(stream, "Error: Invalid stream provided"); return MSCOMP_ARG_ERROR; }
+#ifdef MSCOMP_WITH_STREAM_CHECKSUM
+	if (stream->checksumming)
+	{
+		// Checksum the output that was produced while it is still in the cache
+		const const_bytes out = stream->out;
+		const MSCompStatus status = inflaters[stream->format](stream);
+		if (stream->out != out) { stream->checksum = ms_crc32c(stream->checksum, out, stream->out - out); }
+		return status;
+	}
+#endif
 	return inflaters[stream->format](stream);
 }
+MSCompStatus ms_inflate_reset(mscomp_stream* stream, MSCompFormat format)
+{
+	if (stream == NULL || (unsigned)format >= ARRAYSIZE(inflaters_reset) || !inflaters_reset[format]) { SET_ERROR(stream, "Error: Invalid format provided"); return MSCOMP_ARG_ERROR; }
+	return inflaters_reset[format](stream);
+}
 MSCompStatus ms_inflate_end(mscomp_stream* stream)
 {
 	if (stream == NULL || (unsigned)stream->format >= ARRAYSIZE(inflaters_end) || !inflaters_end[stream->format]) { SET_ERROR(stream, "Error: Invalid stream provided"); return MSCOMP_ARG_ERROR; }
@@ -25,12 +25,27 @@
 
 #define MIN_DATA	5
 
-typedef XpressDictionary<0x2000> Dictionary;
+typedef XpressDictionary<0x2000, 0x2000, 15, 3, uint16_t> Dictionary;
+
+// Small inputs use dictionaries with fewer hash bits, a window sized to the input, and 16-bit
+// positions so that the time to set them up scales with the size of the input
+#define SMALL_SIZE	0x400
+#define MEDIUM_SIZE	0x2000
+typedef XpressDictionary<SMALL_SIZE,  SMALL_SIZE,  11, 3, uint16_t> DictionarySmall;
+typedef XpressDictionary<MEDIUM_SIZE, MEDIUM_SIZE, 14, 3, uint16_t> DictionaryMedium;
+
+struct xpress_context
+{
+	Dictionary d;
+	DictionaryMedium medium;
+	DictionarySmall small;
+};
 
 size_t xpress_max_compressed_size(size_t in_len) { return in_len + 4 + 4 * (in_len / 32); }
 
 struct _mscomp_internal_state
 { // ?-? bytes
+	size_t size; // see ALLOC_STATE
 	bool finished;
 	
 	uint32_t flags, *out_flags;
@@ -52,8 +67,7 @@ MSCompStatus xpress_deflate_init(mscomp_stream* stream)
 #ifdef _DEBUG
 	INIT_STREAM(stream, true, MSCOMP_XPRESS);
 
-	mscomp_internal_state* state = (mscomp_internal_state*)malloc(sizeof(mscomp_internal_state));
-	if (UNLIKELY(state == NULL)) { SET_ERROR(stream, "XPRESS Compression Error: Unable to allocate buffer memory"); return MSCOMP_MEM_ERROR; }
+	ALLOC_STATE(stream, state, "XPRESS Compression Error: Unable to allocate buffer memory");
 	state->finished  = false;
 	state->flags = 0;
 	state->out_flags = NULL;
@@ -72,6 +86,20 @@ MSCompStatus xpress_deflate_init(mscomp_stream* stream)
 	return MSCOMP_MEM_ERROR;
 #endif
 }
+MSCompStatus xpress_deflate_reset(mscomp_stream* stream)
+{
+	RESET_STREAM(stream, true, MSCOMP_XPRESS, false);
+
+	mscomp_internal_state* state = stream->state;
+	state->finished  = false;
+	state->flags = 0;
+	state->out_flags = NULL;
+	state->flag_count = 0;
+	state->half_byte = NULL;
+	state->out_avail = 0;
+
+	return MSCOMP_OK;
+}
 ENTRY_POINT MSCompStatus xpress_deflate(mscomp_stream* stream, MSCompFlush flush)
 {
 	// There will be one conceptual difference between the streaming and non-streaming versions.
@@ -237,7 +265,8 @@ MSCompStatus xpress_deflate_end(mscomp_stream* stream)
 }
 
 #ifdef MSCOMP_WITH_OPT_COMPRESS
-ENTRY_POINT MSCompStatus xpress_compress(const_bytes in, size_t in_len, bytes out, size_t* _out_len)
+template<class Dict>
+FORCE_INLINE static MSCompStatus xpress_compress_all(const_bytes in, size_t in_len, bytes out, size_t* _out_len, Dict* d)
 {
 	const size_t out_len = *_out_len;
 	const const_bytes                  in_end  = in +in_len,  in_end2  = in_end  - 2;
@@ -247,8 +276,8 @@ ENTRY_POINT MSCompStatus xpress_compress(const_bytes in, size_t in_len, bytes ou
 	uint32_t flags = 0, *out_flags = (uint32_t*)out;
 	byte flag_count;
 	byte* half_byte = NULL;
-	
-	Dictionary d(in, in_end);
+	Acceleration accel;
+	PHASE_SCOPE(MSCOMP_PHASE_FIND);
 
 	if (in_len == 0)
 	{
@@ -261,16 +290,24 @@ ENTRY_POINT MSCompStatus xpress_compress(const_bytes in, size_t in_len, bytes ou
 
 	out += 4;		// skip four for flags
 	*out++ = *in++;	// copy the first byte
+	STATS_ADD(literals, 1);
 	flag_count = 1;
 
 	while (in < in_end2 && out < out_end1)
 	{
 		uint32_t len, off;
-		if (filled_to <= in) { filled_to = d.Fill(filled_to); }
+		if (filled_to <= in)
+		{
+			PHASE_SCOPE(MSCOMP_PHASE_FILL);
+			const const_bytes fill = filled_to;
+			filled_to = d->Fill(filled_to);
+			CHECKSUM(fill, filled_to - fill);
+		}
 		flags <<= 1;
-		if ((len = d.Find(in, &off)) < 3) { *out++ = *in++; } // Copy byte
+		if (accel.Skip() || !accel.Found((len = d->Find(in, &off)) >= 3)) { *out++ = *in++; STATS_ADD(literals, 1); } // Copy byte
 		else // Match found
 		{
+			STATS_ADD(matches, 1);
 			in += len;
 			len -= 3;
 			SET_UINT16(out, ((off-1) << 3) | MIN(len, 7));
@@ -326,6 +363,7 @@ ENTRY_POINT MSCompStatus xpress_compress(const_bytes in, size_t in_len, bytes ou
 	while (in < in_end && out < out_end)
 	{
 		*out++ = *in++;
+		STATS_ADD(literals, 1);
 		flags <<= 1;
 		if (++flag_count == 32)
 		{
@@ -340,13 +378,131 @@ ENTRY_POINT MSCompStatus xpress_compress(const_bytes in, size_t in_len, bytes ou
 	// Note: the shifting math does not effect flags at all when flag_count == 0, resulting in a copy of the previous flags so the proper value must be set manually
 	// RTL produces improper output in this case as well, so the decompressor still must tolerate bad flags at the very end
 	if (UNLIKELY(in != in_end)) { PRINT_ERROR("Xpress Compression Error: Insufficient buffer"); return MSCOMP_BUF_ERROR; }
+	CHECKSUM(filled_to, in_end - filled_to); // the last bytes are never added to the dictionary
 	flags = flag_count ? (flags << (32 - flag_count)) | ((1 << (32 - flag_count)) - 1) : 0xFFFFFFFF;
 	SET_UINT32(out_flags, flags);
 	*_out_len = out - out_start;
 	return MSCOMP_OK;
 }
+template<class Dict>
+FORCE_INLINE static MSCompStatus xpress_compress_new_dict(const_bytes in, size_t in_len, bytes out, size_t* _out_len)
+{
+#ifdef MSCOMP_WITH_SMALL_STACK
+	Dict* d = (Dict*)MS_ALLOC(&ms_global_allocator, sizeof(Dict));
+	if (UNLIKELY(d == NULL)) { return MSCOMP_MEM_ERROR; }
+	new (d) Dict(in, in + in_len);
+	const MSCompStatus status = xpress_compress_all(in, in_len, out, _out_len, d);
+	d->~Dict();
+	MS_FREE(&ms_global_allocator, d, sizeof(Dict));
+	return status;
+#else
+	Dict d(in, in + in_len);
+	return xpress_compress_all(in, in_len, out, _out_len, &d);
+#endif
+}
+ENTRY_POINT CPU_DISPATCH MSCompStatus xpress_compress(const_bytes in, size_t in_len, bytes out, size_t* _out_len)
+{
+	if (in_len <= SMALL_SIZE)  { return xpress_compress_new_dict<DictionarySmall>(in, in_len, out, _out_len); }
+	if (in_len <= MEDIUM_SIZE) { return xpress_compress_new_dict<DictionaryMedium>(in, in_len, out, _out_len); }
+	return xpress_compress_new_dict<Dictionary>(in, in_len, out, _out_len);
+}
+ENTRY_POINT CPU_DISPATCH MSCompStatus xpress_compress_ctx(mscomp_context* ctx, const_bytes in, size_t in_len, bytes out, size_t* _out_len)
+{
+	// The dictionaries are kept in the context and are reset without clearing them
+	// The same dictionary as xpress_compress is used for each input size so the output is identical
+	xpress_context* c = (xpress_context*)ctx->xpress;
+	if (UNLIKELY(c == NULL))
+	{
+		c = (xpress_context*)MS_ALLOC(&ctx->allocator, sizeof(xpress_context));
+		if (UNLIKELY(c == NULL)) { return MSCOMP_MEM_ERROR; }
+		ctx->xpress = new (c) xpress_context();
+	}
+	if (in_len <= SMALL_SIZE)
+	{
+		c->small.Reset(in, in + in_len);
+		return xpress_compress_all(in, in_len, out, _out_len, &c->small);
+	}
+	if (in_len <= MEDIUM_SIZE)
+	{
+		c->medium.Reset(in, in + in_len);
+		return xpress_compress_all(in, in_len, out, _out_len, &c->medium);
+	}
+	c->d.Reset(in, in + in_len);
+	return xpress_compress_all(in, in_len, out, _out_len, &c->d);
+}
 #else
 ALL_AT_ONCE_WRAPPER_COMPRESS(xpress)
+MSCompStatus xpress_compress_ctx(mscomp_context* /*ctx*/, const_bytes in, size_t in_len, bytes out, size_t* _out_len) { return xpress_compress(in, in_len, out, _out_len); }
+#endif
+template<class Dict>
+static size_t xpress_compressed_size_all(const_bytes in, size_t in_len, Dict* d)
+{
+	// The same parse as xpress_compress_all except that only the size of the output is counted
+	if (in_len == 0) { return 4; }
+	const const_bytes in_end = in + in_len, in_end2 = in_end - 2;
+	const_bytes filled_to = in;
+	size_t size = 5; // the first flags and the first byte
+	uint_fast8_t flag_count = 1;
+	bool half_byte = false;
+	Acceleration accel;
+	++in;
+
+	while (in < in_end2)
+	{
+		uint32_t len, off;
+		if (filled_to <= in) { filled_to = d->Fill(filled_to); }
+		if (accel.Skip() || !accel.Found((len = d->Find(in, &off)) >= 3)) { ++in; ++size; }
+		else
+		{
+			in += len;
+			len -= 3;
+			size += 2;
+			if (len >= 0x7)
+			{
+				len -= 0x7;
+				if (!half_byte) { ++size; } // the half byte is shared with the next long match
+				half_byte = !half_byte;
+				if (len >= 0xF)
+				{
+					len -= 0xF;
+					++size;
+					if (len >= 0xFF) { size += (len + 0xF + 0x7 <= 0xFFFF) ? 2 : 6; }
+				}
+			}
+		}
+		if (++flag_count == 32) { flag_count = 0; size += 4; }
+	}
+	for (; in < in_end; ++in, ++size)
+	{
+		if (++flag_count == 32) { flag_count = 0; size += 4; }
+	}
+	return size;
+}
+template<class Dict>
+FORCE_INLINE static MSCompStatus xpress_compressed_size_new_dict(const_bytes in, size_t in_len, size_t* size)
+{
+#ifdef MSCOMP_WITH_SMALL_STACK
+	Dict* d = (Dict*)MS_ALLOC(&ms_global_allocator, sizeof(Dict));
+	if (UNLIKELY(d == NULL)) { return MSCOMP_MEM_ERROR; }
+	new (d) Dict(in, in + in_len);
+	*size = xpress_compressed_size_all(in, in_len, d);
+	d->~Dict();
+	MS_FREE(&ms_global_allocator, d, sizeof(Dict));
+#else
+	Dict d(in, in + in_len);
+	*size = xpress_compressed_size_all(in, in_len, &d);
 #endif
+	return MSCOMP_OK;
+}
+ENTRY_POINT CPU_DISPATCH MSCompStatus xpress_compressed_size(const_bytes in, size_t in_len, size_t* size)
+{
+	if (in_len <= SMALL_SIZE)  { return xpress_compressed_size_new_dict<DictionarySmall>(in, in_len, size); }
+	if (in_len <= MEDIUM_SIZE) { return xpress_compressed_size_new_dict<DictionaryMedium>(in, in_len, size); }
+	return xpress_compressed_size_new_dict<Dictionary>(in, in_len, size);
+}
+void xpress_context_free(mscomp_context* ctx)
+{
+	if (ctx->xpress) { ((xpress_context*)ctx->xpress)->~xpress_context(); MS_FREE(&ctx->allocator, ctx->xpress, sizeof(xpress_context)); ctx->xpress = NULL; }
+}
 
 #endif
@@ -26,10 +26,12 @@
 typedef CircularBuffer<0x2000> Buffer;
 
 struct _mscomp_internal_state
-{ // 38-42 bytes (+padding) + buffer
+{ // 43-51 bytes (+padding) + buffer
+	size_t size; // see ALLOC_STATE
 	uint32_t flagged, flags;
 	byte half_byte;
 	bool has_half_byte;
+	bool contiguous; // the output history is kept by the caller directly before out instead of in buffer
 	byte in[10];
 	size_t in_avail;
 	Buffer buffer;
@@ -42,23 +44,41 @@ static FORCE_INLINE bool set_bits_are_highest(uint32_t x) { x = ~x; return !((x+
 
 ////////////////////////////// Decompression Functions /////////////////////////////////////////////
 
-MSCompStatus xpress_inflate_init(mscomp_stream* stream)
+static void xpress_inflate_init_state(mscomp_internal_state* state, bool contiguous)
 {
-	INIT_STREAM(stream, false, MSCOMP_XPRESS);
-
-	mscomp_internal_state* state = (mscomp_internal_state*)malloc(sizeof(mscomp_internal_state));
-	if (UNLIKELY(state == NULL)) { SET_ERROR(stream, "XPRESS Decompression Error: Unable to allocate state memory"); return MSCOMP_MEM_ERROR; }
-
 	state->flagged = 1;
 	state->flags = 0;
 	state->has_half_byte = false;
+	state->contiguous = contiguous;
 	state->in_avail  = 0;
 	state->copy_len = 0;
 	new (&state->buffer) Buffer();
+}
+MSCompStatus xpress_inflate_init(mscomp_stream* stream)
+{
+	INIT_STREAM(stream, false, MSCOMP_XPRESS);
+
+	ALLOC_STATE(stream, state, "XPRESS Decompression Error: Unable to allocate state memory");
+	xpress_inflate_init_state(state, false);
 
 	stream->state = state;
 	return MSCOMP_OK;
 }
+MSCompStatus xpress_inflate_init_contiguous(mscomp_stream* stream)
+{
+	if (UNLIKELY(stream == NULL)) { return MSCOMP_ARG_ERROR; }
+	MSCompStatus status = xpress_inflate_init(stream);
+	if (status == MSCOMP_OK) { stream->state->contiguous = true; }
+	return status;
+}
+MSCompStatus xpress_inflate_reset(mscomp_stream* stream)
+{
+	// Keeps the contiguous setting unless the stream was a different format
+	const bool contiguous = stream != NULL && stream->format == MSCOMP_XPRESS && stream->state != NULL && stream->state->contiguous;
+	RESET_STREAM(stream, false, MSCOMP_XPRESS, true);
+	xpress_inflate_init_state(stream->state, contiguous);
+	return MSCOMP_OK;
+}
 #define _READ_SYMBOL(ERROR, LABEL) \
 { /*
 	Reads a symbol from the input data.
@@ -114,30 +134,26 @@ LABEL			if (UNLIKELY(in + 2 > in_end)) { ERROR("XPRESS Decompression Error: Inva
 #define READ_SYMBOL(ERROR) _READ_SYMBOL(ERROR,)
 #define READ_SYMBOL_WITH_LABEL(ERROR, LABEL) _READ_SYMBOL(ERROR,LABEL:)
 
-#define IN_NEAR_END  0x074; // 4 + 32 * (2 + 0.5 + 1) from the end, or maybe 4 + 32 * (2 + 0.5 + 1 + 2 + 4) = 0x134
-#define OUT_NEAR_END 32*FAST_COPY_ROOM;
-#define INFLATE_FAST(ERROR, CHECKED_LENGTH, CHECKED_COPY) \
+#define IN_NEAR_END  0x094 // 4 + 31 * (2 + 0.5 + 1) + 32 from the end (the last literal run is copied with a 32-byte wild copy), the extra length bytes (2 + 4) are checked
+#define OUT_NEAR_END 32*FAST_COPY_ROOM // both must be no more than MSCOMP_DECOMPRESS_SLACK
+#define INFLATE_FAST_FRAGMENT(ERROR, CHECKED_LENGTH, CHECKED_COPY) \
 { /*
-	Fast decompression loop with many shortcuts and assumptions. Most of the decompression happens
-	here with very few bounds checks but we can only get to within a few hundred bytes of the end.
+	Decompresses an entire fragment (32 symbols) with many shortcuts and assumptions. There must be
+	at least IN_NEAR_END bytes readable after in and OUT_NEAR_END bytes writable after out.
 
 	This can only be started at the beginning of a fragment/chunk (about to read the flags) and the
 	output (from out_start to out) must contain enough bytes for the look-back (up to 0x2000).
 
 	Arguments:
-		ERROR          A macro that takes a single argument: an error string
+		ERROR          A macro that takes a single argument: an error string, it must return or jump
 		CHECKED_LENGTH Code to execute when we are leaving fast mode in the middle of getting a length
 		CHECKED_COPY   Code to execute when we are leaving fast mode in the middle of a block copy
 
-	The code after the macro will execute when we are leaving fast mode at the end of a fragment.
-
 	This makes use of the following local variables:
 		in        in/out  input array of bytes, updated to the next byte to read
-		in_end    in      first invalid byte in in
-		in_endx   in      IN_NEAR_END from in_end
+		in_endx   in      IN_NEAR_END from the end of the readable input
 		out       in/out  output array of bytes, updated to the next byte to write
-		out_end   in      first invalid byte in out
-		out_endx  in      OUT_NEAR_END from out_end
+		out_endx  in      OUT_NEAR_END from the end of the writable output
 		out_start in      the start of the output bytes (may be <out if we know there is buffer data before out)
 		half_byte in      a pointer to a byte with the last half-byte length, or NULL if not available
 		flagged   out     current flag state (either 0 or non-zero)
@@ -145,55 +161,63 @@ LABEL			if (UNLIKELY(in + 2 > in_end)) { ERROR("XPRESS Decompression Error: Inva
 		off       out     last offset read from a symbol
 		len       out     last length read from a symbol, reduced if some were copied
 	*/ \
-	while (LIKELY(in < in_endx && out < out_endx)) \
+	flags = GET_UINT32(in); \
+	flagged = flags & 0x80000000; \
+	flags = (flags << 1) | 1; \
+	in += 4; \
+	do \
 	{ \
-		/* Start a fragment */ \
-		flags = GET_UINT32(in); \
-		flagged = flags & 0x80000000; \
-		flags = (flags << 1) | 1; \
-		in += 4; \
-		do \
+		if (flagged) /* Either: offset/length symbol, end of flags, or end of stream (only happens in non-fast versions) */ \
 		{ \
-			if (flagged) /* Either: offset/length symbol, end of flags, or end of stream (only happens in non-fast versions) */ \
+			/* Offset/length symbol */ \
+			const uint16_t sym = GET_UINT16(in); in += 2; \
+			off = (sym >> 3) + 1; \
+			if ((len = sym & 0x7) == 0x7) \
 			{ \
-				/* Offset/length symbol */ \
-				const uint16_t sym = GET_UINT16(in); in += 2; \
-				off = (sym >> 3) + 1; \
-				if ((len = sym & 0x7) == 0x7) \
+				if (half_byte) { len = *half_byte >> 4; half_byte = NULL; } \
+				else           { len = *(half_byte = in++) & 0xF; } \
+				if (len == 0xF) \
 				{ \
-					if (half_byte) { len = *half_byte >> 4; half_byte = NULL; } \
-					else           { len = *(half_byte = in++) & 0xF; } \
-					if (len == 0xF) \
+					if ((len = *(in++)) == 0xFF) \
 					{ \
-						if ((len = *(in++)) == 0xFF) \
-						{ \
-							if (UNLIKELY(in + 6 > in_endx)) { CHECKED_LENGTH; } \
-							len = GET_UINT16(in); in += 2; \
-							if (UNLIKELY(len == 0)) { len = GET_UINT32(in); in += 4; } \
-							if (UNLIKELY(len < 0xF+0x7)) { ERROR("XPRESS Decompression Error: Invalid data: Invalid length"); return MSCOMP_DATA_ERROR; } \
-							len -= 0xF+0x7; \
-						} \
-						len += 0xF; \
+						if (UNLIKELY(in + 6 > in_endx)) { CHECKED_LENGTH; } \
+						len = GET_UINT16(in); in += 2; \
+						if (UNLIKELY(len == 0)) { len = GET_UINT32(in); in += 4; } \
+						if (UNLIKELY(len < 0xF+0x7)) { ERROR("XPRESS Decompression Error: Invalid data: Invalid length"); } \
+						len -= 0xF+0x7; \
 					} \
-					len += 0x7; \
+					len += 0xF; \
 				} \
-				len += 0x3; \
-				const_bytes o = out-off; \
-				if (UNLIKELY(o < out_start)) { ERROR("XPRESS Decompression Error: Invalid data: Invalid offset"); return MSCOMP_DATA_ERROR; } \
-				FAST_COPY(out, o, len, off, out_endx, CHECKED_COPY); \
-				flagged = flags & 0x80000000; \
-				flags <<= 1; \
-			} \
-			else /* Copy up to 32 bytes directly */ \
-			{ \
-				int n = count_leading_zeros(flags) + 1; \
-				ALWAYS(0 < n && n <= 32); \
-				flagged = 1; \
-				flags = (uint32_t)(((uint64_t)flags) << n); \
-				COPY_128_FAST(out, in); if (n > 16) { COPY_128_FAST(out+16, in+16); } \
-				out += n; in += n; \
+				len += 0x7; \
 			} \
-		} while (LIKELY(flags)); \
+			len += 0x3; \
+			const_bytes o = out-off; \
+			if (UNLIKELY(o < out_start)) { ERROR("XPRESS Decompression Error: Invalid data: Invalid offset"); } \
+			FAST_COPY(out, o, len, off, out_endx, CHECKED_COPY); \
+			flagged = flags & 0x80000000; \
+			flags <<= 1; \
+		} \
+		else /* Copy the entire run of literals (up to 32 bytes) with a single wild copy */ \
+		{ \
+			int n = count_leading_zeros(flags) + 1; \
+			ALWAYS(0 < n && n <= 32); \
+			flagged = 1; \
+			flags = (uint32_t)(((uint64_t)flags) << n); \
+			COPY_256_FAST(out, in); \
+			out += n; in += n; \
+		} \
+	} while (LIKELY(flags)); \
+}
+#define INFLATE_FAST(ERROR, CHECKED_LENGTH, CHECKED_COPY) \
+{ /*
+	Fast decompression loop. Most of the decompression happens here with very few bounds checks but
+	we can only get to within a few hundred bytes of the end. See INFLATE_FAST_FRAGMENT for details.
+
+	The code after the macro will execute when we are leaving fast mode at the end of a fragment.
+	*/ \
+	while (LIKELY(in < in_endx && out < out_endx)) \
+	{ \
+		INFLATE_FAST_FRAGMENT(ERROR, CHECKED_LENGTH, CHECKED_COPY); \
 	} \
 }
 
@@ -213,6 +237,8 @@ LABEL			if (UNLIKELY(in + 2 > in_end)) { ERROR("XPRESS Decompression Error: Inva
 	stream->in_total  += in_len;  stream->in_avail -= in_len; stream->in  = in; \
 	stream->out_total += out_len; stream->out_avail = 0;      stream->out = out_end
 #define SET_STREAM_ERROR(MSG) SET_ERROR(stream, MSG)
+#define RETURN_STREAM_ERROR(MSG) { SET_STREAM_ERROR(MSG); return MSCOMP_DATA_ERROR; }
+#define RETURN_DATA_ERROR(MSG) return MSCOMP_DATA_ERROR
 #define READ_SYMBOL_PART_ERROR(MSG, NOT_ENOUGH_BYTES, BYTES_ADVANCED, ...) \
 	WARNINGS_PUSH() \
 	WARNINGS_IGNORE_CONDITIONAL_EXPR_CONSTANT() \
@@ -242,27 +268,42 @@ LABEL			if (UNLIKELY(in + 2 > in_end)) { ERROR("XPRESS Decompression Error: Inva
 	SET_STREAM_ERROR(MSG);
 #define DO_NOTHING(...)
 
+// Copies len bytes from off bytes before out to out, the source and destination may overlap
+static FORCE_INLINE void copy_from_history(bytes out, const uint_fast16_t off, const size_t len)
+{
+	if (off == 1) { memset(out, out[-1], len); }
+	else if (off >= len) { memcpy(out, out-off, len); }
+	else { for (const_bytes end = out + len; out < end; ++out) { *out = *(out-off); } }
+}
+
+// When the output is contiguous all of the look-back data is in the output itself and the buffer is
+// never used, otherwise everything that is output must also be added to the buffer
+#define HISTORY_SIZE()            (Contiguous ? (uint32_t)MIN(stream->out_total, (size_t)0x2000) : buf->size())
+#define HISTORY_COPY(off, len, x) if (Contiguous) { copy_from_history(x, off, len); } else { buf->copy(off, len, x); }
+#define HISTORY_PUSH_BACK(x, n)   if (!Contiguous) { buf->push_back(x, n); }
+
 WARNINGS_PUSH()
 WARNINGS_IGNORE_POTENTIAL_UNINIT_VALRIABLE_USED()
-ENTRY_POINT MSCompStatus xpress_inflate(mscomp_stream* stream)
+template<bool Contiguous>
+static FORCE_INLINE MSCompStatus xpress_inflate_t(mscomp_stream* stream)
 {
-	CHECK_STREAM_PLUS(stream, false, MSCOMP_XPRESS, stream->state == NULL);
-
 	mscomp_internal_state *state = stream->state;
 	Buffer* const buf = &state->buffer;
-	const bytes out_start = stream->out;
+	PHASE_SCOPE(MSCOMP_PHASE_DECODE);
+	// The first byte that can be looked back to in the output
+	const const_bytes out_start = stream->out - (Contiguous ? HISTORY_SIZE() : 0);
 
 	// Copy data from the buffer to the output
 	if (state->copy_len)
 	{
 		if (state->copy_len > stream->out_avail)
 		{
-			buf->copy(state->copy_off, stream->out_avail, out_start);
-			ADVANCE_OUT_TO_END(stream);
+			HISTORY_COPY(state->copy_off, stream->out_avail, stream->out);
 			state->copy_len -= (uint32_t)stream->out_avail;
+			ADVANCE_OUT_TO_END(stream);
 			return MSCOMP_OK;
 		}
-		buf->copy(state->copy_off, state->copy_len, out_start);
+		HISTORY_COPY(state->copy_off, state->copy_len, stream->out);
 		ADVANCE_OUT(stream, state->copy_len);
 		state->copy_len = 0;
 		state->flagged = state->flags & 0x80000000;
@@ -332,14 +373,14 @@ ENTRY_POINT MSCompStatus xpress_inflate(mscomp_stream* stream)
 	}
 	while (LIKELY(in + 4 <= in_end))
 	{
-		if (out-buf->size() >= out_start && in < in_endx && out < out_endx)
+		if ((Contiguous || out-buf->size() >= out_start) && in < in_endx && out < out_endx)
 		{
 			// Switch to fast decompression mode
 			const const_bytes out_fast_start = out;
-			INFLATE_FAST(SET_STREAM_ERROR,
-				buf->push_back(out_fast_start, out-out_fast_start); goto CHECKED_LENGTH,
-				buf->push_back(out_fast_start, out-out_fast_start); goto COPY_DATA);
-			buf->push_back(out_fast_start, out-out_fast_start); continue;
+			INFLATE_FAST(RETURN_STREAM_ERROR,
+				HISTORY_PUSH_BACK(out_fast_start, out-out_fast_start); STATS_ADD(fast_bytes, out-out_fast_start); goto CHECKED_LENGTH,
+				HISTORY_PUSH_BACK(out_fast_start, out-out_fast_start); STATS_ADD(fast_bytes, out-out_fast_start); goto COPY_DATA);
+			HISTORY_PUSH_BACK(out_fast_start, out-out_fast_start); STATS_ADD(fast_bytes, out-out_fast_start); continue;
 		}
 
 		// Start a fragment
@@ -354,37 +395,53 @@ MAIN_LOOP:
 			{
 				READ_SYMBOL_WITH_LABEL(READ_SYMBOL_ERROR, CHECKED_LENGTH);
 COPY_DATA:
-				if (UNLIKELY(buf->size() < off)) { SET_ERROR(stream, "XPRESS Decompression Error: Invalid data: Illegal offset"); return MSCOMP_DATA_ERROR; }
+				if (UNLIKELY(Contiguous ? out - off < out_start : buf->size() < off)) { SET_ERROR(stream, "XPRESS Decompression Error: Invalid data: Illegal offset"); return MSCOMP_DATA_ERROR; }
 				size_t out_rem = out_end-out;
 				if (len > out_rem)
 				{
-					buf->copy(off, out_rem, out);
+					HISTORY_COPY(off, out_rem, out);
 					// We have written all the we can for now, save state and quit
 					state->copy_len = (uint32_t)(len - out_rem);
 					state->copy_off = off;
 					WROTE_ALL_OUT();
 					return MSCOMP_OK;
 				}
-				buf->copy(off, len, out);
+				HISTORY_COPY(off, len, out);
 				out += len;
 			}
 			else
 			{
 COPY_BYTE:
 				if (out == out_end) { WROTE_ALL_OUT(); return MSCOMP_OK; } // We have written all the we can for now, save state and quit
-				else { buf->push_back(*out++ = *in++); } // Copy byte directly
+				else if (Contiguous) { *out++ = *in++; } // Copy byte directly
+				else { buf->push_back(*out++ = *in++); }
 			}
 			flagged = flags & 0x80000000;
 			flags <<= 1;
 		} while (LIKELY(flags));
 	}
+	INFLATE_SYNC_STATE(); // must be before the memcpy since half_byte may point into state->in
 	state->in_avail = in_end - in;
 	ALWAYS(state->in_avail <= 3);
 	memcpy(state->in, in, state->in_avail); // at most 3 bytes
-	READ_ALL_IN();
+	READ_ALL_IN_NO_SYNC();
 	return MSCOMP_OK;
 }
 WARNINGS_POP()
+ENTRY_POINT CPU_DISPATCH MSCompStatus xpress_inflate(mscomp_stream* stream)
+{
+	CHECK_STREAM_PLUS(stream, false, MSCOMP_XPRESS, stream->state == NULL);
+#ifdef MSCOMP_WITH_STATS
+	// The fast loop counts its own output, everything else written during this call was slow
+	const size_t out_total = stream->out_total;
+	const uint64_t fast_bytes = ms_stats.fast_bytes;
+	const MSCompStatus status = stream->state->contiguous ? xpress_inflate_t<true>(stream) : xpress_inflate_t<false>(stream);
+	if (status >= 0) { STATS_ADD(slow_bytes, (stream->out_total - out_total) - (ms_stats.fast_bytes - fast_bytes)); }
+	return status;
+#else
+	return stream->state->contiguous ? xpress_inflate_t<true>(stream) : xpress_inflate_t<false>(stream);
+#endif
+}
 MSCompStatus xpress_inflate_end(mscomp_stream* stream)
 {
 	CHECK_STREAM_PLUS(stream, false, MSCOMP_XPRESS, stream->state == NULL);
@@ -396,20 +453,32 @@ MSCompStatus xpress_inflate_end(mscomp_stream* stream)
 
 	// Cleanup
 	state->buffer.~Buffer();
-	free(state);
+	FREE_STATE(state);
 	stream->state = NULL;
 
 	return status;
 }
 #ifdef MSCOMP_WITH_OPT_DECOMPRESS
-ENTRY_POINT MSCompStatus xpress_decompress(const_bytes in, size_t in_len, bytes out, size_t* _out_len)
+#define ROLLBACK_FRAGMENT(MSG) goto ROLLBACK
+// When decompressing in-place the output can be written up to the next unread input byte, so the
+// end of the output moves forward as input is read. The pending half-byte is also input that will
+// be read later so it is moved out of the buffer before anything is written.
+#define OUT_LIMIT() (InPlace ? in : out_end)
+#define SAVE_HALF_BYTE() if (InPlace && half_byte) { saved_half_byte = *half_byte; half_byte = &saved_half_byte; }
+template<bool Slack, bool InPlace>
+static FORCE_INLINE MSCompStatus xpress_decompress_all(const_bytes in, size_t in_len, bytes out, size_t* _out_len)
 {
+	// With slack the near-end pointers are relative to the end of the slack instead of the data
 	const size_t out_len = *_out_len;
-	const const_bytes                  in_end  = in +in_len,  in_endx  = in_end -IN_NEAR_END;
-	const const_bytes out_start = out, out_end = out+out_len, out_endx = out_end-OUT_NEAR_END;
+	const const_bytes                  in_end  = in +in_len,  in_endx  = Slack ? in_end +(MSCOMP_DECOMPRESS_SLACK-IN_NEAR_END)  : in_end -IN_NEAR_END;
+	const const_bytes out_start = out, out_end = out+out_len;
+	const_bytes out_endx = Slack ? out_end+(MSCOMP_DECOMPRESS_SLACK-OUT_NEAR_END) : out_end-OUT_NEAR_END;
 	const_byte* half_byte = NULL;
+	byte saved_half_byte = 0;
 	uint32_t flags, flagged, len;
 	uint_fast16_t off;
+	STATS_ONLY(size_t fast_len = 0;)
+	PHASE_SCOPE(MSCOMP_PHASE_DECODE);
 
 	if (in_len < MIN_DATA)
 	{
@@ -417,9 +486,45 @@ ENTRY_POINT MSCompStatus xpress_decompress(const_bytes in, size_t in_len, bytes
 		return MSCOMP_DATA_ERROR;
 	}
 
-	INFLATE_FAST(DO_NOTHING, goto CHECKED_LENGTH,
-		if (UNLIKELY(out + len > out_end)) { return MSCOMP_BUF_ERROR; }
-		goto CHECKED_COPY);
+	if (Slack)
+	{
+		// Decompress entire fragments all the way to the end of the data, any fragment that goes past
+		// the end (into the slack) or has a problem is undone and redone in the slower loop below
+		const_bytes in_frag = in, half_byte_frag = half_byte;
+		bytes out_frag = out;
+		while (LIKELY(in < in_end && out < out_end))
+		{
+			in_frag = in; out_frag = out; half_byte_frag = half_byte;
+			INFLATE_FAST_FRAGMENT(ROLLBACK_FRAGMENT, goto ROLLBACK, goto ROLLBACK);
+			if (UNLIKELY(in > in_end || out > out_end))
+			{
+ROLLBACK:		in = in_frag; out = out_frag; half_byte = half_byte_frag;
+				break;
+			}
+		}
+	}
+	else if (InPlace)
+	{
+		// Each fragment can only write up to where the input was when it started
+		while (LIKELY(in < in_endx && (size_t)(in - out) > OUT_NEAR_END))
+		{
+			SAVE_HALF_BYTE();
+			out_endx = in - OUT_NEAR_END;
+			INFLATE_FAST_FRAGMENT(RETURN_DATA_ERROR, STATS_ONLY(fast_len = out - out_start;) goto CHECKED_LENGTH,
+				if (UNLIKELY(out + len > in)) { return MSCOMP_BUF_ERROR; }
+				SAVE_HALF_BYTE();
+				STATS_ONLY(fast_len = out - out_start;)
+				goto CHECKED_COPY);
+		}
+	}
+	else
+	{
+		INFLATE_FAST(RETURN_DATA_ERROR, STATS_ONLY(fast_len = out - out_start;) goto CHECKED_LENGTH,
+			if (UNLIKELY(out + len > out_end)) { return MSCOMP_BUF_ERROR; }
+			STATS_ONLY(fast_len = out - out_start;)
+			goto CHECKED_COPY);
+	}
+	STATS_ONLY(fast_len = out - out_start;)
 
 	// Slower decompression but with full bounds checking
 	while (LIKELY(in + 4 <= in_end))
@@ -433,14 +538,16 @@ ENTRY_POINT MSCompStatus xpress_decompress(const_bytes in, size_t in_len, bytes
 			if (in == in_end)
 			{
 				if (UNLIKELY(!flagged || !set_bits_are_highest(flags))) { return MSCOMP_DATA_ERROR; }
+				STATS_DECOMPRESSED(out - out_start, fast_len);
 				*_out_len = out - out_start;
 				return MSCOMP_OK;
 			}
 			else if (flagged) // Either: offset/length symbol, end of flags, or end of stream (checked above)
 			{
 				READ_SYMBOL_WITH_LABEL(DO_NOTHING, CHECKED_LENGTH);
-				if (UNLIKELY(out - off < out_start)) { return MSCOMP_DATA_ERROR; }
-				if (UNLIKELY(out + len > out_end))   { return MSCOMP_BUF_ERROR; }
+				if (UNLIKELY(out - off < out_start))  { return MSCOMP_DATA_ERROR; }
+				if (UNLIKELY(out + len > OUT_LIMIT())) { return MSCOMP_BUF_ERROR; }
+				SAVE_HALF_BYTE();
 				if (off == 1)
 				{
 					memset(out, out[-1], len);
@@ -452,16 +559,111 @@ ENTRY_POINT MSCompStatus xpress_decompress(const_bytes in, size_t in_len, bytes
 CHECKED_COPY:		for (end = out + len; out < end; ++out) { *out = *(out-off); }
 				}
 			}
-			else if (UNLIKELY(out == out_end)) { return MSCOMP_BUF_ERROR; }
-			else { *out++ = *in++; } // Copy byte directly
+			else
+			{
+				// Copy the entire run of literals directly (or as much as is available)
+				size_t n = MIN((size_t)count_leading_zeros(flags) + 1, (size_t)(in_end - in));
+				if (UNLIKELY(out + n > out_end)) { return MSCOMP_BUF_ERROR; }
+				SAVE_HALF_BYTE();
+				if (InPlace) { memmove(out, in, n); } else { memcpy(out, in, n); }
+				out += n; in += n;
+				flags <<= n-1;
+			}
 			flagged = flags & 0x80000000;
 			flags <<= 1;
 		} while (LIKELY(flags));
 	}
 	return MSCOMP_DATA_ERROR;
 }
+ENTRY_POINT CPU_DISPATCH MSCompStatus xpress_decompress(const_bytes in, size_t in_len, bytes out, size_t* _out_len)
+{
+	return xpress_decompress_all<false, false>(in, in_len, out, _out_len);
+}
+ENTRY_POINT CPU_DISPATCH MSCompStatus xpress_decompress_slack(const_bytes in, size_t in_len, bytes out, size_t* _out_len)
+{
+	return xpress_decompress_all<true, false>(in, in_len, out, _out_len);
+}
+ENTRY_POINT CPU_DISPATCH MSCompStatus xpress_decompress_inplace(bytes buf, size_t in_len, size_t* _out_len)
+{
+	if (UNLIKELY(in_len > *_out_len)) { return MSCOMP_ARG_ERROR; }
+	return xpress_decompress_all<false, true>(buf + *_out_len - in_len, in_len, buf, _out_len);
+}
 #else
 ALL_AT_ONCE_WRAPPER_DECOMPRESS(xpress)
+MSCompStatus xpress_decompress_slack(const_bytes in, size_t in_len, bytes out, size_t* _out_len) { return xpress_decompress(in, in_len, out, _out_len); }
+ENTRY_POINT MSCompStatus xpress_decompress_inplace(bytes buf, size_t in_len, size_t* _out_len)
+{
+	// The stream functions never write past out_avail so the output is limited to the gap before the
+	// unread input each call
+	if (UNLIKELY(in_len > *_out_len)) { return MSCOMP_ARG_ERROR; }
+	mscomp_stream strm;
+	MSCompStatus status = xpress_inflate_init(&strm);
+	if (UNLIKELY(status != MSCOMP_OK)) { return status; }
+	strm.in = buf + *_out_len - in_len;
+	strm.in_avail = in_len;
+	strm.out = buf;
+	do
+	{
+		const size_t in_total = strm.in_total, out_total = strm.out_total;
+		strm.out_avail = strm.in - strm.out;
+		status = xpress_inflate(&strm);
+		if (UNLIKELY(status >= MSCOMP_OK && in_total == strm.in_total && out_total == strm.out_total)) { status = MSCOMP_BUF_ERROR; }
+	} while (status >= MSCOMP_OK && status != MSCOMP_STREAM_END && (strm.in_avail || strm.out_avail == 0));
+	if (UNLIKELY(status < 0)) { xpress_inflate_end(&strm); }
+	else if (LIKELY((status = xpress_inflate_end(&strm)) == MSCOMP_OK)) { *_out_len = strm.out_total; }
+	return status;
+}
 #endif
+size_t xpress_inplace_margin(size_t in_len) { return in_len / 8 + 8; } // literal runs need 4 bytes of flags for every 32 bytes
+
+// Validation follows the fully bounds-checked loop of xpress_decompress_all but only counts the
+// output bytes instead of copying them
+ENTRY_POINT MSCompStatus xpress_validate(const_bytes in, size_t in_len, size_t* _out_len)
+{
+	const const_bytes in_end = in + in_len;
+	const_byte* half_byte = NULL;
+	uint32_t flags, flagged, len;
+	uint_fast16_t off;
+	size_t out = 0;
+
+	if (in_len < MIN_DATA)
+	{
+		if (LIKELY(in_len == 0 || (in_len == 4 && GET_UINT32(in) != 0xFFFFFFFF))) { *_out_len = 0; return MSCOMP_OK; }
+		return MSCOMP_DATA_ERROR;
+	}
+
+	while (LIKELY(in + 4 <= in_end))
+	{
+		// Start a fragment
+		flagged = (flags = GET_UINT32(in)) & 0x80000000;
+		flags = (flags << 1) | 1;
+		in += 4;
+		do
+		{
+			if (in == in_end)
+			{
+				if (UNLIKELY(!flagged || !set_bits_are_highest(flags))) { return MSCOMP_DATA_ERROR; }
+				*_out_len = out;
+				return MSCOMP_OK;
+			}
+			else if (flagged) // Either: offset/length symbol, end of flags, or end of stream (checked above)
+			{
+				READ_SYMBOL(DO_NOTHING);
+				if (UNLIKELY(off > out)) { return MSCOMP_DATA_ERROR; }
+				out += len;
+			}
+			else
+			{
+				// Skip the entire run of literals (or as much as is available)
+				size_t n = MIN((size_t)count_leading_zeros(flags) + 1, (size_t)(in_end - in));
+				out += n; in += n;
+				flags <<= n-1;
+			}
+			flagged = flags & 0x80000000;
+			flags <<= 1;
+		} while (LIKELY(flags));
+	}
+	return MSCOMP_DATA_ERROR;
+}
 
 #endif
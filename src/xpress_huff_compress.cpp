@@ -41,24 +41,36 @@
 #define MIN_DATA		HALF_SYMBOLS + 4 // the 512 Huffman lens + 2 uint16s for minimal bitstream
 
 typedef XpressDictionary<MAX_OFFSET, CHUNK_SIZE> Dictionary;
+
+// Small inputs use dictionaries with fewer hash bits, a window sized to the input, and 16-bit
+// positions so that the time to set them up scales with the size of the input
+#define SMALL_SIZE		0x400
+#define MEDIUM_SIZE		0x2000
+typedef XpressDictionary<SMALL_SIZE,  SMALL_SIZE,  11, 3, uint16_t> DictionarySmall;
+typedef XpressDictionary<MEDIUM_SIZE, MEDIUM_SIZE, 14, 3, uint16_t> DictionaryMedium;
 typedef HuffmanEncoder<HUFF_BITS_MAX, SYMBOLS> Encoder;
 
-size_t xpress_huff_max_compressed_size(size_t in_len) { return in_len + 4 + (HALF_SYMBOLS + 2) + (HALF_SYMBOLS + 2) * (in_len / CHUNK_SIZE); }
+// The last chunk has 257 symbols when nothing matches so one literal needs a 9-bit code (at most 1 in 2048 extra bytes)
+#define LAST_CHUNK_MAX(n) ((n) + (n) / 2048 + 6)
+size_t xpress_huff_max_compressed_size(size_t in_len) { return in_len + 4 + (HALF_SYMBOLS + 2) + (HALF_SYMBOLS + 2) * (in_len / CHUNK_SIZE) + MIN(in_len, CHUNK_SIZE) / 2048; }
 
 
 ////////////////////////////// Compression Functions ///////////////////////////////////////////////
 WARNINGS_PUSH()
 WARNINGS_IGNORE_POTENTIAL_UNINIT_VALRIABLE_USED()
-static size_t xh_compress_lz77(const_bytes in, int32_t /* * */ in_len, const_bytes in_end, bytes out, uint32_t symbol_counts[SYMBOLS], Dictionary* d)
+template<class Dict>
+FORCE_INLINE static size_t xh_compress_lz77_all(const_bytes in, int32_t /* * */ in_len, const_bytes in_end, bytes out, uint32_t symbol_counts[SYMBOLS], Dict* d)
 {
 	int32_t rem = /* * */ in_len;
 	uint32_t mask;
 	const const_bytes in_orig = in, out_orig = out;
-	uint32_t* mask_out;
+	uint32_t* mask_out = NULL;
 	byte i;
 
-	d->Fill(in);
+	{ PHASE_SCOPE(MSCOMP_PHASE_FILL); d->Fill(in); }
+	PHASE_SCOPE(MSCOMP_PHASE_FIND);
 	memset(symbol_counts, 0, SYMBOLS*sizeof(uint32_t));
+	Acceleration accel;
 
 	////////// Count the symbols and write the initial LZ77 compressed data //////////
 	// A uint32 mask holds the status of each subsequent byte (0 for literal, 1 for match)
@@ -87,11 +99,12 @@ static size_t xh_compress_lz77(const_bytes in, int32_t /* * */ in_len, const_byt
 			uint32_t len, off;
 			mask >>= 1;
 			//d->Add(in);
-			if (rem >= 3 && (len = d->Find(in, &off)) >= 3)
+			if (rem >= 3 && !accel.Skip() && accel.Found((len = d->Find(in, &off, rem)) >= 3))
 			{
 				// TODO: allow len > rem (chunk-spanning matches)
-				if (len > rem) { len = rem; }
+				if (len > (uint32_t)rem) { len = rem; } // rem > 0 here
 				in += len; rem -= len;
+				STATS_ADD(matches, 1);
 				
 				//d->Add(in + 1, len - 1);
 
@@ -114,6 +127,7 @@ static size_t xh_compress_lz77(const_bytes in, int32_t /* * */ in_len, const_byt
 				// Write the literal value (which is the symbol)
 				++symbol_counts[*out++ = *in++];
 				--rem;
+				STATS_ADD(literals, 1);
 			}
 		}
 
@@ -147,11 +161,76 @@ static size_t xh_compress_lz77(const_bytes in, int32_t /* * */ in_len, const_byt
 	// Return the number of bytes in the output
 	return out - out_orig;
 }
+template<class Dict>
+FORCE_INLINE static size_t xh_compress_run(const_bytes in, int32_t in_len, const_bytes in_end, bool first, bytes out, uint32_t symbol_counts[SYMBOLS], Dict* d)
+{
+	// Same as xh_compress_lz77_all for a chunk that is a single repeated byte which is either at the
+	// start of the data or continues the run from the previous chunk. Find would always choose the
+	// previous byte with the longest possible length so the chunk is at most a literal, one
+	// match, and a literal. Only the end of the run is added to the dictionary.
+	const bool is_end = in + in_len == in_end;
+	const const_bytes out_orig = out;
+	const byte c = *in;
+	uint32_t mask = 0, i = 0;
+	{ PHASE_SCOPE(MSCOMP_PHASE_FILL); d->FillRun(in); }
+	PHASE_SCOPE(MSCOMP_PHASE_FIND);
+	memset(symbol_counts, 0, SYMBOLS*sizeof(uint32_t));
+	STATS_ADD(run_chunks, 1);
+
+	bytes mask_out = out;
+	out += 4;
+	if (first) { *out++ = c; ++symbol_counts[c]; ++i; --in_len; STATS_ADD(literals, 1); }
+	// Matches never reach the very end of the data
+	const uint32_t len = (uint32_t)(is_end ? in_len - 1 : in_len);
+	if (in_len >= 3 && len >= 3)
+	{
+		const uint32_t len3 = len - 3;
+		const byte sym = (byte)MIN(0xF, len3); // offset 1 has no offset bits
+		++symbol_counts[0x100 | sym];
+		*out = sym; SET_UINT16_RAW(out+1, 0); out += 3;
+		if (len3 >= 0xFF + 0xF) { *out = 0xFF; SET_UINT16_RAW(out+1, len3); out += 3; }
+		else if (len3 >= 0xF)   { *out++ = (byte)(len3 - 0xF); }
+		mask |= 1 << i++;
+		in_len -= len;
+		STATS_ADD(matches, 1);
+	}
+	for (; in_len; --in_len, ++i) { *out++ = c; ++symbol_counts[c]; STATS_ADD(literals, 1); }
+	if (is_end)
+	{
+		mask |= 1 << i;
+		SET_UINT32_RAW(out, 0);
+		out += 3;
+		++symbol_counts[STREAM_END];
+	}
+	SET_UINT32_RAW(mask_out, mask);
+	return out - out_orig;
+}
+CPU_DISPATCH static size_t xh_compress_lz77(const_bytes in, int32_t in_len, const_bytes in_end, bytes out, uint32_t symbol_counts[SYMBOLS], Dictionary* d)
+{
+	return xh_compress_lz77_all(in, in_len, in_end, out, symbol_counts, d);
+}
+CPU_DISPATCH static size_t xh_compress_lz77(const_bytes in, int32_t in_len, const_bytes in_end, bytes out, uint32_t symbol_counts[SYMBOLS], DictionaryMedium* d)
+{
+	return xh_compress_lz77_all(in, in_len, in_end, out, symbol_counts, d);
+}
+CPU_DISPATCH static size_t xh_compress_lz77(const_bytes in, int32_t in_len, const_bytes in_end, bytes out, uint32_t symbol_counts[SYMBOLS], DictionarySmall* d)
+{
+	return xh_compress_lz77_all(in, in_len, in_end, out, symbol_counts, d);
+}
 WARNINGS_POP()
+template<class Dict>
+FORCE_INLINE static size_t xh_compress_chunk(const_bytes in, int32_t in_len, const_bytes in_start, const_bytes in_end, bytes out, uint32_t symbol_counts[SYMBOLS], Dict* d)
+{
+	const bool first = in == in_start;
+	if ((first || in[-1] == *in) && is_run(in, in_len)) { return xh_compress_run(in, in_len, in_end, first, out, symbol_counts, d); }
+	return xh_compress_lz77(in, in_len, in_end, out, symbol_counts, d);
+}
 static uint32_t xh_compress_no_matching(const_bytes in, int32_t in_len, bool is_end, bytes out, uint32_t symbol_counts[SYMBOLS])
 {
 	const const_bytes in_end = in + in_len, in_endx = in_end - 32;
 	const const_bytes out_orig = out;
+	STATS_ADD(no_matching, 1);
+	PHASE_SCOPE(MSCOMP_PHASE_FIND);
 	memset(symbol_counts, 0, SYMBOLS*sizeof(uint32_t));
 	while (in < in_endx)
 	{
@@ -188,10 +267,11 @@ static size_t xh_calc_compressed_len_no_matching(const const_byte lens[SYMBOLS],
 	for (uint_fast16_t i = 0; i <= 0x100; ++i) { sym_bits += lens[i] * symbol_counts[i]; }
 	return (sym_bits+15)/16*2;
 }
-static void xh_compress_encode(const_bytes in, const const_bytes in_end, bytes out, Encoder *encoder)
+CPU_DISPATCH static void xh_compress_encode(const_bytes in, const const_bytes in_end, bytes out, Encoder *encoder)
 {
 	// Write the encoded compressed data
 	// This involves parsing the LZ77 compressed data and re-writing it with the Huffman codes
+	PHASE_SCOPE(MSCOMP_PHASE_ENCODE);
 	OutputBitstream bstr(out);
 	while (in < in_end)
 	{
@@ -240,90 +320,200 @@ static void xh_compress_encode(const_bytes in, const const_bytes in_end, bytes o
 	bstr.Finish(); // make sure that the write stream is finished writing
 }
 
-ENTRY_POINT MSCompStatus xpress_huff_compress(const_bytes in, size_t in_len, bytes out, size_t* _out_len)
-{
-	if (in_len == 0) { *_out_len = 0; return MSCOMP_OK; }
+// for every 32 bytes in "in" we need up to 36 bytes in the temp buffer + maybe an extra uint32 length symbol + up to 7 for the EOS (+1 for alignment)
+#define BUF_SIZE(in_len)	(((in_len) >= CHUNK_SIZE) ? 0x1200C : (((in_len) + 31) / 32 * 36 + 4 + 8))
 
-	bytes buf = (bytes)malloc((in_len >= CHUNK_SIZE) ? 0x1200C : ((in_len + 31) / 32 * 36 + 4 + 8)); // for every 32 bytes in "in" we need up to 36 bytes in the temp buffer + maybe an extra uint32 length symbol + up to 7 for the EOS (+1 for alignment)
-	if (buf == NULL) { return MSCOMP_MEM_ERROR; }
-	
-	const bytes out_orig = out;
-	const const_bytes in_end = in+in_len;
-	size_t out_len = *_out_len;
-	Dictionary d(in, in_end);
+struct xpress_huff_context
+{
+	Dictionary d;
+	DictionaryMedium medium;
+	DictionarySmall small;
 	Encoder encoder;
+	byte buf[BUF_SIZE(CHUNK_SIZE)];
+};
+
+// When out is NULL nothing is written and only the compressed size is calculated
+template<class Dict>
+static MSCompStatus xpress_huff_compress_all(const_bytes in, size_t in_len, bytes out, size_t* _out_len, Dict* d, Encoder* encoder, bytes buf)
+{
+	const const_bytes in_start = in, in_end = in+in_len;
+	size_t out_len = *_out_len, total = 0;
 	uint32_t symbol_counts[SYMBOLS]; // 4*512 = 2 kb
 
 	// Go through each chunk except the last
 	while (in_len > CHUNK_SIZE)
 	{
+		TRACE_CHUNK_START(MSCOMP_XPRESS_HUFF, true);
+
 		////////// Perform the initial LZ77 compression //////////
-		size_t buf_len = xh_compress_lz77(in, CHUNK_SIZE, in_end, buf, symbol_counts, &d);
+		const bool matching = !few_matches(in, CHUNK_SIZE);
+		CHECKSUM(in, CHUNK_SIZE);
+		size_t buf_len = 0, comp_len = 0;
+		const_bytes lens = NULL;
+		if (LIKELY(matching))
+		{
+			buf_len = xh_compress_chunk(in, CHUNK_SIZE, in_start, in_end, buf, symbol_counts, d);
 
-		////////// Create the Huffman codes/lens and Calculate the compressed output size //////////
-		const_bytes lens = encoder.CreateCodes(symbol_counts);
-		size_t comp_len = xh_calc_compressed_len(lens, symbol_counts, buf_len);
+			////////// Create the Huffman codes/lens and Calculate the compressed output size //////////
+			lens = encoder->CreateCodes(symbol_counts);
+			comp_len = xh_calc_compressed_len(lens, symbol_counts, buf_len);
+		}
 		
 		////////// Guarantee Max Compression Size //////////
 		// This is required to guarantee max compressed size
 		// It is very rare that it is used (mainly medium-high uncompressible data)
-		if (UNLIKELY(comp_len > CHUNK_SIZE+2)) // + 2 for alignment
+		// Incompressible data skips right to it
+		if (UNLIKELY(!matching || comp_len > CHUNK_SIZE+2)) // + 2 for alignment
 		{
 			buf_len = xh_compress_no_matching(in, CHUNK_SIZE, false, buf, symbol_counts);
-			lens = encoder.CreateCodesSlow(symbol_counts);
+			lens = encoder->CreateCodesSlow(symbol_counts);
 			comp_len = xh_calc_compressed_len_no_matching(lens, symbol_counts);
 			assert(comp_len <= CHUNK_SIZE+2);
 		}
 
 		////////// Output Huffman prefix codes as lengths and Encode compressed data //////////
-		if (out_len < HALF_SYMBOLS + comp_len) { PRINT_ERROR("Xpress Huffman Compression Error: Insufficient buffer\n"); free(buf); return MSCOMP_BUF_ERROR; }
-		for (const const_bytes end = lens + SYMBOLS; lens < end; lens += 2) { *out++ = lens[0] | (lens[1] << 4); }
-		xh_compress_encode(buf, buf+buf_len, out, &encoder);
+		if (out_len < HALF_SYMBOLS + comp_len) { PRINT_ERROR("Xpress Huffman Compression Error: Insufficient buffer\n"); return MSCOMP_BUF_ERROR; }
+		if (LIKELY(out != NULL))
+		{
+			for (const const_bytes end = lens + SYMBOLS; lens < end; lens += 2) { *out++ = lens[0] | (lens[1] << 4); }
+			xh_compress_encode(buf, buf+buf_len, out, encoder);
+			out += comp_len;
+		}
+		TRACE_CHUNK_DONE(MSCOMP_XPRESS_HUFF, true, false, CHUNK_SIZE, HALF_SYMBOLS + comp_len);
 		in += CHUNK_SIZE; in_len -= CHUNK_SIZE;
-		out += comp_len; out_len -= HALF_SYMBOLS + comp_len;
+		out_len -= HALF_SYMBOLS + comp_len; total += HALF_SYMBOLS + comp_len;
 	}
 
 	// Do the last chunk
 	if (in_len == 0)
 	{
-		if (UNLIKELY(out_len < MIN_DATA)) { PRINT_ERROR("Xpress Huffman Compression Error: Insufficient buffer\n"); free(buf); return MSCOMP_BUF_ERROR; }
-		memset(out, 0, MIN_DATA);
-		out[STREAM_END>>1] = STREAM_END_LEN_1;
-		out += MIN_DATA;
+		if (UNLIKELY(out_len < MIN_DATA)) { PRINT_ERROR("Xpress Huffman Compression Error: Insufficient buffer\n"); return MSCOMP_BUF_ERROR; }
+		if (LIKELY(out != NULL))
+		{
+			memset(out, 0, MIN_DATA);
+			out[STREAM_END>>1] = STREAM_END_LEN_1;
+		}
+		total += MIN_DATA;
 	}
 	else
 	{
+		TRACE_CHUNK_START(MSCOMP_XPRESS_HUFF, true);
+
 		////////// Perform the initial LZ77 compression //////////
-		size_t buf_len = xh_compress_lz77(in, (int32_t)in_len, in_end, buf, symbol_counts, &d);
+		const bool matching = !few_matches(in, in_len);
+		CHECKSUM(in, in_len);
+		size_t buf_len = 0, comp_len = 0;
+		const_bytes lens = NULL;
+		if (LIKELY(matching))
+		{
+			buf_len = xh_compress_chunk(in, (int32_t)in_len, in_start, in_end, buf, symbol_counts, d);
 
-		////////// Create the Huffman codes/lens and Calculate the compressed output size //////////
-		const_bytes lens = encoder.CreateCodes(symbol_counts);
-		size_t comp_len = xh_calc_compressed_len(lens, symbol_counts, buf_len);
+			////////// Create the Huffman codes/lens and Calculate the compressed output size //////////
+			lens = encoder->CreateCodes(symbol_counts);
+			comp_len = xh_calc_compressed_len(lens, symbol_counts, buf_len);
+		}
 		
 		////////// Guarantee Max Compression Size //////////
 		// This is required to guarantee max compressed size
 		// It is very rare that it is used (mainly medium-high uncompressible data)
-		if (UNLIKELY(comp_len > in_len+6)) // +4 to 5 for alignment and end-of-stream
+		// Incompressible data skips right to it
+		if (UNLIKELY(!matching || comp_len > LAST_CHUNK_MAX(in_len))) // +4 to 5 for alignment and end-of-stream
 		{
 			buf_len = xh_compress_no_matching(in, in_len, true, buf, symbol_counts);
-			lens = encoder.CreateCodesSlow(symbol_counts);
+			lens = encoder->CreateCodesSlow(symbol_counts);
 			comp_len = xh_calc_compressed_len_no_matching(lens, symbol_counts);
-			assert(comp_len <= in_len+6);
+			assert(comp_len <= LAST_CHUNK_MAX(in_len));
 		}
 
 		////////// Output Huffman prefix codes as lengths and Encode compressed data //////////
-		if (UNLIKELY(out_len < HALF_SYMBOLS + comp_len)) { PRINT_ERROR("Xpress Huffman Compression Error: Insufficient buffer\n"); free(buf); return MSCOMP_BUF_ERROR; }
-		for (const_bytes end = lens + SYMBOLS; lens < end; lens += 2) { *out++ = lens[0] | (lens[1] << 4); }
-		xh_compress_encode(buf, buf+buf_len, out, &encoder);
-		out += comp_len;
+		if (UNLIKELY(out_len < HALF_SYMBOLS + comp_len)) { PRINT_ERROR("Xpress Huffman Compression Error: Insufficient buffer\n"); return MSCOMP_BUF_ERROR; }
+		if (LIKELY(out != NULL))
+		{
+			for (const_bytes end = lens + SYMBOLS; lens < end; lens += 2) { *out++ = lens[0] | (lens[1] << 4); }
+			xh_compress_encode(buf, buf+buf_len, out, encoder);
+		}
+		TRACE_CHUNK_DONE(MSCOMP_XPRESS_HUFF, true, false, in_len, HALF_SYMBOLS + comp_len);
+		total += HALF_SYMBOLS + comp_len;
 	}
 
-	// Cleanup
-	free(buf);
-
 	// Return the total number of compressed bytes
-	*_out_len = out - out_orig;
+	*_out_len = total;
 	return MSCOMP_OK;
 }
 
+template<class Dict>
+FORCE_INLINE static MSCompStatus xpress_huff_compress_new_dict(const_bytes in, size_t in_len, bytes out, size_t* _out_len, bytes buf)
+{
+	Encoder encoder;
+#ifdef MSCOMP_WITH_SMALL_STACK
+	Dict* d = (Dict*)MS_ALLOC(&ms_global_allocator, sizeof(Dict));
+	if (UNLIKELY(d == NULL)) { return MSCOMP_MEM_ERROR; }
+	new (d) Dict(in, in+in_len);
+	const MSCompStatus status = xpress_huff_compress_all(in, in_len, out, _out_len, d, &encoder, buf);
+	d->~Dict();
+	MS_FREE(&ms_global_allocator, d, sizeof(Dict));
+	return status;
+#else
+	Dict d(in, in+in_len);
+	return xpress_huff_compress_all(in, in_len, out, _out_len, &d, &encoder, buf);
+#endif
+}
+FORCE_INLINE static MSCompStatus xpress_huff_compress_new_buf(const_bytes in, size_t in_len, bytes out, size_t* _out_len)
+{
+	if (in_len == 0) { *_out_len = 0; return MSCOMP_OK; }
+
+	bytes buf = (bytes)MS_ALLOC(&ms_global_allocator, BUF_SIZE(in_len));
+	if (buf == NULL) { return MSCOMP_MEM_ERROR; }
+	MSCompStatus status;
+	if (in_len <= SMALL_SIZE)       { status = xpress_huff_compress_new_dict<DictionarySmall>(in, in_len, out, _out_len, buf); }
+	else if (in_len <= MEDIUM_SIZE) { status = xpress_huff_compress_new_dict<DictionaryMedium>(in, in_len, out, _out_len, buf); }
+	else                            { status = xpress_huff_compress_new_dict<Dictionary>(in, in_len, out, _out_len, buf); }
+	MS_FREE(&ms_global_allocator, buf, BUF_SIZE(in_len));
+	return status;
+}
+ENTRY_POINT MSCompStatus xpress_huff_compress(const_bytes in, size_t in_len, bytes out, size_t* _out_len)
+{
+	return xpress_huff_compress_new_buf(in, in_len, out, _out_len);
+}
+ENTRY_POINT MSCompStatus xpress_huff_compressed_size(const_bytes in, size_t in_len, size_t* size)
+{
+	// The LZ77 and Huffman passes still run but nothing is encoded or written
+	*size = SIZE_MAX;
+	return xpress_huff_compress_new_buf(in, in_len, NULL, size);
+}
+
+ENTRY_POINT MSCompStatus xpress_huff_compress_ctx(mscomp_context* ctx, const_bytes in, size_t in_len, bytes out, size_t* _out_len)
+{
+	if (in_len == 0) { *_out_len = 0; return MSCOMP_OK; }
+	TRACE_SCOPE(ctx->trace, ctx->trace_opaque);
+
+	// The dictionaries, encoder, and temporary buffer are kept in the context and the dictionaries
+	// are reset without clearing them
+	// The same dictionary as xpress_huff_compress is used for each input size so the output is identical
+	xpress_huff_context* c = (xpress_huff_context*)ctx->xpress_huff;
+	if (UNLIKELY(c == NULL))
+	{
+		c = (xpress_huff_context*)MS_ALLOC(&ctx->allocator, sizeof(xpress_huff_context));
+		if (UNLIKELY(c == NULL)) { return MSCOMP_MEM_ERROR; }
+		ctx->xpress_huff = new (c) xpress_huff_context();
+	}
+	if (in_len <= SMALL_SIZE)
+	{
+		c->small.Reset(in, in+in_len);
+		return xpress_huff_compress_all(in, in_len, out, _out_len, &c->small, &c->encoder, c->buf);
+	}
+	if (in_len <= MEDIUM_SIZE)
+	{
+		c->medium.Reset(in, in+in_len);
+		return xpress_huff_compress_all(in, in_len, out, _out_len, &c->medium, &c->encoder, c->buf);
+	}
+	c->d.Reset(in, in+in_len);
+	return xpress_huff_compress_all(in, in_len, out, _out_len, &c->d, &c->encoder, c->buf);
+}
+
+void xpress_huff_context_free(mscomp_context* ctx)
+{
+	if (ctx->xpress_huff) { ((xpress_huff_context*)ctx->xpress_huff)->~xpress_huff_context(); MS_FREE(&ctx->allocator, ctx->xpress_huff, sizeof(xpress_huff_context)); ctx->xpress_huff = NULL; }
+}
+
 #endif
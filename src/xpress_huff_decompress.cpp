@@ -36,14 +36,20 @@ typedef HuffmanDecoder<HUFF_BITS_MAX, SYMBOLS> Decoder;
 
 
 ////////////////////////////// Decompression Functions /////////////////////////////////////////////
-static MSCompStatus xpress_huff_decompress_chunk(const_bytes* _in, const const_bytes in_end, bytes* _out, const const_bytes out_end, const const_bytes out_origin, Decoder *decoder)
+template<bool Slack>
+static FORCE_INLINE MSCompStatus xpress_huff_decode_chunk(const_bytes* _in, const const_bytes in_end, bytes* _out, const const_bytes out_end, const const_bytes out_origin, Decoder *decoder)
 {
 	InputBitstream bstr(*_in, in_end);
 	const const_bytes in_endx  = in_end - 13; // 6 bytes for the up-to 30 bits we may need (along with the 16-bit alignments the bitstream does) + 7 for an extra length bytes
 	bytes out = *_out;
-	const const_bytes out_endx = out_end - FAST_COPY_ROOM, out_end_chunk = out + CHUNK_SIZE, out_endx_chunk = MIN(out_end_chunk, out_endx);
+	// With slack the fast loop runs until the end of the output and copies may go into the slack
+	// The input slack is not used since the end-of-stream symbol cannot be detected in the fast loop
+	const const_bytes out_endx = Slack ? out_end + (MSCOMP_DECOMPRESS_SLACK - FAST_COPY_ROOM) : out_end - FAST_COPY_ROOM;
+	const const_bytes out_end_chunk = out + CHUNK_SIZE, out_endx_chunk = MIN(out_end_chunk, Slack ? out_end : out_endx);
 	uint32_t len, off;
 	uint_fast16_t sym;
+	STATS_ONLY(size_t fast_len = 0;)
+	PHASE_SCOPE(MSCOMP_PHASE_DECODE);
 
 	// Fast decompression - minimal bounds checking
 	while (LIKELY(out < out_endx_chunk && bstr.RawStream() < in_endx))
@@ -71,16 +77,19 @@ static MSCompStatus xpress_huff_decompress_chunk(const_bytes* _in, const const_b
 			if (UNLIKELY(o < out_origin))		{ PRINT_ERROR("XPRESS Huffman Decompression Error: Invalid data: Invalid offset\n"); return MSCOMP_DATA_ERROR; }
 			FAST_COPY(out, o, len, off, out_endx,
 				if (UNLIKELY(out + len > out_end)) { return MSCOMP_BUF_ERROR; }
+				STATS_ONLY(fast_len = out - *_out;)
 				goto CHECKED_COPY);
 		}
 	}
+	if (Slack && UNLIKELY(out > out_end)) { PRINT_ERROR("XPRESS Huffman Decompression Error: Insufficient buffer\n"); return MSCOMP_BUF_ERROR; }
+	STATS_ONLY(fast_len = out - *_out;)
 
 	// Slow decompression - full bounds checking
 	while (out < out_end_chunk || !bstr.MaskIsZero()) /* end of chunk, not stream */
 	{
 		sym = decoder->DecodeSymbol(&bstr);
 		if (UNLIKELY(sym == INVALID_SYMBOL))						{ PRINT_ERROR("XPRESS Huffman Decompression Error: Invalid data: Unable to read enough bits for symbol\n"); return MSCOMP_DATA_ERROR; }
-		if (sym == STREAM_END && bstr.RemainingRawBytes() == 0 && bstr.MaskIsZero()) { *_in = bstr.RawStream(); *_out = out; return MSCOMP_STREAM_END; }
+		if (sym == STREAM_END && bstr.RemainingRawBytes() == 0 && bstr.MaskIsZero()) { STATS_DECOMPRESSED(out - *_out, fast_len); *_in = bstr.RawStream(); *_out = out; return MSCOMP_STREAM_END; }
 		if (sym < 0x100)
 		{
 			if (UNLIKELY(out == out_end))							{ PRINT_ERROR("XPRESS Huffman Decompression Error: Insufficient buffer\n"); return MSCOMP_BUF_ERROR; }
@@ -108,7 +117,7 @@ static MSCompStatus xpress_huff_decompress_chunk(const_bytes* _in, const const_b
 			{
 				const uint_fast8_t off_bits = (uint_fast8_t)((sym>>4) & 0xF);
 				if (UNLIKELY(off_bits > bstr.AvailableBits()))		{ PRINT_ERROR("XPRESS Huffman Decompression Error: Invalid data: Unable to read %u bits for offset\n", sym); return MSCOMP_DATA_ERROR; }
-				off = bstr.ReadBits_Fast(off_bits) + (1 << off_bits);
+				off = bstr.ReadBits(off_bits) + (1 << off_bits);
 			}
 			if (UNLIKELY(out - off < out_origin))					{ PRINT_ERROR("XPRESS Huffman Decompression Error: Invalid data: Illegal offset (%p-%u < %p)\n", out, off, out_origin); return MSCOMP_DATA_ERROR; }
 			if (UNLIKELY(out + len > out_end))						{ PRINT_ERROR("XPRESS Huffman Decompression Error: Insufficient buffer\n"); return MSCOMP_BUF_ERROR; }
@@ -124,6 +133,7 @@ CHECKED_COPY:	for (end = out + len; out < end; ++out) { *out = *(out-off); }
 			}
 		}
 	}
+	STATS_DECOMPRESSED(out - *_out, fast_len);
 	*_out = out;
 	*_in = bstr.RawStream();
 	if (decoder->DecodeSymbol(&bstr) == STREAM_END && bstr.RemainingRawBytes() == 0 && bstr.MaskIsZero())
@@ -133,7 +143,16 @@ CHECKED_COPY:	for (end = out + len; out < end; ++out) { *out = *(out-off); }
 	}
 	return MSCOMP_OK;
 }
-ENTRY_POINT MSCompStatus xpress_huff_decompress(const_bytes in, size_t in_len, bytes out, size_t* out_len)
+CPU_DISPATCH static MSCompStatus xpress_huff_decompress_chunk(const_bytes* _in, const const_bytes in_end, bytes* _out, const const_bytes out_end, const const_bytes out_origin, Decoder *decoder)
+{
+	return xpress_huff_decode_chunk<false>(_in, in_end, _out, out_end, out_origin, decoder);
+}
+CPU_DISPATCH static MSCompStatus xpress_huff_decompress_chunk_slack(const_bytes* _in, const const_bytes in_end, bytes* _out, const const_bytes out_end, const const_bytes out_origin, Decoder *decoder)
+{
+	return xpress_huff_decode_chunk<true>(_in, in_end, _out, out_end, out_origin, decoder);
+}
+template<bool Slack, bool InPlace>
+static FORCE_INLINE MSCompStatus xpress_huff_decompress_all(const_bytes in, size_t in_len, bytes out, size_t* out_len)
 {
 	const const_bytes                  in_end  = in  + in_len;
 	const const_bytes out_start = out, out_end = out + *out_len;
@@ -147,6 +166,9 @@ ENTRY_POINT MSCompStatus xpress_huff_decompress(const_bytes in, size_t in_len, b
 			if (in != in_end) { PRINT_ERROR("Xpress Huffman Decompression Error: Invalid Data: Less than %d input bytes\n", MIN_DATA); return MSCOMP_DATA_ERROR; }
 			break;
 		}
+		TRACE_CHUNK_START(MSCOMP_XPRESS_HUFF, false);
+		TRACE_ONLY(const const_bytes in_chunk = in;)
+		const const_bytes out_chunk = out;
 		for (uint_fast16_t i = 0, i2 = 0; i < HALF_SYMBOLS; ++i)
 		{
 			code_lengths[i2++] = (in[i] & 0xF);
@@ -154,11 +176,90 @@ ENTRY_POINT MSCompStatus xpress_huff_decompress(const_bytes in, size_t in_len, b
 		}
 		in += HALF_SYMBOLS;
 		if (UNLIKELY(!decoder.SetCodeLengths(code_lengths))) { PRINT_ERROR("Xpress Huffman Decompression Error: Invalid Data: Unable to resolve Huffman codes\n"); return MSCOMP_DATA_ERROR; }
-		status = xpress_huff_decompress_chunk(&in, in_end, &out, out_end, out_start, &decoder);
+		// When in-place the chunk must fit entirely before its own input (after the Huffman table)
+		status = (Slack ? xpress_huff_decompress_chunk_slack : xpress_huff_decompress_chunk)(&in, in_end, &out, InPlace ? in : out_end, out_start, &decoder);
 		if (UNLIKELY(status < MSCOMP_OK)) { return status; }
+		TRACE_CHUNK_DONE(MSCOMP_XPRESS_HUFF, false, false, in - in_chunk, out - out_chunk);
+		CHECKSUM(out_chunk, out - out_chunk);
 	} while (status != MSCOMP_STREAM_END);
 	*out_len = out-out_start;
 	return MSCOMP_OK;
 }
+ENTRY_POINT MSCompStatus xpress_huff_decompress(const_bytes in, size_t in_len, bytes out, size_t* out_len)
+{
+	return xpress_huff_decompress_all<false, false>(in, in_len, out, out_len);
+}
+ENTRY_POINT MSCompStatus xpress_huff_decompress_slack(const_bytes in, size_t in_len, bytes out, size_t* out_len)
+{
+	return xpress_huff_decompress_all<true, false>(in, in_len, out, out_len);
+}
+ENTRY_POINT MSCompStatus xpress_huff_decompress_inplace(bytes buf, size_t in_len, size_t* out_len)
+{
+	if (UNLIKELY(in_len > *out_len)) { return MSCOMP_ARG_ERROR; }
+	return xpress_huff_decompress_all<false, true>(buf + *out_len - in_len, in_len, buf, out_len);
+}
+// A chunk must fit before its own input and every chunk can add a table along with some extra bits
+#define CHUNK_EXPANSION (HALF_SYMBOLS + 2 + CHUNK_SIZE / 1024)
+size_t xpress_huff_inplace_margin(size_t in_len) { return MIN(in_len, CHUNK_SIZE + CHUNK_EXPANSION) + CHUNK_EXPANSION * (in_len / CHUNK_SIZE + 1); }
+
+// Validation decodes every symbol like the slow loop of xpress_huff_decode_chunk but only counts
+// the output bytes instead of copying them, offsets may reach back into previous chunks
+ENTRY_POINT MSCompStatus xpress_huff_validate(const_bytes in, size_t in_len, size_t* out_len)
+{
+	const const_bytes in_end = in + in_len;
+	size_t out = 0;
+	Decoder decoder;
+	byte code_lengths[SYMBOLS];
+	while (in != in_end)
+	{
+		if (UNLIKELY(in_end - in < MIN_DATA)) { PRINT_ERROR("Xpress Huffman Decompression Error: Invalid Data: Less than %d input bytes\n", MIN_DATA); return MSCOMP_DATA_ERROR; }
+		for (uint_fast16_t i = 0, i2 = 0; i < HALF_SYMBOLS; ++i)
+		{
+			code_lengths[i2++] = (in[i] & 0xF);
+			code_lengths[i2++] = (in[i] >>  4);
+		}
+		in += HALF_SYMBOLS;
+		if (UNLIKELY(!decoder.SetCodeLengths(code_lengths))) { PRINT_ERROR("Xpress Huffman Decompression Error: Invalid Data: Unable to resolve Huffman codes\n"); return MSCOMP_DATA_ERROR; }
+
+		InputBitstream bstr(in, in_end);
+		const size_t out_end_chunk = out + CHUNK_SIZE;
+		while (out < out_end_chunk || !bstr.MaskIsZero()) /* end of chunk, not stream */
+		{
+			const uint_fast16_t sym = decoder.DecodeSymbol(&bstr);
+			if (UNLIKELY(sym == INVALID_SYMBOL))						{ PRINT_ERROR("XPRESS Huffman Decompression Error: Invalid data: Unable to read enough bits for symbol\n"); return MSCOMP_DATA_ERROR; }
+			if (sym == STREAM_END && bstr.RemainingRawBytes() == 0 && bstr.MaskIsZero()) { *out_len = out; return MSCOMP_OK; }
+			if (sym < 0x100) { ++out; continue; }
+			uint32_t len, off;
+			if ((len = sym & 0xF) == 0xF)
+			{
+				if (UNLIKELY(bstr.RemainingRawBytes() < 1))				{ PRINT_ERROR("XPRESS Huffman Decompression Error: Invalid data: Unable to read extra byte for length\n"); return MSCOMP_DATA_ERROR; }
+				else if ((len = bstr.ReadRawByte()) == 0xFF)
+				{
+					if (UNLIKELY(bstr.RemainingRawBytes() < 2))			{ PRINT_ERROR("XPRESS Huffman Decompression Error: Invalid data: Unable to read two bytes for length\n"); return MSCOMP_DATA_ERROR; }
+					if (UNLIKELY((len = bstr.ReadRawUInt16()) == 0))
+					{
+						if (UNLIKELY(bstr.RemainingRawBytes() < 4))		{ PRINT_ERROR("XPRESS Huffman Decompression Error: Invalid data: Unable to read four bytes for length\n"); return MSCOMP_DATA_ERROR; }
+						len = bstr.ReadRawUInt32();
+					}
+					if (UNLIKELY(len < 0xF))							{ PRINT_ERROR("XPRESS Huffman Decompression Error: Invalid data: Invalid length specified\n"); return MSCOMP_DATA_ERROR; }
+					len -= 0xF;
+				}
+				len += 0xF;
+			}
+			len += 3;
+			{
+				const uint_fast8_t off_bits = (uint_fast8_t)((sym>>4) & 0xF);
+				if (UNLIKELY(off_bits > bstr.AvailableBits()))			{ PRINT_ERROR("XPRESS Huffman Decompression Error: Invalid data: Unable to read %u bits for offset\n", sym); return MSCOMP_DATA_ERROR; }
+				off = bstr.ReadBits(off_bits) + (1 << off_bits);
+			}
+			if (UNLIKELY(off > out))									{ PRINT_ERROR("XPRESS Huffman Decompression Error: Invalid data: Illegal offset (%zu-%u < 0)\n", out, off); return MSCOMP_DATA_ERROR; }
+			out += len;
+		}
+		in = bstr.RawStream();
+		if (decoder.DecodeSymbol(&bstr) == STREAM_END && bstr.RemainingRawBytes() == 0 && bstr.MaskIsZero()) { break; }
+	}
+	*out_len = out;
+	return MSCOMP_OK;
+}
 
 #endif
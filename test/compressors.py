@@ -1,4 +1,4 @@
-from ctypes import c_size_t, c_int, c_void_p, c_ubyte, c_char_p, c_char, c_bool
+from ctypes import c_size_t, c_int, c_void_p, c_ubyte, c_char_p, c_char, c_bool, c_uint32
 from ctypes import create_string_buffer, cast, POINTER, byref, cdll, sizeof, memmove, Structure
 from abc import ABCMeta, abstractmethod
 from warnings import warn
@@ -211,13 +211,22 @@ if dll is not None:
     def _prep(f, args):
         f.restype, f.errcheck, f.argtypes = c_int, _errchk, args
         return f
+    def _optional_stream_fields():
+        # mscomp_stream has more fields when the library is compiled with MSCOMP_WITH_TRACE or
+        # MSCOMP_WITH_STREAM_CHECKSUM, their setters only succeed when they are there
+        fields, buf = [], create_string_buffer(4096)
+        if hasattr(dll, 'ms_stream_set_trace') and dll.ms_stream_set_trace(buf, None, None) == 0:
+            fields += [("trace", c_void_p), ("trace_opaque", c_void_p)]
+        if hasattr(dll, 'ms_stream_set_checksum') and dll.ms_stream_set_checksum(buf, False) == 0:
+            fields += [("checksumming", c_bool), ("checksum", c_uint32)]
+        return fields
     class OpenSrc(StreamableCompressor):
         class stream(Structure):
             _fields_ = [("format", c_int), ("compressing", c_bool),
                         ("in_", c_void_p), ("in_avail",  c_size_t), ("in_total",  c_size_t),
                         ("out", c_void_p), ("out_avail", c_size_t), ("out_total", c_size_t),
-                        ("error", c_char*256), ("warning", c_char*256),
-                        ("state", c_void_p)]
+                        ("error", c_char*256), ("warning", c_char*256)] + \
+                        _optional_stream_fields() + [("state", c_void_p)]
 
         compress     = _prep(dll.ms_compress,   [c_int, c_void_p, c_size_t, c_void_p, POINTER(c_size_t)])
         decompress   = _prep(dll.ms_decompress, [c_int, c_void_p, c_size_t, c_void_p, POINTER(c_size_t)])
@@ -0,0 +1,758 @@
+// ms-compress: implements Microsoft compression algorithms
+// Copyright (C) 2012  Jeffrey Bush  jeff@coderforlife.com
+//
+// This library is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This library is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+
+/////////////////// Benchmark //////////////////////////////////////////////////
+// mscomp_bench [options] [file ...]
+//   -f formats   Comma-separated formats: none, lznt1, xpress, xpress-huff (default all but none)
+//   -m modes     Comma-separated modes: oneshot, ctx, stream (default all)
+//   -i count     Timed iterations per measurement (default 10)
+//   -w count     Untimed warmup iterations per measurement (default 2)
+//   -c cpu       Pin the benchmark to the given processor
+//   -s           Also measure per-call latencies of small buffers (64 bytes to 64 kb)
+//   -t ms        Minimum milliseconds per small buffer measurement (default 200)
+//   -p           Also break down hardware performance counters by phase (Linux only)
+//   -g families  Comma-separated generated data: text, binary, pages, random, logs, mixed, all
+//   -z sizes     Comma-separated sizes of the generated data, with k, m, or g suffixes (default 1m)
+//   -r seed      Seed of the generated data (default 1)
+//   -o dir       Only write the generated data to files in the directory, named family-size
+//   -j file      Write all results as JSON to the file ("-" for stdout)
+//
+// Times the library directly so that the results only include the library itself. Each file is
+// compressed and decompressed as a whole with every format and mode and the best and median
+// speeds over the iterations are reported along with the compression ratio. Every result is
+// checked to decompress back to the original before timing. If no files or generated data are
+// given then 1 MB of generated text is used.
+//
+// The generated data (see mscomp_corpus.h) is the same on every machine for the same family, size,
+// and seed so results can be tracked over time without downloading any corpora. Sizes can be from
+// 1 byte to 1 GB and every combination of the families and sizes is used.
+//
+// The modes are ms_compress/ms_decompress (oneshot), ms_compress_ctx with a reused context and
+// ms_decompress (ctx), and ms_deflate/ms_inflate given 64 kb at a time (stream). Formats without
+// streaming support are skipped in the stream mode. The library has no compression levels.
+//
+// The small buffer latencies time every call individually and report percentiles over many
+// different slices of the largest file or generated data, which shows the fixed costs and the
+// jitter that the whole-file numbers hide. The JSON output contains everything printed so that the
+// results of different builds can be compared.
+//
+// The hardware performance counters (cycles, instructions, branch misses, L1 data cache read
+// misses, and last-level cache misses) are read with perf_event_open as a single group during
+// extra untimed runs. When the library is compiled with MSCOMP_WITH_PHASES the counts are split
+// between the phases of the library (dictionary filling, match finding, Huffman code creation,
+// Huffman encoding, and decoding), otherwise everything is reported as "other". The counters are
+// read at the start and end of every phase so the phases are large enough (whole chunks) that the
+// reads are cheap compared to the phases themselves, but the numbers are always a little higher
+// than without -p. Counters the processor or the kernel does not allow are shown as "-".
+//
+// Compile against the library, for example (or use build.sh):
+//   g++ -O3 -DMSCOMP_WITHOUT_LZX -pthread -Iinclude test/mscomp_bench.cpp src/*.cpp -o mscomp_bench
+// adding -DMSCOMP_WITH_PHASES for the phase breakdown of -p.
+
+#include "../include/mscomp.h"
+#include "mscomp_corpus.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#include <windows.h>
+static double now()
+{
+	LARGE_INTEGER t, f;
+	QueryPerformanceCounter(&t);
+	QueryPerformanceFrequency(&f);
+	return (double)t.QuadPart / f.QuadPart;
+}
+static bool pin_cpu(int cpu) { return cpu < 64 && SetThreadAffinityMask(GetCurrentThread(), (DWORD_PTR)1 << cpu) != 0; }
+#else
+#ifndef _GNU_SOURCE
+#define _GNU_SOURCE
+#endif
+#include <time.h>
+#include <sched.h>
+static double now()
+{
+	struct timespec t;
+	clock_gettime(CLOCK_MONOTONIC, &t);
+	return t.tv_sec + t.tv_nsec * 1e-9;
+}
+#ifdef __linux__
+#include <unistd.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <linux/perf_event.h>
+#endif
+#ifdef CPU_SET
+static bool pin_cpu(int cpu)
+{
+	cpu_set_t set;
+	CPU_ZERO(&set);
+	CPU_SET(cpu, &set);
+	return sched_setaffinity(0, sizeof(set), &set) == 0;
+}
+#else
+static bool pin_cpu(int /*cpu*/) { return false; }
+#endif
+#endif
+
+#define MIN_SIZE		0x40
+#define MAX_SIZE		0x10000
+#define MAX_GENERATED	0x40000000
+#define STREAM_CHUNK	0x10000
+#define MAX_SAMPLES		0x40000
+
+static const MSCompFormat formats[] = { MSCOMP_NONE, MSCOMP_LZNT1, MSCOMP_XPRESS, MSCOMP_XPRESS_HUFF };
+static const char* const format_names[] = { "none", "lznt1", "xpress", "xpress-huff" };
+#define NUM_FORMATS (sizeof(formats) / sizeof(formats[0]))
+
+enum Mode { MODE_ONESHOT, MODE_CTX, MODE_STREAM };
+static const char* const mode_names[] = { "oneshot", "ctx", "stream" };
+#define NUM_MODES (sizeof(mode_names) / sizeof(mode_names[0]))
+
+static FILE* tables; // where the tables are printed
+
+struct options
+{
+	unsigned formats, modes; // bitmasks of the indices above
+	unsigned iterations, warmup;
+	bool small, perf;
+	double small_seconds;
+};
+
+static bytes read_file(const char* path, size_t* len)
+{
+	FILE* f = fopen(path, "rb");
+	if (f == NULL) { return NULL; }
+	size_t cap = 0x10000, n = 0;
+	bytes data = (bytes)malloc(cap);
+	while (data)
+	{
+		n += fread(data + n, 1, cap - n, f);
+		if (n < cap) { break; }
+		bytes d = (bytes)realloc(data, cap *= 2);
+		if (d == NULL) { free(data); data = NULL; } else { data = d; }
+	}
+	fclose(f);
+	*len = n;
+	return data;
+}
+
+
+///// Running the Library /////
+static MSCompStatus stream_compress(MSCompFormat format, const_bytes in, size_t in_len, bytes out, size_t* out_len)
+{
+	mscomp_stream s;
+	MSCompStatus err = ms_deflate_init(format, &s);
+	if (err != MSCOMP_OK) { return err; }
+	s.out = out;
+	s.out_avail = *out_len;
+	size_t pos = 0;
+	do
+	{
+		const size_t n = in_len - pos < STREAM_CHUNK ? in_len - pos : STREAM_CHUNK;
+		s.in = in + pos;
+		s.in_avail = n;
+		pos += n;
+		err = ms_deflate(&s, pos == in_len ? MSCOMP_FINISH : MSCOMP_NO_FLUSH);
+		if (err >= 0 && s.in_avail) { err = MSCOMP_BUF_ERROR; }
+	} while (err == MSCOMP_OK && pos < in_len);
+	if (err == MSCOMP_STREAM_END) { err = MSCOMP_OK; }
+	else if (err == MSCOMP_OK) { err = MSCOMP_BUF_ERROR; } // finished without the stream ending
+	*out_len = s.out_total;
+	const MSCompStatus end = ms_deflate_end(&s);
+	return err == MSCOMP_OK ? end : err;
+}
+
+static MSCompStatus stream_decompress(MSCompFormat format, const_bytes in, size_t in_len, bytes out, size_t* out_len)
+{
+	mscomp_stream s;
+	MSCompStatus err = ms_inflate_init(format, &s);
+	if (err != MSCOMP_OK) { return err; }
+	s.out = out;
+	s.out_avail = *out_len;
+	size_t pos = 0;
+	do
+	{
+		const size_t n = in_len - pos < STREAM_CHUNK ? in_len - pos : STREAM_CHUNK;
+		s.in = in + pos;
+		s.in_avail = n;
+		pos += n;
+		err = ms_inflate(&s);
+		if (err >= 0 && s.in_avail && err != MSCOMP_STREAM_END) { err = MSCOMP_BUF_ERROR; }
+	} while (err >= 0 && err != MSCOMP_STREAM_END && pos < in_len);
+	*out_len = s.out_total;
+	const MSCompStatus end = ms_inflate_end(&s);
+	return err < 0 ? err : end;
+}
+
+static MSCompStatus compress(Mode mode, MSCompFormat format, mscomp_context* ctx, const_bytes in, size_t in_len, bytes out, size_t* out_len)
+{
+	switch (mode)
+	{
+	case MODE_ONESHOT: return ms_compress(format, in, in_len, out, out_len);
+	case MODE_CTX:     return ms_compress_ctx(ctx, format, in, in_len, out, out_len);
+	default:           return stream_compress(format, in, in_len, out, out_len);
+	}
+}
+
+static MSCompStatus decompress(Mode mode, MSCompFormat format, const_bytes in, size_t in_len, bytes out, size_t* out_len)
+{
+	return mode == MODE_STREAM ? stream_decompress(format, in, in_len, out, out_len) : ms_decompress(format, in, in_len, out, out_len);
+}
+
+static bool supported(Mode mode, MSCompFormat format)
+{
+	if (mode != MODE_STREAM) { return true; }
+	mscomp_stream s;
+	if (ms_deflate_init(format, &s) != MSCOMP_OK) { return false; }
+	ms_deflate_end(&s);
+	if (ms_inflate_init(format, &s) != MSCOMP_OK) { return false; }
+	ms_inflate_end(&s);
+	return true;
+}
+
+
+///// Statistics /////
+static int cmp_double(const void* a, const void* b)
+{
+	const double x = *(const double*)a, y = *(const double*)b;
+	return x < y ? -1 : (x > y ? 1 : 0);
+}
+// The samples must be sorted
+static double percentile(const double* samples, size_t n, double p) { return samples[(size_t)(p * (n - 1) + 0.5)]; }
+
+
+///// JSON Output /////
+struct json
+{
+	FILE* f;
+	bool first; // no comma is needed before the next value
+};
+static void json_str(FILE* f, const char* s)
+{
+	fputc('"', f);
+	for (; *s; ++s)
+	{
+		if (*s == '"' || *s == '\\') { fputc('\\', f); fputc(*s, f); }
+		else if ((unsigned char)*s < 0x20) { fprintf(f, "\\u%04x", (unsigned char)*s); }
+		else { fputc(*s, f); }
+	}
+	fputc('"', f);
+}
+static void json_next(json* j) { if (!j->first) { fputs(",\n", j->f); } j->first = false; }
+
+
+///// Hardware Performance Counters /////
+#define NUM_COUNTERS	5
+#define NUM_PHASES		(MSCOMP_PHASE_COUNT + 1) // the last one is outside of all phases
+#define MAX_DEPTH		8
+static const char* const counter_names[NUM_COUNTERS] = { "cycles", "instructions", "branch_misses", "l1d_misses", "llc_misses" };
+static const char* const phase_names[NUM_PHASES] = { "fill", "find", "create-codes", "encode", "decode", "other" };
+
+struct perf
+{
+	int group;						// the file descriptor of the group leader, -1 if none are available
+	int index[NUM_COUNTERS];		// the position of each counter in the group, -1 if not available
+	unsigned count;					// the number of counters in the group
+	uint64_t last[NUM_COUNTERS];	// the values at the last read
+	uint64_t counts[NUM_PHASES][NUM_COUNTERS];
+	MSCompPhase stack[MAX_DEPTH];	// the phases currently running, innermost last
+	unsigned depth;
+};
+
+#ifdef __linux__
+static bool perf_open(perf* p)
+{
+	static const uint32_t types[NUM_COUNTERS] = { PERF_TYPE_HARDWARE, PERF_TYPE_HARDWARE, PERF_TYPE_HARDWARE, PERF_TYPE_HW_CACHE, PERF_TYPE_HARDWARE };
+	static const uint64_t configs[NUM_COUNTERS] = {
+		PERF_COUNT_HW_CPU_CYCLES, PERF_COUNT_HW_INSTRUCTIONS, PERF_COUNT_HW_BRANCH_MISSES,
+		PERF_COUNT_HW_CACHE_L1D | (PERF_COUNT_HW_CACHE_OP_READ << 8) | (PERF_COUNT_HW_CACHE_RESULT_MISS << 16),
+		PERF_COUNT_HW_CACHE_MISSES,
+	};
+	memset(p, 0, sizeof(perf));
+	p->group = -1;
+	for (size_t i = 0; i < NUM_COUNTERS; ++i)
+	{
+		struct perf_event_attr attr;
+		memset(&attr, 0, sizeof(attr));
+		attr.size = sizeof(attr);
+		attr.type = types[i];
+		attr.config = configs[i];
+		attr.read_format = PERF_FORMAT_GROUP;
+		attr.exclude_kernel = 1;
+		attr.exclude_hv = 1;
+		const int fd = (int)syscall(SYS_perf_event_open, &attr, 0, -1, p->group, 0);
+		if (fd < 0) { p->index[i] = -1; continue; }
+		if (p->group < 0) { p->group = fd; }
+		p->index[i] = (int)p->count++;
+	}
+	return p->group >= 0;
+}
+static void perf_read(const perf* p, uint64_t values[NUM_COUNTERS])
+{
+	uint64_t buf[1 + NUM_COUNTERS]; // the number of counters followed by their values
+	if (read(p->group, buf, sizeof(buf)) < (ssize_t)((1 + p->count) * sizeof(uint64_t))) { memset(buf, 0, sizeof(buf)); }
+	for (size_t i = 0; i < NUM_COUNTERS; ++i) { values[i] = p->index[i] >= 0 ? buf[1 + p->index[i]] : 0; }
+}
+#else
+static bool perf_open(perf* p) { memset(p, 0, sizeof(perf)); p->group = -1; return false; }
+static void perf_read(const perf* /*p*/, uint64_t values[NUM_COUNTERS]) { memset(values, 0, NUM_COUNTERS * sizeof(uint64_t)); }
+#endif
+
+// Gives the counts since the last read to the innermost running phase
+static void perf_attribute(perf* p)
+{
+	uint64_t values[NUM_COUNTERS];
+	perf_read(p, values);
+	uint64_t* counts = p->counts[p->depth ? p->stack[p->depth - 1] : MSCOMP_PHASE_COUNT];
+	for (size_t i = 0; i < NUM_COUNTERS; ++i) { counts[i] += values[i] - p->last[i]; p->last[i] = values[i]; }
+}
+static void perf_hook(void* opaque, MSCompPhase phase, bool begin)
+{
+	perf* p = (perf*)opaque;
+	perf_attribute(p);
+	if (!begin) { if (p->depth) { --p->depth; } }
+	else if (p->depth < MAX_DEPTH) { p->stack[p->depth++] = phase; }
+}
+static void perf_start(perf* p)
+{
+	memset(p->counts, 0, sizeof(p->counts));
+	p->depth = 0;
+	perf_read(p, p->last);
+	ms_set_phase_hook(perf_hook, p);
+}
+static void perf_stop(perf* p)
+{
+	ms_set_phase_hook(NULL, NULL);
+	perf_attribute(p);
+}
+
+// Prints the counts per byte (or per kb for the misses) of uncompressed data for each phase that ran
+static void perf_print(const perf* p, json* j, const char* what, double bytes)
+{
+	static const double scales[NUM_COUNTERS] = { 1, 1, 1024, 1024, 1024 };
+	fprintf(tables, "  %-14s %10s %10s %6s %12s %12s %12s\n", what, "cycles/B", "instr/B", "IPC", "br-miss/kB", "L1d-miss/kB", "LLC-miss/kB");
+	if (j) { fprintf(j->f, ", \"%s\": {\"bytes\": %.0f", what, bytes); }
+	uint64_t total[NUM_COUNTERS] = { 0 };
+	for (size_t ph = 0; ph <= NUM_PHASES; ++ph)
+	{
+		const uint64_t* counts = ph < NUM_PHASES ? p->counts[ph] : total;
+		bool ran = false;
+		for (size_t i = 0; i < NUM_COUNTERS; ++i) { ran |= counts[i] != 0; }
+		if (!ran && ph < NUM_PHASES) { continue; }
+		const char* name = ph < NUM_PHASES ? phase_names[ph] : "total";
+		fprintf(tables, "  %-14s", name);
+		for (size_t i = 0; i < NUM_COUNTERS; ++i)
+		{
+			if (i == 2) // IPC goes right after the instructions
+			{
+				if (p->index[0] >= 0 && p->index[1] >= 0 && counts[0]) { fprintf(tables, " %6.2f", (double)counts[1] / counts[0]); }
+				else { fprintf(tables, " %6s", "-"); }
+			}
+			if (p->index[i] >= 0) { fprintf(tables, i < 2 ? " %10.2f" : " %12.2f", counts[i] * scales[i] / bytes); }
+			else { fprintf(tables, i < 2 ? " %10s" : " %12s", "-"); }
+		}
+		fprintf(tables, "\n");
+		if (j)
+		{
+			fprintf(j->f, ", \"%s\": {", name);
+			bool first = true;
+			for (size_t i = 0; i < NUM_COUNTERS; ++i)
+			{
+				if (p->index[i] < 0) { continue; }
+				fprintf(j->f, "%s\"%s\": %llu", first ? "" : ", ", counter_names[i], (unsigned long long)counts[i]);
+				first = false;
+			}
+			fputc('}', j->f);
+		}
+		if (ph < NUM_PHASES) { for (size_t i = 0; i < NUM_COUNTERS; ++i) { total[i] += counts[i]; } }
+	}
+	if (j) { fputc('}', j->f); }
+}
+
+
+///// Whole Files /////
+static int bench_file(const options* opts, json* j, perf* p, const char* name, const_bytes data, size_t len, mscomp_context* ctx)
+{
+	const size_t comp_cap = ms_max_compressed_size(MSCOMP_XPRESS_HUFF, len) + ms_max_compressed_size(MSCOMP_LZNT1, len) + STREAM_CHUNK;
+	bytes comp = (bytes)malloc(comp_cap), decomp = (bytes)malloc(len + 1);
+	double* comp_times = (double*)malloc(opts->iterations * sizeof(double));
+	double* decomp_times = (double*)malloc(opts->iterations * sizeof(double));
+	if (comp == NULL || decomp == NULL || comp_times == NULL || decomp_times == NULL) { fprintf(stderr, "Out of memory\n"); return 1; }
+
+	fprintf(tables, "%s (%u bytes)\n", name, (unsigned)len);
+	fprintf(tables, "%-12s %-8s %8s %12s %12s %12s %12s\n", "format", "mode", "ratio", "comp best", "comp median", "decomp best", "decomp med");
+	if (j) { json_next(j); fputs("  {\"name\": ", j->f); json_str(j->f, name); fprintf(j->f, ", \"size\": %u, \"results\": [", (unsigned)len); }
+	bool first = true;
+
+	for (size_t f = 0; f < NUM_FORMATS; ++f)
+	{
+		if (!(opts->formats & (1u << f))) { continue; }
+		for (size_t m = 0; m < NUM_MODES; ++m)
+		{
+			if (!(opts->modes & (1u << m))) { continue; }
+			const Mode mode = (Mode)m;
+			if (!supported(mode, formats[f])) { fprintf(tables, "%-12s %-8s %8s\n", format_names[f], mode_names[m], "n/a"); continue; }
+
+			// Check the round-trip
+			size_t comp_len = comp_cap, decomp_len = len;
+			MSCompStatus err = compress(mode, formats[f], ctx, data, len, comp, &comp_len);
+			if (err != MSCOMP_OK) { fprintf(stderr, "%s %s compression failed: %d\n", format_names[f], mode_names[m], err); return 1; }
+			err = decompress(mode, formats[f], comp, comp_len, decomp, &decomp_len);
+			if (err < 0 || decomp_len != len || memcmp(decomp, data, len) != 0)
+			{
+				fprintf(stderr, "%s %s decompression failed: %d\n", format_names[f], mode_names[m], err); return 1;
+			}
+
+			// Time the compression and decompression
+			for (unsigned i = 0; i < opts->warmup + opts->iterations; ++i)
+			{
+				size_t out_len = comp_cap;
+				const double start = now();
+				compress(mode, formats[f], ctx, data, len, comp, &out_len);
+				const double end = now();
+				if (i >= opts->warmup) { comp_times[i - opts->warmup] = end - start; }
+			}
+			for (unsigned i = 0; i < opts->warmup + opts->iterations; ++i)
+			{
+				size_t out_len = len;
+				const double start = now();
+				decompress(mode, formats[f], comp, comp_len, decomp, &out_len);
+				const double end = now();
+				if (i >= opts->warmup) { decomp_times[i - opts->warmup] = end - start; }
+			}
+			qsort(comp_times, opts->iterations, sizeof(double), cmp_double);
+			qsort(decomp_times, opts->iterations, sizeof(double), cmp_double);
+			const double mb = len / 1e6, ratio = len ? comp_len * 100.0 / len : 100.0;
+			const double comp_best = mb / comp_times[0], comp_median = mb / percentile(comp_times, opts->iterations, 0.5);
+			const double decomp_best = mb / decomp_times[0], decomp_median = mb / percentile(decomp_times, opts->iterations, 0.5);
+
+			fprintf(tables, "%-12s %-8s %7.2f%% %12.1f %12.1f %12.1f %12.1f\n", format_names[f], mode_names[m], ratio,
+				comp_best, comp_median, decomp_best, decomp_median);
+			if (j)
+			{
+				fprintf(j->f, "%s\n    {\"format\": \"%s\", \"mode\": \"%s\", \"compressed_size\": %u, \"ratio\": %.4f, "
+					"\"comp_mbps\": {\"best\": %.2f, \"median\": %.2f}, \"decomp_mbps\": {\"best\": %.2f, \"median\": %.2f}",
+					first ? "" : ",", format_names[f], mode_names[m], (unsigned)comp_len, ratio,
+					comp_best, comp_median, decomp_best, decomp_median);
+				first = false;
+			}
+
+			// Count the hardware events of each phase in separate runs
+			if (p)
+			{
+				const double bytes = (double)len * opts->iterations;
+				if (j) { fprintf(j->f, ", \"perf\": {\"iterations\": %u", opts->iterations); }
+				perf_start(p);
+				for (unsigned i = 0; i < opts->iterations; ++i) { size_t out_len = comp_cap; compress(mode, formats[f], ctx, data, len, comp, &out_len); }
+				perf_stop(p);
+				perf_print(p, j, "compress", bytes);
+				perf_start(p);
+				for (unsigned i = 0; i < opts->iterations; ++i) { size_t out_len = len; decompress(mode, formats[f], comp, comp_len, decomp, &out_len); }
+				perf_stop(p);
+				perf_print(p, j, "decompress", bytes);
+				if (j) { fputc('}', j->f); }
+			}
+			if (j) { fputc('}', j->f); }
+		}
+	}
+	fprintf(tables, "\n");
+	if (j) { fputs("]}", j->f); }
+
+	free(comp);
+	free(decomp);
+	free(comp_times);
+	free(decomp_times);
+	return 0;
+}
+
+
+///// Small Buffers /////
+// Every call is timed on its own with a different slice of the data for each call
+static int bench_small(const options* opts, json* j, const_bytes data, size_t data_len, mscomp_context* ctx)
+{
+	const size_t comp_cap = ms_max_compressed_size(MSCOMP_XPRESS_HUFF, MAX_SIZE) + ms_max_compressed_size(MSCOMP_LZNT1, MAX_SIZE) + STREAM_CHUNK;
+	bytes comp = (bytes)malloc(comp_cap), decomp = (bytes)malloc(MAX_SIZE);
+	double* samples = (double*)malloc(MAX_SAMPLES * sizeof(double));
+	if (comp == NULL || decomp == NULL || samples == NULL) { fprintf(stderr, "Out of memory\n"); return 1; }
+	if (data_len < MAX_SIZE) { fprintf(stderr, "Small buffers need at least %u bytes of data\n", MAX_SIZE); return 1; }
+
+	for (size_t f = 0; f < NUM_FORMATS; ++f)
+	{
+		if (!(opts->formats & (1u << f))) { continue; }
+		for (size_t m = 0; m < NUM_MODES; ++m)
+		{
+			if (!(opts->modes & (1u << m)) || !supported((Mode)m, formats[f])) { continue; }
+			const Mode mode = (Mode)m;
+			fprintf(tables, "%s %s (ns per call)\n", format_names[f], mode_names[m]);
+			fprintf(tables, "%8s %8s %9s %9s %9s %9s %9s %9s %9s %9s\n", "size", "ratio",
+				"comp p50", "comp p90", "comp p99", "comp max", "dec p50", "dec p90", "dec p99", "dec max");
+			for (size_t size = MIN_SIZE; size <= MAX_SIZE; size <<= 1)
+			{
+				// The ratio is always for the same (up to 64) slices so it does not depend on the speed
+				const size_t nslices = (data_len - size) / size + 1;
+				size_t total_in = 0, total_out = 0;
+				for (size_t i = 0; i < nslices && i < 64; ++i)
+				{
+					size_t out_len = comp_cap;
+					if (compress(mode, formats[f], ctx, data + i * size, size, comp, &out_len) != MSCOMP_OK) { fprintf(stderr, "Compression failed\n"); return 1; }
+					total_in += size; total_out += out_len;
+				}
+
+				double comp_pct[4], decomp_pct[4];
+				for (int dir = 0; dir < 2; ++dir)
+				{
+					size_t n = 0, comp_len = comp_cap;
+					if (dir == 1)
+					{
+						// Decompression always uses the same slice, which is checked once before timing
+						size_t decomp_len = size;
+						compress(mode, formats[f], ctx, data, size, comp, &comp_len);
+						if (decompress(mode, formats[f], comp, comp_len, decomp, &decomp_len) < 0 || decomp_len != size || memcmp(decomp, data, size) != 0)
+						{
+							fprintf(stderr, "Decompression failed\n"); return 1;
+						}
+					}
+					for (unsigned i = 0; i < opts->warmup; ++i)
+					{
+						size_t out_len = dir ? size : comp_cap;
+						if (dir) { decompress(mode, formats[f], comp, comp_len, decomp, &out_len); }
+						else { compress(mode, formats[f], ctx, data + (i % nslices) * size, size, comp, &out_len); }
+					}
+					const double stop = now() + opts->small_seconds;
+					do
+					{
+						size_t out_len = dir ? size : comp_cap;
+						const double start = now();
+						if (dir) { decompress(mode, formats[f], comp, comp_len, decomp, &out_len); }
+						else { compress(mode, formats[f], ctx, data + (n % nslices) * size, size, comp, &out_len); }
+						samples[n++] = now() - start;
+					} while (n < MAX_SAMPLES && (n < opts->iterations || now() < stop));
+					qsort(samples, n, sizeof(double), cmp_double);
+					double* pct = dir ? decomp_pct : comp_pct;
+					pct[0] = percentile(samples, n, 0.50) * 1e9;
+					pct[1] = percentile(samples, n, 0.90) * 1e9;
+					pct[2] = percentile(samples, n, 0.99) * 1e9;
+					pct[3] = samples[n - 1] * 1e9;
+				}
+
+				const double ratio = total_out * 100.0 / total_in;
+				fprintf(tables, "%8u %7.2f%% %9.0f %9.0f %9.0f %9.0f %9.0f %9.0f %9.0f %9.0f\n", (unsigned)size, ratio,
+					comp_pct[0], comp_pct[1], comp_pct[2], comp_pct[3], decomp_pct[0], decomp_pct[1], decomp_pct[2], decomp_pct[3]);
+				if (j)
+				{
+					json_next(j);
+					fprintf(j->f, "  {\"format\": \"%s\", \"mode\": \"%s\", \"size\": %u, \"ratio\": %.4f, "
+						"\"comp_ns\": {\"p50\": %.0f, \"p90\": %.0f, \"p99\": %.0f, \"max\": %.0f}, "
+						"\"decomp_ns\": {\"p50\": %.0f, \"p90\": %.0f, \"p99\": %.0f, \"max\": %.0f}}",
+						format_names[f], mode_names[m], (unsigned)size, ratio,
+						comp_pct[0], comp_pct[1], comp_pct[2], comp_pct[3], decomp_pct[0], decomp_pct[1], decomp_pct[2], decomp_pct[3]);
+				}
+			}
+			fprintf(tables, "\n");
+		}
+	}
+
+	free(comp);
+	free(decomp);
+	free(samples);
+	return 0;
+}
+
+
+///// Command Line /////
+static bool parse_list(const char* s, const char* const* names, size_t count, unsigned* mask)
+{
+	*mask = 0;
+	while (*s)
+	{
+		const char* end = strchr(s, ',');
+		const size_t len = end ? (size_t)(end - s) : strlen(s);
+		size_t i = 0;
+		while (i < count && (strlen(names[i]) != len || strncmp(names[i], s, len) != 0)) { ++i; }
+		if (i == count) { return false; }
+		*mask |= 1u << i;
+		s += len + (end ? 1 : 0);
+	}
+	return *mask != 0;
+}
+
+// Sizes are numbers of bytes with an optional k, m, or g suffix (powers of 1024)
+#define MAX_SIZES 16
+static bool parse_sizes(const char* s, size_t* sizes, size_t* count)
+{
+	*count = 0;
+	while (*s)
+	{
+		char* end;
+		unsigned long long size = strtoull(s, &end, 10);
+		if (end == s) { return false; }
+		switch (*end)
+		{
+		case 'k': case 'K': size <<= 10; ++end; break;
+		case 'm': case 'M': size <<= 20; ++end; break;
+		case 'g': case 'G': size <<= 30; ++end; break;
+		}
+		if (size == 0 || size > MAX_GENERATED || *count == MAX_SIZES || (*end && *end != ',')) { return false; }
+		sizes[(*count)++] = (size_t)size;
+		s = *end ? end + 1 : end;
+	}
+	return *count != 0;
+}
+static void size_name(char* name, size_t n, size_t size)
+{
+	if      (size % 0x40000000 == 0) { snprintf(name, n, "%ug", (unsigned)(size >> 30)); }
+	else if (size % 0x100000 == 0)   { snprintf(name, n, "%um", (unsigned)(size >> 20)); }
+	else if (size % 0x400 == 0)      { snprintf(name, n, "%uk", (unsigned)(size >> 10)); }
+	else                             { snprintf(name, n, "%u", (unsigned)size); }
+}
+
+static int usage(const char* prog)
+{
+	fprintf(stderr, "Usage: %s [-f formats] [-m modes] [-i iterations] [-w warmup] [-c cpu] [-s] [-t ms] [-p]\n"
+		"       [-g families] [-z sizes] [-r seed] [-o dir] [-j file] [file ...]\n", prog);
+	return 1;
+}
+
+int main(int argc, char* argv[])
+{
+	options opts = { 0xE, 0x7, 10, 2, false, false, 0.2 }; // all formats but none, all modes
+	const char* json_path = NULL;
+	const char* out_dir = NULL;
+	unsigned families = 0;
+	size_t sizes[MAX_SIZES] = { 0x100000 }, nsizes = 1;
+	unsigned long long seed = 1;
+	int cpu = -1, argi = 1;
+	for (; argi < argc && argv[argi][0] == '-' && argv[argi][1]; ++argi)
+	{
+		const char opt = argv[argi][1];
+		if (opt == 's') { opts.small = true; continue; }
+		if (opt == 'p') { opts.perf = true; continue; }
+		if (argi + 1 >= argc) { return usage(argv[0]); }
+		const char* val = argv[++argi];
+		switch (opt)
+		{
+		case 'f': if (!parse_list(val, format_names, NUM_FORMATS, &opts.formats)) { return usage(argv[0]); } break;
+		case 'm': if (!parse_list(val, mode_names, NUM_MODES, &opts.modes)) { return usage(argv[0]); } break;
+		case 'i': opts.iterations = (unsigned)atoi(val); break;
+		case 'w': opts.warmup = (unsigned)atoi(val); break;
+		case 'c': cpu = atoi(val); break;
+		case 't': opts.small_seconds = atoi(val) / 1000.0; break;
+		case 'g':
+			if (strcmp(val, "all") == 0) { families = (1u << CORPUS_COUNT) - 1; }
+			else if (!parse_list(val, corpus_names, CORPUS_COUNT, &families)) { return usage(argv[0]); }
+			break;
+		case 'z': if (!parse_sizes(val, sizes, &nsizes)) { return usage(argv[0]); } break;
+		case 'r': seed = strtoull(val, NULL, 10); break;
+		case 'o': out_dir = val; break;
+		case 'j': json_path = val; break;
+		default: return usage(argv[0]);
+		}
+	}
+	if (opts.iterations == 0) { return usage(argv[0]); }
+	if (families == 0 && (argi == argc || out_dir)) { families = 1u << CORPUS_TEXT; }
+
+	// Only write the generated data
+	if (out_dir)
+	{
+		for (size_t g = 0; g < CORPUS_COUNT; ++g)
+		{
+			if (!(families & (1u << g))) { continue; }
+			for (size_t s = 0; s < nsizes; ++s)
+			{
+				char size[16], path[1024];
+				size_name(size, sizeof(size), sizes[s]);
+				snprintf(path, sizeof(path), "%s/%s-%s", out_dir, corpus_names[g], size);
+				bytes data = (bytes)malloc(sizes[s]);
+				if (data == NULL) { fprintf(stderr, "Out of memory\n"); return 1; }
+				corpus_generate((CorpusFamily)g, seed, data, sizes[s]);
+				FILE* f = fopen(path, "wb");
+				const bool ok = f != NULL && fwrite(data, 1, sizes[s], f) == sizes[s];
+				if (f != NULL && fclose(f) != 0) { fprintf(stderr, "Could not write %s\n", path); free(data); return 1; }
+				free(data);
+				if (!ok) { fprintf(stderr, "Could not write %s\n", path); return 1; }
+			}
+		}
+		return 0;
+	}
+
+	if (cpu >= 0 && !pin_cpu(cpu)) { fprintf(stderr, "Could not pin to processor %d\n", cpu); return 1; }
+
+	json j = { NULL, true }, *jp = NULL;
+	if (json_path)
+	{
+		j.f = strcmp(json_path, "-") == 0 ? stdout : fopen(json_path, "w");
+		if (j.f == NULL) { fprintf(stderr, "Could not open %s\n", json_path); return 1; }
+		jp = &j;
+		fprintf(j.f, "{\"iterations\": %u, \"warmup\": %u, \"cpu\": %d, \"seed\": %llu,\n\"files\": [\n", opts.iterations, opts.warmup, cpu, seed);
+	}
+	// When JSON goes to stdout the tables go to stderr
+	tables = (j.f == stdout) ? stderr : stdout;
+
+	mscomp_context* ctx;
+	if (ms_context_create(&ctx) != MSCOMP_OK) { fprintf(stderr, "Could not create context\n"); return 1; }
+
+	perf perf_counters, *pp = NULL;
+	if (opts.perf)
+	{
+		if (!perf_open(&perf_counters)) { fprintf(stderr, "Hardware performance counters are not available\n"); }
+		else
+		{
+			pp = &perf_counters;
+			if (ms_set_phase_hook(NULL, NULL) != MSCOMP_OK) { fprintf(stderr, "The library was compiled without MSCOMP_WITH_PHASES, only totals are available\n"); }
+		}
+	}
+
+	// The largest data is kept for the small buffers
+	bytes small_data = NULL;
+	size_t small_len = 0;
+	int result = 0;
+	for (size_t g = 0; g < CORPUS_COUNT && result == 0; ++g)
+	{
+		if (!(families & (1u << g))) { continue; }
+		for (size_t s = 0; s < nsizes && result == 0; ++s)
+		{
+			const size_t len = sizes[s];
+			char size[16], name[64];
+			size_name(size, sizeof(size), len);
+			snprintf(name, sizeof(name), "%s-%s", corpus_names[g], size);
+			bytes data = (bytes)malloc(len);
+			if (data == NULL) { fprintf(stderr, "Out of memory\n"); result = 1; break; }
+			corpus_generate((CorpusFamily)g, seed, data, len);
+			result = bench_file(&opts, jp, pp, name, data, len, ctx);
+			if (len > small_len) { free(small_data); small_data = data; small_len = len; } else { free(data); }
+		}
+	}
+	for (int i = argi; i < argc && result == 0; ++i)
+	{
+		size_t len;
+		bytes data = read_file(argv[i], &len);
+		if (data == NULL) { fprintf(stderr, "Could not read %s\n", argv[i]); result = 1; break; }
+		result = bench_file(&opts, jp, pp, argv[i], data, len, ctx);
+		if (len > small_len) { free(small_data); small_data = data; small_len = len; } else { free(data); }
+	}
+	if (jp) { j.first = true; fputs("\n],\n\"small\": [\n", j.f); }
+	if (result == 0 && opts.small) { result = bench_small(&opts, jp, small_data, small_len, ctx); }
+	if (jp) { fputs("\n]}\n", j.f); if (j.f != stdout) { fclose(j.f); } }
+
+	free(small_data);
+	ms_context_free(ctx);
+	return result;
+}
@@ -0,0 +1,223 @@
+// ms-compress: implements Microsoft compression algorithms
+// Copyright (C) 2012  Jeffrey Bush  jeff@coderforlife.com
+//
+// This library is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This library is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+
+/////////////////// Synthetic Corpus ///////////////////////////////////////////
+// Deterministic data for benchmarks that cannot download the usual corpora. Each family imitates a
+// kind of data the formats are used for:
+//   text     English-like words with punctuation, numbers, and paragraphs
+//   binary   fixed-size little-endian records (ids, timestamps, small enums, names, hashes)
+//   pages    4 KB pages like a hibernation file: mostly zero pages along with sparse pointer
+//            tables, records, text, and already compressed pages
+//   random   incompressible bytes
+//   logs     highly repetitive timestamped log lines from a few templates
+//   mixed    4 to 64 KB runs of all of the other families
+//
+// The data only depends on the family and the seed, never on the platform (it uses its own random
+// number generator and byte order), and shorter data is always the start of longer data with the
+// same family and seed.
+
+#ifndef MSCOMP_CORPUS_H
+#define MSCOMP_CORPUS_H
+
+#include "../include/mscomp.h"
+
+#include <stdio.h>
+#include <string.h>
+
+enum CorpusFamily { CORPUS_TEXT, CORPUS_BINARY, CORPUS_PAGES, CORPUS_RANDOM, CORPUS_LOGS, CORPUS_MIXED, CORPUS_COUNT };
+static const char* const corpus_names[CORPUS_COUNT] = { "text", "binary", "pages", "random", "logs", "mixed" };
+
+///// Random Numbers /////
+// xorshift64* seeded with splitmix64
+struct corpus_rng { uint64_t s; };
+static void corpus_seed(corpus_rng* r, uint64_t seed)
+{
+	uint64_t z = seed + 0x9E3779B97F4A7C15ull;
+	z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ull;
+	z = (z ^ (z >> 27)) * 0x94D049BB133111EBull;
+	r->s = (z ^ (z >> 31)) | 1; // never 0
+}
+static uint64_t corpus_next(corpus_rng* r)
+{
+	r->s ^= r->s >> 12; r->s ^= r->s << 25; r->s ^= r->s >> 27;
+	return r->s * 0x2545F4914F6CDD1Dull;
+}
+// A number from 0 to n-1
+static uint32_t corpus_below(corpus_rng* r, uint32_t n) { return (uint32_t)(((corpus_next(r) >> 32) * n) >> 32); }
+
+// Copies as much of the string as fits, returning the new position
+static size_t corpus_put(bytes out, size_t i, size_t len, const char* s, size_t n)
+{
+	if (n > len - i) { n = len - i; }
+	memcpy(out + i, s, n);
+	return i + n;
+}
+static void corpus_le(bytes p, uint64_t x, size_t n) { for (size_t i = 0; i < n; ++i) { p[i] = (byte)(x >> (8 * i)); } }
+
+///// Families /////
+static void corpus_text(corpus_rng* r, bytes out, size_t len)
+{
+	static const char* const words[] = {
+		"the", "of", "and", "to", "a", "in", "is", "it", "that", "was", "for", "on", "are", "with", "as",
+		"be", "at", "one", "have", "this", "from", "by", "not", "but", "what", "all", "were", "when",
+		"we", "there", "can", "an", "your", "which", "their", "said", "if", "will", "each", "about",
+		"how", "up", "out", "them", "then", "she", "many", "some", "so", "these", "would", "other",
+		"into", "has", "more", "her", "two", "like", "him", "see", "time", "could", "no", "make",
+		"than", "first", "been", "its", "who", "now", "people", "my", "made", "over", "did", "down",
+		"only", "way", "find", "use", "may", "water", "long", "little", "very", "after", "words",
+		"called", "just", "where", "most", "know", "compression", "window", "dictionary", "stream",
+	};
+	const uint32_t nwords = (uint32_t)(sizeof(words) / sizeof(words[0]));
+	size_t i = 0;
+	bool start = true;
+	uint32_t sentences = 0;
+	while (i < len)
+	{
+		char buf[32];
+		size_t n;
+		if (corpus_below(r, 24) == 0) { n = (size_t)snprintf(buf, sizeof(buf), "%u", corpus_below(r, 2030)); }
+		else
+		{
+			// The minimum of two picks makes the early words more common, like real text
+			const uint32_t a = corpus_below(r, nwords), b = corpus_below(r, nwords);
+			const char* w = words[a < b ? a : b];
+			n = strlen(w);
+			memcpy(buf, w, n);
+			if (start && buf[0] >= 'a' && buf[0] <= 'z') { buf[0] = (char)(buf[0] - 'a' + 'A'); }
+		}
+		start = false;
+		const uint32_t p = corpus_below(r, 100);
+		if (p < 8) { buf[n++] = '.'; start = true; ++sentences; }
+		else if (p < 13) { buf[n++] = ','; }
+		if (start && sentences % 6 == 0) { buf[n++] = '\n'; buf[n++] = '\n'; }
+		else { buf[n++] = ' '; }
+		i = corpus_put(out, i, len, buf, n);
+	}
+}
+
+static void corpus_binary(corpus_rng* r, bytes out, size_t len)
+{
+	static const char names[16][8] = {
+		"alpha", "beta", "gamma", "delta", "epsilon", "zeta", "eta", "theta",
+		"iota", "kappa", "lambda", "mu", "nu", "xi", "omicron", "pi",
+	};
+	uint32_t id = corpus_below(r, 100000), time = 1500000000 + corpus_below(r, 100000000);
+	int32_t value = 0;
+	for (size_t i = 0; i < len; )
+	{
+		byte rec[32];
+		corpus_le(rec +  0, id++, 4);
+		corpus_le(rec +  4, time += 1 + corpus_below(r, 16), 4);
+		corpus_le(rec +  8, corpus_below(r, 8), 2);
+		corpus_le(rec + 10, (uint64_t)1 << corpus_below(r, 4), 2);
+		corpus_le(rec + 12, (uint32_t)(value += (int32_t)corpus_below(r, 201) - 100), 4);
+		memcpy(rec + 16, names[corpus_below(r, 16)], 8);
+		corpus_le(rec + 24, corpus_next(r), 4); // a hash, incompressible
+		corpus_le(rec + 28, 0, 4);
+		i = corpus_put(out, i, len, (const char*)rec, sizeof(rec));
+	}
+}
+
+static void corpus_random(corpus_rng* r, bytes out, size_t len)
+{
+	for (size_t i = 0; i < len; i += 8)
+	{
+		byte x[8];
+		corpus_le(x, corpus_next(r), 8);
+		memcpy(out + i, x, len - i < 8 ? len - i : 8);
+	}
+}
+
+static void corpus_pages(corpus_rng* r, bytes out, size_t len)
+{
+	for (size_t i = 0; i < len; i += 0x1000)
+	{
+		const size_t n = len - i < 0x1000 ? len - i : 0x1000;
+		const uint32_t kind = corpus_below(r, 100);
+		if (kind < 55) { memset(out + i, 0, n); } // unused memory
+		else if (kind < 70) // page tables and other sparse pointers
+		{
+			byte page[0x1000];
+			memset(page, 0, sizeof(page));
+			for (uint32_t k = corpus_below(r, 64); k; --k)
+			{
+				corpus_le(page + 8 * corpus_below(r, 0x200), 0x00007F0000000000ull | ((uint64_t)corpus_below(r, 0x100000) << 12) | 0x67, 8);
+			}
+			memcpy(out + i, page, n);
+		}
+		else if (kind < 85) { corpus_binary(r, out + i, n); }
+		else if (kind < 95) { corpus_text(r, out + i, n); }
+		else { corpus_random(r, out + i, n); } // already compressed or encrypted
+	}
+}
+
+static void corpus_logs(corpus_rng* r, bytes out, size_t len)
+{
+	static const char* const paths[] = { "/api/v1/items", "/api/v1/users", "/api/v1/orders", "/health", "/static/app.js" };
+	uint64_t ms = corpus_below(r, 86400000);
+	for (size_t i = 0; i < len; )
+	{
+		char ts[32], line[192];
+		ms += corpus_below(r, 50);
+		const uint32_t day = 1 + (uint32_t)(ms / 86400000 % 28), t = (uint32_t)(ms % 86400000);
+		snprintf(ts, sizeof(ts), "2024-01-%02uT%02u:%02u:%02u.%03uZ", day, t / 3600000, t / 60000 % 60, t / 1000 % 60, t % 1000);
+		const uint32_t kind = corpus_below(r, 100), worker = corpus_below(r, 8);
+		int n;
+		if (kind < 60) { n = snprintf(line, sizeof(line), "%s INFO  [worker-%u] GET %s/%u 200 %u bytes in %u ms\n", ts, worker, paths[corpus_below(r, 5)], corpus_below(r, 10000), 200 + corpus_below(r, 8000), 1 + corpus_below(r, 40)); }
+		else if (kind < 80) { n = snprintf(line, sizeof(line), "%s INFO  [worker-%u] POST /api/v1/orders 201 %u bytes in %u ms\n", ts, worker, 100 + corpus_below(r, 400), 5 + corpus_below(r, 80)); }
+		else if (kind < 90) { n = snprintf(line, sizeof(line), "%s WARN  [worker-%u] slow query on table items took %u ms\n", ts, worker, 500 + corpus_below(r, 3000)); }
+		else if (kind < 97) { n = snprintf(line, sizeof(line), "%s DEBUG [cache] hit ratio %u.%02u%% (%u entries)\n", ts, 80 + corpus_below(r, 20), corpus_below(r, 100), 10000 + corpus_below(r, 1000)); }
+		else { n = snprintf(line, sizeof(line), "%s ERROR [worker-%u] connection reset by peer (retry %u of 3)\n", ts, worker, 1 + corpus_below(r, 3)); }
+		i = corpus_put(out, i, len, line, (size_t)n);
+	}
+}
+
+static void corpus_family(CorpusFamily family, corpus_rng* r, bytes out, size_t len);
+static void corpus_mixed(corpus_rng* r, bytes out, size_t len)
+{
+	for (size_t i = 0; i < len; )
+	{
+		const CorpusFamily family = (CorpusFamily)corpus_below(r, CORPUS_MIXED);
+		size_t n = 0x1000 + corpus_below(r, 0xF001);
+		if (n > len - i) { n = len - i; }
+		corpus_family(family, r, out + i, n);
+		i += n;
+	}
+}
+
+static void corpus_family(CorpusFamily family, corpus_rng* r, bytes out, size_t len)
+{
+	switch (family)
+	{
+	case CORPUS_TEXT:	corpus_text(r, out, len); break;
+	case CORPUS_BINARY:	corpus_binary(r, out, len); break;
+	case CORPUS_PAGES:	corpus_pages(r, out, len); break;
+	case CORPUS_RANDOM:	corpus_random(r, out, len); break;
+	case CORPUS_LOGS:	corpus_logs(r, out, len); break;
+	default:			corpus_mixed(r, out, len); break;
+	}
+}
+
+// Fills out with len bytes of the family, different seeds give different data
+static void corpus_generate(CorpusFamily family, uint64_t seed, bytes out, size_t len)
+{
+	corpus_rng r;
+	corpus_seed(&r, seed * CORPUS_COUNT + family);
+	corpus_family(family, &r, out, len);
+}
+
+#endif
@@ -0,0 +1,849 @@
+// ms-compress: implements Microsoft compression algorithms
+// Copyright (C) 2012  Jeffrey Bush  jeff@coderforlife.com
+//
+// This library is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This library is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+
+/////////////////// Tests //////////////////////////////////////////////////////
+// mscomp_test
+//
+// Behavioral tests of the library entry points. Every test compresses generated data with each
+// format and checks that the data comes back out, and that truncated and corrupted input gives
+// the same result (output or error) as ms_decompress. Each failed check is printed and the exit
+// code is 1 if anything failed.
+//
+// The generated data is deterministic so a failure can always be reproduced.
+
+#include "../include/mscomp.h"
+
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+static const MSCompFormat formats[] = { MSCOMP_NONE, MSCOMP_LZNT1, MSCOMP_XPRESS, MSCOMP_XPRESS_HUFF };
+static const char* const format_names[] = { "none", "", "lznt1", "xpress", "xpress-huff" };
+#define NUM_FORMATS (sizeof(formats) / sizeof(formats[0]))
+
+static const size_t sizes[] = { 1, 7, 100, 4095, 4096, 4097, 10000, 65536, 65537, 131072, 200000 };
+#define NUM_SIZES (sizeof(sizes) / sizeof(sizes[0]))
+
+// Zero is all zeros and run is a single repeated byte up to a different last byte, so both have chunks
+// that are a single repeated byte (including runs that continue across 64 KB chunks)
+enum Kind { KIND_TEXT, KIND_LOW, KIND_RANDOM, KIND_SPARSE, KIND_ZERO, KIND_RUN, NUM_KINDS };
+static const char* const kind_names[] = { "text", "low", "random", "sparse", "zero", "run" };
+
+static unsigned failures = 0;
+#define CHECK(cond, ...) do { if (!(cond)) { ++failures; printf("%s:%d: ", __FILE__, __LINE__); printf(__VA_ARGS__); printf("\n"); } } while (0)
+
+///// Data /////
+static uint32_t rng_state = 1;
+static uint32_t rng() { rng_state ^= rng_state << 13; rng_state ^= rng_state >> 17; rng_state ^= rng_state << 5; return rng_state; }
+
+static void generate(bytes data, size_t len, Kind kind)
+{
+	static const char* const words[] = { "the", "of", "and", "compression", "data", "window", "offset", "length", "match", "literal" };
+	rng_state = 0x9E3779B9 ^ (uint32_t)len ^ ((uint32_t)kind << 24);
+	size_t i = 0;
+	while (i < len)
+	{
+		switch (kind)
+		{
+		case KIND_TEXT:
+			for (const char* w = words[rng() % 10]; *w && i < len; ++w) { data[i++] = (byte)*w; }
+			if (i < len) { data[i++] = ' '; }
+			break;
+		case KIND_LOW:    data[i++] = (byte)(rng() % 4); break;
+		case KIND_RANDOM: data[i++] = (byte)rng(); break;
+		case KIND_SPARSE: data[i++] = (rng() % 64) ? 0 : (byte)rng(); break;
+		case KIND_ZERO:   data[i++] = 0; break;
+		default:          data[i] = (i == len - 1) ? 'b' : 'a'; ++i; break;
+		}
+	}
+}
+
+// Compresses the data into a new buffer that has MSCOMP_DECOMPRESS_SLACK bytes after it
+static bytes compress(MSCompFormat format, const_bytes data, size_t len, size_t* comp_len)
+{
+	*comp_len = ms_max_compressed_size(format, len);
+	bytes comp = (bytes)malloc(*comp_len + MSCOMP_DECOMPRESS_SLACK);
+	MSCompStatus status = ms_compress(format, data, len, comp, comp_len);
+	CHECK(status == MSCOMP_OK, "%s: compressing %zu bytes failed: %d", format_names[format], len, status);
+	if (status != MSCOMP_OK) { free(comp); return NULL; }
+	return comp;
+}
+
+// Damages a copy of compressed data in the ways the tests use: truncation and single bit flips
+static unsigned num_damages(MSCompFormat format) { (void)format; return 8; }
+static size_t damage(bytes comp, size_t comp_len, unsigned i)
+{
+	if (i < 4) { return comp_len * i / 4; }
+	comp[rng() % comp_len] ^= (byte)(1 << (rng() % 8));
+	return comp_len;
+}
+
+///// Slack /////
+static void test_slack(MSCompFormat format, const_bytes data, size_t len, const_bytes comp, size_t comp_len)
+{
+	// Round trip, with the slack after the exact decompressed size
+	bytes out = (bytes)malloc(len + MSCOMP_DECOMPRESS_SLACK);
+	size_t out_len = len;
+	MSCompStatus status = ms_decompress_slack(format, comp, comp_len, out, &out_len);
+	CHECK(status == MSCOMP_OK && out_len == len && memcmp(out, data, len) == 0, "%s: slack round trip of %zu bytes failed: %d", format_names[format], len, status);
+
+	// A short output buffer
+	out_len = len - 1;
+	status = ms_decompress_slack(format, comp, comp_len, out, &out_len);
+	CHECK(status == MSCOMP_BUF_ERROR, "%s: slack with a short buffer gave %d", format_names[format], status);
+	free(out);
+
+	// Damaged input gives the same result as ms_decompress (except the LZNT1 buffer error, see mscomp.h)
+	bytes bad = (bytes)malloc(comp_len + MSCOMP_DECOMPRESS_SLACK);
+	bytes out1 = (bytes)malloc(2*len + MSCOMP_DECOMPRESS_SLACK), out2 = (bytes)malloc(2*len + MSCOMP_DECOMPRESS_SLACK);
+	for (unsigned i = 0; i < num_damages(format); ++i)
+	{
+		memcpy(bad, comp, comp_len);
+		const size_t bad_len = damage(bad, comp_len, i);
+		size_t len1 = 2*len, len2 = 2*len;
+		const MSCompStatus s1 = ms_decompress      (format, bad, bad_len, out1, &len1);
+		const MSCompStatus s2 = ms_decompress_slack(format, bad, bad_len, out2, &len2);
+		const bool same = s1 == s2 || (format == MSCOMP_LZNT1 && s1 == MSCOMP_DATA_ERROR && s2 == MSCOMP_BUF_ERROR);
+		CHECK(same && (s1 != MSCOMP_OK || (len1 == len2 && memcmp(out1, out2, len1) == 0)),
+			"%s: damaged input %u of %zu bytes: ms_decompress gave %d and slack gave %d", format_names[format], i, len, s1, s2);
+	}
+	free(bad); free(out1); free(out2);
+}
+
+///// In-Place /////
+static void test_inplace(MSCompFormat format, const_bytes data, size_t len, const_bytes comp, size_t comp_len)
+{
+	// Round trip with the margin
+	const size_t buf_len = len + ms_inplace_margin(format, comp_len);
+	bytes buf = (bytes)malloc(buf_len);
+	memcpy(buf + buf_len - comp_len, comp, comp_len);
+	size_t out_len = buf_len;
+	MSCompStatus status = ms_decompress_inplace(format, buf, comp_len, &out_len);
+	CHECK(status == MSCOMP_OK && out_len == len && memcmp(buf, data, len) == 0, "%s: in-place round trip of %zu bytes failed: %d", format_names[format], len, status);
+
+	// Without the margin it either works or reports a buffer error, never bad output
+	if (comp_len <= len)
+	{
+		memcpy(buf + len - comp_len, comp, comp_len);
+		out_len = len;
+		status = ms_decompress_inplace(format, buf, comp_len, &out_len);
+		CHECK((status == MSCOMP_OK && out_len == len && memcmp(buf, data, len) == 0) || status == MSCOMP_BUF_ERROR,
+			"%s: in-place without a margin of %zu bytes gave %d", format_names[format], len, status);
+	}
+
+	// Input longer than the buffer
+	out_len = comp_len - 1;
+	CHECK(ms_decompress_inplace(format, buf, comp_len, &out_len) == MSCOMP_ARG_ERROR, "%s: in-place input longer than the buffer was accepted", format_names[format]);
+	free(buf);
+
+	// Damaged input only succeeds when ms_decompress succeeds, with the same output
+	bytes bad = (bytes)malloc(comp_len);
+	for (unsigned i = 0; i < num_damages(format); ++i)
+	{
+		memcpy(bad, comp, comp_len);
+		const size_t bad_len = damage(bad, comp_len, i);
+		// both get the same room since damaged input can decompress to more than the original
+		const size_t buf2_len = 2*len + ms_inplace_margin(format, bad_len);
+		bytes out = (bytes)malloc(buf2_len), buf2 = (bytes)malloc(buf2_len);
+		size_t len1 = buf2_len;
+		const MSCompStatus s1 = ms_decompress(format, bad, bad_len, out, &len1);
+		memcpy(buf2 + buf2_len - bad_len, bad, bad_len);
+		size_t len2 = buf2_len;
+		const MSCompStatus s2 = ms_decompress_inplace(format, buf2, bad_len, &len2);
+		CHECK(s2 != MSCOMP_OK || (s1 == MSCOMP_OK && len1 == len2 && memcmp(out, buf2, len1) == 0),
+			"%s: damaged input %u of %zu bytes: ms_decompress gave %d and in-place gave %d", format_names[format], i, len, s1, s2);
+		free(out); free(buf2);
+	}
+	free(bad);
+}
+
+///// Validation /////
+// Validation agrees with decompression on both good and damaged data
+static void test_validate(MSCompFormat format, const_bytes data, size_t len, const_bytes comp, size_t comp_len)
+{
+	size_t val_len = 0;
+	MSCompStatus status = ms_validate(format, comp, comp_len, &val_len);
+	CHECK(status == MSCOMP_OK && val_len == len, "%s: validation of %zu bytes failed: %d (%zu bytes)", format_names[format], len, status, val_len);
+
+	bytes bad = (bytes)malloc(comp_len), out = (bytes)malloc(len);
+	for (unsigned i = 0; i < num_damages(format); ++i)
+	{
+		memcpy(bad, comp, comp_len);
+		const size_t bad_len = damage(bad, comp_len, i);
+		size_t out_len = len;
+		const MSCompStatus dec = ms_decompress(format, bad, bad_len, out, &out_len);
+		const MSCompStatus val = ms_validate(format, bad, bad_len, &val_len);
+		if (dec == MSCOMP_OK) { CHECK(val == MSCOMP_OK && val_len == out_len, "%s: validation of damaged data gave %d (%zu bytes) instead of %zu bytes", format_names[format], val, val_len, out_len); }
+		else if (dec == MSCOMP_DATA_ERROR)
+		{
+			// ms_decompress reports an LZNT1 output that does not fit as a data error (see test_slack)
+			const bool too_long = format == MSCOMP_LZNT1 && val == MSCOMP_OK && val_len > len;
+			CHECK(val == MSCOMP_DATA_ERROR || too_long, "%s: validation of damaged data gave %d instead of %d", format_names[format], val, dec);
+		}
+		if (val == MSCOMP_OK && val_len <= len) { CHECK(dec == MSCOMP_OK, "%s: decompression of validated damaged data of %zu bytes failed: %d", format_names[format], val_len, dec); }
+	}
+	free(bad); free(out);
+}
+
+///// Streaming /////
+#define MIN(a, b) (((a) < (b)) ? (a) : (b))
+#define MAX(a, b) (((a) > (b)) ? (a) : (b))
+
+typedef MSCompStatus (*inflate_init_func)(MSCompFormat format, mscomp_stream* stream);
+static const inflate_init_func inflate_inits[] = { ms_inflate_init, ms_inflate_init_contiguous };
+static const char* const inflate_init_names[] = { "stream", "contiguous stream" };
+
+// Inflates in steps of at most in_step bytes of input and out_step bytes of output (0 for no limit)
+// The output is always written directly after the previous output so it is contiguous
+static MSCompStatus inflate_all(mscomp_stream* stream, const_bytes comp, size_t comp_len, size_t in_step, size_t out_step, bytes out, size_t* out_len)
+{
+	MSCompStatus status;
+	size_t in_pos = 0, out_pos = 0;
+	do
+	{
+		stream->in = comp + in_pos;
+		stream->in_avail = in_step ? MIN(in_step, comp_len - in_pos) : comp_len - in_pos;
+		do
+		{
+			stream->out = out + out_pos;
+			stream->out_avail = out_step ? MIN(out_step, *out_len - out_pos) : *out_len - out_pos;
+			const size_t out_avail = stream->out_avail;
+			status = ms_inflate(stream);
+			if (status < 0) { return status; }
+			out_pos += out_avail - stream->out_avail;
+		} while (stream->out_avail == 0 && out_pos < *out_len);
+		const size_t consumed = (stream->in - comp) - in_pos;
+		in_pos += consumed;
+		// once the output is full keep feeding the trailing input until no more is taken
+		if (consumed == 0 && out_pos == *out_len) { break; }
+	} while (in_pos < comp_len && status != MSCOMP_STREAM_END);
+	*out_len = out_pos;
+	return MSCOMP_OK;
+}
+static MSCompStatus inflate_stream(inflate_init_func init, MSCompFormat format, const_bytes comp, size_t comp_len, size_t in_step, size_t out_step, bytes out, size_t* out_len)
+{
+	mscomp_stream stream;
+	MSCompStatus status = init(format, &stream);
+	if (status != MSCOMP_OK) { return status; }
+	status = inflate_all(&stream, comp, comp_len, in_step, out_step, out, out_len);
+	const MSCompStatus end_status = ms_inflate_end(&stream);
+	return status == MSCOMP_OK ? end_status : status;
+}
+
+// Deflates all of the data in steps of at most out_step bytes of output
+static MSCompStatus deflate_all(mscomp_stream* stream, const_bytes data, size_t len, size_t out_step, bytes out, size_t* out_len)
+{
+	MSCompStatus status;
+	size_t out_pos = 0;
+	stream->in = data;
+	stream->in_avail = len;
+	do
+	{
+		stream->out = out + out_pos;
+		stream->out_avail = MIN(out_step, *out_len - out_pos);
+		const size_t out_avail = stream->out_avail;
+		status = ms_deflate(stream, MSCOMP_FINISH);
+		if (status < 0) { return status; }
+		out_pos += out_avail - stream->out_avail;
+	} while (status != MSCOMP_STREAM_END && out_pos < *out_len);
+	*out_len = out_pos;
+	return status == MSCOMP_STREAM_END ? MSCOMP_OK : MSCOMP_BUF_ERROR;
+}
+
+static void test_stream(MSCompFormat format, const_bytes data, size_t len, const_bytes comp, size_t comp_len)
+{
+	static const size_t steps[][2] = { { 0, 0 }, { 0, 1 }, { 0, 7 }, { 0, 0x1001 }, { 1, 0 }, { 3, 0 }, { 5, 11 } };
+	bytes out = (bytes)malloc(len);
+	for (size_t m = 0; m < 2; ++m)
+	{
+		for (size_t i = 0; i < sizeof(steps) / sizeof(steps[0]); ++i)
+		{
+			size_t out_len = len;
+			const MSCompStatus status = inflate_stream(inflate_inits[m], format, comp, comp_len, steps[i][0], steps[i][1], out, &out_len);
+			CHECK(status == MSCOMP_OK && out_len == len && memcmp(out, data, len) == 0,
+				"%s: %s round trip of %zu bytes in steps of %zu and %zu bytes failed: %d", format_names[format], inflate_init_names[m], len, steps[i][0], steps[i][1], status);
+		}
+	}
+	free(out);
+
+	// Damaged input gives the same result in both modes
+	bytes bad = (bytes)malloc(comp_len), out1 = (bytes)malloc(2*len), out2 = (bytes)malloc(2*len);
+	for (unsigned i = 0; i < num_damages(format); ++i)
+	{
+		memcpy(bad, comp, comp_len);
+		const size_t bad_len = damage(bad, comp_len, i);
+		size_t len1 = 2*len, len2 = 2*len;
+		const MSCompStatus s1 = inflate_stream(ms_inflate_init,            format, bad, bad_len, 5, 11, out1, &len1);
+		const MSCompStatus s2 = inflate_stream(ms_inflate_init_contiguous, format, bad, bad_len, 5, 11, out2, &len2);
+		CHECK(s1 == s2 && (s1 != MSCOMP_OK || (len1 == len2 && memcmp(out1, out2, len1) == 0)),
+			"%s: damaged input %u of %zu bytes: stream gave %d and contiguous stream gave %d", format_names[format], i, len, s1, s2);
+	}
+	free(bad); free(out1); free(out2);
+}
+
+///// Reset /////
+// A stream that is reset part of the way through works like a new one
+static void test_reset(MSCompFormat format, const_bytes data, size_t len, const_bytes comp, size_t comp_len)
+{
+	mscomp_stream stream;
+	bytes out = (bytes)malloc(len);
+	for (size_t m = 0; m < 2; ++m)
+	{
+		if (inflate_inits[m](format, &stream) != MSCOMP_OK) { continue; }
+		size_t out_len = len / 2 + 1;
+		MSCompStatus status = inflate_all(&stream, comp, comp_len / 2, 0, 0, out, &out_len);
+		status = ms_inflate_reset(&stream, format);
+		CHECK(status == MSCOMP_OK, "%s: %s reset failed: %d", format_names[format], inflate_init_names[m], status);
+		out_len = len;
+		status = inflate_all(&stream, comp, comp_len, 0, 0, out, &out_len);
+		CHECK(status == MSCOMP_OK && out_len == len && memcmp(out, data, len) == 0,
+			"%s: %s round trip of %zu bytes after a reset failed: %d", format_names[format], inflate_init_names[m], len, status);
+		ms_inflate_end(&stream);
+	}
+	free(out);
+
+	if (ms_deflate_init(format, &stream) != MSCOMP_OK) { return; }
+	const size_t max_len = ms_max_compressed_size(format, len) + 0x100;
+	bytes comp2 = (bytes)malloc(max_len);
+	size_t comp2_len = max_len;
+	deflate_all(&stream, data, len / 2, 0x1000, comp2, &comp2_len);
+	MSCompStatus status = ms_deflate_reset(&stream, format);
+	CHECK(status == MSCOMP_OK, "%s: deflate reset failed: %d", format_names[format], status);
+	comp2_len = max_len;
+	status = deflate_all(&stream, data, len, 0x1000, comp2, &comp2_len);
+	CHECK(status == MSCOMP_OK, "%s: deflate of %zu bytes after a reset failed: %d", format_names[format], len, status);
+	ms_deflate_end(&stream);
+	if (status == MSCOMP_OK)
+	{
+		bytes out2 = (bytes)malloc(len);
+		size_t out2_len = len;
+		status = ms_decompress(format, comp2, comp2_len, out2, &out2_len);
+		CHECK(status == MSCOMP_OK && out2_len == len && memcmp(out2, data, len) == 0,
+			"%s: round trip of %zu bytes deflated after a reset failed: %d", format_names[format], len, status);
+		free(out2);
+	}
+	free(comp2);
+}
+
+///// Checksums /////
+static void test_checksum(MSCompFormat format, const_bytes data, size_t len, const_bytes comp, size_t comp_len)
+{
+	const uint32_t crc = ms_crc32c(0, data, len);
+	uint32_t checksum = 0;
+	const size_t max_len = ms_max_compressed_size(format, len) + 0x100;
+	bytes buf = (bytes)malloc(max_len > len ? max_len : len);
+	size_t buf_len = max_len;
+	MSCompStatus status = ms_compress_checksum(format, data, len, buf, &buf_len, &checksum);
+	CHECK(status == MSCOMP_OK && checksum == crc, "%s: checksum of %zu bytes while compressing is %08x instead of %08x: %d", format_names[format], len, checksum, crc, status);
+	buf_len = len; checksum = 0;
+	status = ms_decompress_checksum(format, comp, comp_len, buf, &buf_len, &checksum);
+	CHECK(status == MSCOMP_OK && checksum == crc, "%s: checksum of %zu bytes while decompressing is %08x instead of %08x: %d", format_names[format], len, checksum, crc, status);
+
+	mscomp_stream stream;
+#ifdef MSCOMP_WITH_STREAM_CHECKSUM
+	if (ms_inflate_init(format, &stream) == MSCOMP_OK)
+	{
+		ms_stream_set_checksum(&stream, true);
+		buf_len = len;
+		status = inflate_all(&stream, comp, comp_len, 5, 11, buf, &buf_len);
+		CHECK(status == MSCOMP_OK && stream.checksum == crc, "%s: inflate checksum of %zu bytes is %08x instead of %08x: %d", format_names[format], len, stream.checksum, crc, status);
+		ms_inflate_end(&stream);
+	}
+	if (ms_deflate_init(format, &stream) == MSCOMP_OK)
+	{
+		ms_stream_set_checksum(&stream, true);
+		buf_len = max_len;
+		status = deflate_all(&stream, data, len, 0x1000, buf, &buf_len);
+		CHECK(status == MSCOMP_OK && stream.checksum == crc, "%s: deflate checksum of %zu bytes is %08x instead of %08x: %d", format_names[format], len, stream.checksum, crc, status);
+		ms_deflate_end(&stream);
+	}
+#else
+	if (ms_inflate_init(format, &stream) == MSCOMP_OK)
+	{
+		status = ms_stream_set_checksum(&stream, true);
+		CHECK(status == MSCOMP_ARG_ERROR, "%s: stream checksums are not compiled in but enabling them returned %d", format_names[format], status);
+		stream.in = comp; stream.out = buf; // ending a stream requires buffers
+		ms_inflate_end(&stream);
+	}
+#endif
+	free(buf);
+}
+
+///// Estimates /////
+// Without sampling (or with too little data to sample) the estimate is exactly the compressed length
+static void test_estimate(MSCompFormat format, const_bytes data, size_t len, const_bytes comp, size_t comp_len)
+{
+	(void)comp;
+	static const unsigned ratios[] = { 0, 1, 16 };
+	for (size_t r = 0; r < sizeof(ratios) / sizeof(ratios[0]); ++r)
+	{
+		if (ratios[r] > 1 && (len + 0xFFFF) / 0x10000 / ratios[r] >= 2) { continue; }
+		size_t size = 0, error = 1;
+		const MSCompStatus status = ms_estimate_compressed_size(format, data, len, ratios[r], &size, &error);
+		CHECK(status == MSCOMP_OK && size == comp_len && error == 0, "%s: estimate of %zu bytes with a sample ratio of %u gave %d (%zu +/- %zu bytes) instead of %zu bytes",
+			format_names[format], len, ratios[r], status, size, error, comp_len);
+	}
+}
+
+// Sampling a large input gives an estimate with a nonzero error bound that the real length is within
+static void test_estimate_sampled()
+{
+	const size_t len = 0x400000;
+	bytes data = (bytes)malloc(len);
+	generate(data, len, KIND_TEXT);
+	for (size_t f = 0; f < NUM_FORMATS; ++f)
+	{
+		const MSCompFormat format = formats[f];
+		if (format == MSCOMP_NONE) { continue; }
+		size_t comp_len;
+		bytes comp = compress(format, data, len, &comp_len);
+		if (comp == NULL) { continue; }
+		size_t size = 0, error = 0;
+		const MSCompStatus status = ms_estimate_compressed_size(format, data, len, 16, &size, &error);
+		CHECK(status == MSCOMP_OK && error != 0 && size <= comp_len + error && comp_len <= size + error,
+			"%s: sampled estimate of %zu bytes gave %d (%zu +/- %zu bytes) instead of %zu bytes", format_names[format], len, status, size, error, comp_len);
+		free(comp);
+	}
+	free(data);
+}
+
+///// Automatic Format Selection /////
+static void test_auto()
+{
+	static const size_t auto_sizes[] = { 0, 100, 10000, 200000, 0x400000 };
+	const size_t max_len = auto_sizes[sizeof(auto_sizes) / sizeof(auto_sizes[0]) - 1];
+	size_t max_comp_len = max_len;
+	for (size_t f = 0; f < NUM_FORMATS; ++f) { max_comp_len = MAX(max_comp_len, ms_max_compressed_size(formats[f], max_len)); }
+	bytes data = (bytes)malloc(max_len), comp = (bytes)malloc(max_comp_len), out = (bytes)malloc(max_len);
+	mscomp_auto_options options = { MSCOMP_MAX_RATIO, 0.0, 0.0, 0 };
+	MSCompFormat format;
+
+	// Round trip with the reported format for both objectives, including sampled data
+	for (int k = 0; k < NUM_KINDS; ++k)
+	{
+		for (size_t s = 0; s < sizeof(auto_sizes) / sizeof(auto_sizes[0]); ++s)
+		{
+			const size_t len = auto_sizes[s];
+			generate(data, len, (Kind)k);
+			for (int o = 0; o < 2; ++o)
+			{
+				options.objective = o ? MSCOMP_MAX_SPEED : MSCOMP_MAX_RATIO; options.min_ratio = 2.0;
+				size_t comp_len = max_comp_len, out_len = len;
+				format = (MSCompFormat)-1;
+				MSCompStatus status = ms_compress_auto(data, len, comp, &comp_len, &options, &format);
+				CHECK(status == MSCOMP_OK && (format != MSCOMP_NONE ? comp_len <= ms_max_compressed_size(format, len) : comp_len == len),
+					"auto: compressing %s data of %zu bytes gave %d (%zu bytes as %d)", kind_names[k], len, status, comp_len, format);
+				if (status != MSCOMP_OK) { continue; }
+				status = ms_decompress(format, comp, comp_len, out, &out_len);
+				CHECK(status == MSCOMP_OK && out_len == len && memcmp(out, data, len) == 0,
+					"%s: auto round trip of %s data of %zu bytes failed: %d", format_names[format], kind_names[k], len, status);
+			}
+		}
+	}
+
+	// Incompressible data except for the middle, which is all that is tried when the data is too
+	// small to sample, chooses Xpress but its output does not fit so the data is stored instead
+	const size_t len = 0x40000, piece = len / 16;
+	generate(data, len, KIND_RANDOM);
+	memset(data + (len - piece) / 2, 0, piece);
+	options.objective = MSCOMP_MAX_RATIO;
+	size_t comp_len = max_comp_len;
+	MSCompStatus status = ms_compress_auto(data, len, comp, &comp_len, &options, &format);
+	CHECK(status == MSCOMP_OK && format == MSCOMP_XPRESS && comp_len > len, "auto: data that compresses only in the middle gave %d (%zu bytes as %d)", status, comp_len, format);
+	comp_len = len;
+	status = ms_compress_auto(data, len, comp, &comp_len, &options, &format);
+	CHECK(status == MSCOMP_OK && format == MSCOMP_NONE && comp_len == len && memcmp(comp, data, len) == 0,
+		"auto: storing data that does not fit gave %d (%zu bytes as %d)", status, comp_len, format);
+	comp_len = len - 1;
+	CHECK(ms_compress_auto(data, len, comp, &comp_len, &options, &format) == MSCOMP_BUF_ERROR, "auto: data that does not fit even when stored was accepted");
+
+	// Invalid arguments
+	comp_len = len;
+	CHECK(ms_compress_auto(data, len, comp, &comp_len, NULL, &format) == MSCOMP_ARG_ERROR, "auto: NULL options were accepted");
+	CHECK(ms_compress_auto(data, len, comp, NULL, &options, &format) == MSCOMP_ARG_ERROR, "auto: a NULL output length was accepted");
+	CHECK(ms_compress_auto(data, len, comp, &comp_len, &options, NULL) == MSCOMP_ARG_ERROR, "auto: a NULL format was accepted");
+	options.min_speed = -1.0;
+	CHECK(ms_compress_auto(data, len, comp, &comp_len, &options, &format) == MSCOMP_ARG_ERROR, "auto: a negative minimum speed was accepted");
+	options.min_speed = 0.0; options.min_ratio = NAN;
+	CHECK(ms_compress_auto(data, len, comp, &comp_len, &options, &format) == MSCOMP_ARG_ERROR, "auto: a NaN minimum ratio was accepted");
+
+	free(data); free(comp); free(out);
+}
+
+///// Contexts /////
+// A context reused for every format and for inputs that shrink and grow (past the point where Xpress
+// slides its window) compresses exactly like ms_compress, with and without an arena allocator
+static void test_context()
+{
+	static const size_t lens[] = { 1024, 200000, 64, 8192, 65536, 1000, 50000, 8000, 300000, 1024, 65537, 4096 };
+	const size_t max_len = 300000, arena_len = 0x800000;
+	size_t max_comp_len = 0;
+	for (size_t f = 0; f < NUM_FORMATS; ++f) { max_comp_len = MAX(max_comp_len, ms_max_compressed_size(formats[f], max_len)); }
+	bytes data = (bytes)malloc(max_len), out1 = (bytes)malloc(max_comp_len), out2 = (bytes)malloc(max_comp_len);
+	void* arena = malloc(arena_len);
+	for (int a = 0; a < 2; ++a)
+	{
+		mscomp_context* ctx = NULL;
+		mscomp_allocator allocator;
+		MSCompStatus status = a ? ms_arena_allocator(&allocator, arena, arena_len) : MSCOMP_OK;
+		if (status == MSCOMP_OK) { status = a ? ms_context_create_with_allocator(&ctx, &allocator) : ms_context_create(&ctx); }
+		CHECK(status == MSCOMP_OK, "creating a context%s failed: %d", a ? " with an arena" : "", status);
+		if (status != MSCOMP_OK) { continue; }
+		for (size_t i = 0; i < sizeof(lens) / sizeof(lens[0]); ++i)
+		{
+			const size_t len = lens[i];
+			generate(data, len, (Kind)(i % NUM_KINDS));
+			for (size_t f = 0; f < NUM_FORMATS; ++f)
+			{
+				const MSCompFormat format = formats[f];
+				size_t len1 = ms_max_compressed_size(format, len), len2 = len1;
+				const MSCompStatus s1 = ms_compress(format, data, len, out1, &len1);
+				const MSCompStatus s2 = ms_compress_ctx(ctx, format, data, len, out2, &len2);
+				CHECK(s1 == MSCOMP_OK && s2 == MSCOMP_OK && len1 == len2 && memcmp(out1, out2, len1) == 0,
+					"%s: compressing %s data of %zu bytes with a reused context%s differs: %d (%zu bytes) instead of %d (%zu bytes)",
+					format_names[format], kind_names[i % NUM_KINDS], len, a ? " with an arena" : "", s2, len2, s1, len1);
+			}
+		}
+		ms_context_free(ctx);
+	}
+	free(arena); free(data); free(out1); free(out2);
+}
+
+///// Statistics /////
+// With MSCOMP_WITH_STATS the counters see the work done, otherwise they are always zero
+static void test_stats()
+{
+	const size_t len = 100000;
+	bytes data = (bytes)malloc(len), out = (bytes)malloc(len);
+	generate(data, len, KIND_TEXT);
+	for (size_t f = 0; f < NUM_FORMATS; ++f)
+	{
+		const MSCompFormat format = formats[f];
+		size_t comp_len;
+		ms_get_stats(NULL, true);
+		bytes comp = compress(format, data, len, &comp_len);
+		if (comp == NULL) { continue; }
+		size_t out_len = len;
+		ms_decompress(format, comp, comp_len, out, &out_len);
+		mscomp_stats stats;
+		memset(&stats, 0xFF, sizeof(stats));
+		ms_get_stats(&stats, true);
+#ifdef MSCOMP_WITH_STATS
+		if (format != MSCOMP_NONE)
+		{
+			CHECK(stats.matches != 0 && stats.literals != 0 && stats.fast_bytes + stats.slow_bytes == len,
+				"%s: stats after a round trip of %zu bytes have %llu matches, %llu literals, and %llu bytes output", format_names[format], len,
+				(unsigned long long)stats.matches, (unsigned long long)stats.literals, (unsigned long long)(stats.fast_bytes + stats.slow_bytes));
+		}
+#else
+		static const mscomp_stats zero = { 0 };
+		CHECK(memcmp(&stats, &zero, sizeof(stats)) == 0, "%s: stats are not compiled in but are not zero", format_names[format]);
+#endif
+		free(comp);
+	}
+	free(data); free(out);
+}
+
+///// Tracing /////
+struct trace_count { MSCompFormat format; bool compressing; size_t chunks, in_len, out_len; };
+static void count_chunk(void* opaque, const mscomp_chunk_trace* trace)
+{
+	trace_count* count = (trace_count*)opaque;
+	if (trace->format != count->format || trace->compressing != count->compressing) { count->chunks = (size_t)-1; return; }
+	++count->chunks; count->in_len += trace->in_len; count->out_len += trace->out_len;
+}
+
+// With MSCOMP_WITH_TRACE the context and stream functions are called once per chunk, otherwise
+// setting them is refused
+static void test_trace()
+{
+	const size_t len = 100000;
+	bytes data = (bytes)malloc(len), out = (bytes)malloc(len);
+	generate(data, len, KIND_TEXT);
+	for (size_t f = 0; f < NUM_FORMATS; ++f)
+	{
+		const MSCompFormat format = formats[f];
+		size_t comp_len;
+		bytes comp = compress(format, data, len, &comp_len);
+		if (comp == NULL) { continue; }
+#ifdef MSCOMP_WITH_TRACE
+		// Only LZNT1 and Xpress Huffman work in chunks
+		const size_t chunk_size = format == MSCOMP_LZNT1 ? 0x1000 : format == MSCOMP_XPRESS_HUFF ? 0x10000 : 0;
+		const size_t chunks = chunk_size ? (len + chunk_size - 1) / chunk_size : 0;
+#endif
+		mscomp_context* ctx;
+		mscomp_stream stream;
+		trace_count count = { format, true, 0, 0, 0 };
+		if (ms_context_create(&ctx) == MSCOMP_OK)
+		{
+			MSCompStatus status = ms_context_set_trace(ctx, count_chunk, &count);
+#ifdef MSCOMP_WITH_TRACE
+			size_t comp2_len = ms_max_compressed_size(format, len);
+			bytes comp2 = (bytes)malloc(comp2_len);
+			if (status == MSCOMP_OK) { status = ms_compress_ctx(ctx, format, data, len, comp2, &comp2_len); }
+			CHECK(status == MSCOMP_OK && count.chunks == chunks && (!chunks || count.in_len == len),
+				"%s: context trace of %zu bytes saw %zu chunks of %zu bytes instead of %zu: %d", format_names[format], len, count.chunks, count.in_len, chunks, status);
+			free(comp2);
+#else
+			CHECK(status == MSCOMP_ARG_ERROR, "%s: tracing is not compiled in but setting a context trace returned %d", format_names[format], status);
+#endif
+			ms_context_free(ctx);
+		}
+		count.compressing = false; count.chunks = count.in_len = count.out_len = 0;
+		if (ms_inflate_init(format, &stream) == MSCOMP_OK)
+		{
+			MSCompStatus status = ms_stream_set_trace(&stream, count_chunk, &count);
+#ifdef MSCOMP_WITH_TRACE
+			size_t out_len = len;
+			if (status == MSCOMP_OK) { status = inflate_all(&stream, comp, comp_len, 0x1000, 0, out, &out_len); }
+			CHECK(status == MSCOMP_OK && count.chunks == chunks && (!chunks || count.out_len == len),
+				"%s: stream trace of %zu bytes saw %zu chunks of %zu bytes instead of %zu: %d", format_names[format], len, count.chunks, count.out_len, chunks, status);
+#else
+			CHECK(status == MSCOMP_ARG_ERROR, "%s: tracing is not compiled in but setting a stream trace returned %d", format_names[format], status);
+			stream.in = comp; stream.out = out; // ending a stream requires buffers
+#endif
+			ms_inflate_end(&stream);
+		}
+		free(comp);
+	}
+	free(data); free(out);
+}
+
+///// Batches /////
+// Every item of a batch gives exactly what the individual function gives for it
+static void test_batch(MSCompFormat format)
+{
+	static const unsigned threads[] = { 1, 4, 0 };
+	const size_t count = NUM_KINDS * NUM_SIZES;
+	mscomp_batch_item* items = (mscomp_batch_item*)malloc(count * sizeof(mscomp_batch_item));
+	bytes* datas = (bytes*)malloc(count * sizeof(bytes));
+	bytes* comps = (bytes*)malloc(count * sizeof(bytes));
+	size_t* comp_lens = (size_t*)malloc(count * sizeof(size_t));
+	for (size_t i = 0; i < count; ++i)
+	{
+		const size_t len = sizes[i % NUM_SIZES];
+		const Kind kind = (Kind)(i / NUM_SIZES);
+		generate(datas[i] = (bytes)malloc(len), len, kind);
+		comp_lens[i] = ms_max_compressed_size(format, len);
+		comps[i] = (bytes)malloc(comp_lens[i]);
+		CHECK(ms_compress(format, datas[i], len, comps[i], comp_lens + i) == MSCOMP_OK, "%s: compressing batch item %zu failed", format_names[format], i);
+	}
+
+	for (size_t t = 0; t < sizeof(threads) / sizeof(threads[0]); ++t)
+	{
+		// Compress, including one item without enough room
+		for (size_t i = 0; i < count; ++i)
+		{
+			const size_t len = sizes[i % NUM_SIZES];
+			items[i].in = datas[i]; items[i].in_len = len;
+			items[i].out_len = i == count / 2 ? comp_lens[i] / 2 : ms_max_compressed_size(format, len);
+			items[i].out = (bytes)malloc(items[i].out_len);
+		}
+		MSCompStatus status = ms_compress_batch(format, items, count, threads[t]);
+		CHECK(status == MSCOMP_BUF_ERROR && items[count / 2].status == MSCOMP_BUF_ERROR,
+			"%s: compressing a batch with %u threads with a short item gave %d", format_names[format], threads[t], status);
+		for (size_t i = 0; i < count; ++i)
+		{
+			if (i != count / 2)
+			{
+				CHECK(items[i].status == MSCOMP_OK && items[i].out_len == comp_lens[i] && memcmp(items[i].out, comps[i], comp_lens[i]) == 0,
+					"%s: batch item %zu compressed with %u threads differs: %d", format_names[format], i, threads[t], items[i].status);
+			}
+			free(items[i].out);
+		}
+
+		// Decompress, including one damaged item
+		for (size_t i = 0; i < count; ++i)
+		{
+			items[i].in = comps[i]; items[i].in_len = i == count / 3 ? comp_lens[i] / 2 : comp_lens[i];
+			items[i].out_len = sizes[i % NUM_SIZES];
+			items[i].out = (bytes)malloc(items[i].out_len);
+		}
+		status = ms_decompress_batch(format, items, count, threads[t]);
+		MSCompStatus expected = MSCOMP_OK;
+		for (size_t i = 0; i < count; ++i)
+		{
+			bytes out = (bytes)malloc(sizes[i % NUM_SIZES]);
+			size_t out_len = sizes[i % NUM_SIZES];
+			const MSCompStatus s = ms_decompress(format, items[i].in, items[i].in_len, out, &out_len);
+			CHECK(items[i].status == s && (s != MSCOMP_OK || (items[i].out_len == out_len && memcmp(items[i].out, out, out_len) == 0)),
+				"%s: batch item %zu decompressed with %u threads gave %d instead of %d", format_names[format], i, threads[t], items[i].status, s);
+			if (expected == MSCOMP_OK) { expected = s; }
+			free(out); free(items[i].out);
+		}
+		CHECK(status == expected, "%s: decompressing a batch with %u threads gave %d instead of %d", format_names[format], threads[t], status, expected);
+	}
+
+	CHECK(ms_compress_batch((MSCompFormat)1, items, count, 1) == MSCOMP_ARG_ERROR, "batch with an invalid format was accepted");
+	CHECK(ms_compress_batch(format, NULL, 1, 1) == MSCOMP_ARG_ERROR, "%s: batch without items was accepted", format_names[format]);
+	CHECK(ms_compress_batch(format, NULL, 0, 0) == MSCOMP_OK, "%s: empty batch failed", format_names[format]);
+
+	for (size_t i = 0; i < count; ++i) { free(datas[i]); free(comps[i]); }
+	free(items); free(datas); free(comps); free(comp_lens);
+}
+
+///// Executors /////
+// A pool created while an arena is the global allocator keeps working after the arena is gone
+static void test_pool_allocator()
+{
+	const size_t arena_len = 0x100000;
+	void* arena = malloc(arena_len);
+	mscomp_allocator allocator;
+	mscomp_executor pool;
+	CHECK(ms_arena_allocator(&allocator, arena, arena_len) == MSCOMP_OK && ms_set_allocator(&allocator) == MSCOMP_OK, "setting an arena allocator failed");
+	CHECK(ms_pool_create(&pool, 4) == MSCOMP_OK && ms_set_executor(&pool) == MSCOMP_OK, "creating a pool failed");
+	ms_set_allocator(NULL);
+	memset(arena, 0xCD, arena_len);
+	free(arena);
+
+	// Enough tasks for every queue to grow
+	const size_t count = 1000, len = 100;
+	byte data[len], outs[count][len];
+	generate(data, len, KIND_TEXT);
+	mscomp_batch_item* items = (mscomp_batch_item*)malloc(count * sizeof(mscomp_batch_item));
+	for (size_t i = 0; i < count; ++i) { items[i].in = data; items[i].in_len = len; items[i].out = outs[i]; items[i].out_len = len; }
+	for (int j = 0; j < 10; ++j)
+	{
+		const MSCompStatus status = ms_decompress_batch(MSCOMP_NONE, items, count, 200);
+		CHECK(status == MSCOMP_OK, "batch with a pool created with an arena gave %d", status);
+	}
+	free(items);
+	ms_set_executor(NULL);
+	ms_pool_free(&pool);
+}
+
+///// Runs /////
+// Chunks of a single repeated byte skip the dictionaries but give exactly the same output as before
+// that shortcut was added, which is pinned here by the size and CRC32C of the compressed data
+static void test_runs()
+{
+	static const MSCompFormat run_formats[] = { MSCOMP_LZNT1, MSCOMP_XPRESS, MSCOMP_XPRESS_HUFF };
+	static const struct { Kind kind; size_t len; struct { size_t len; uint32_t crc; } comp[3]; } expected[] =
+	{
+		{ KIND_ZERO,  65536, { {   96, 0x2A2B35BC }, {   12, 0xBBD5F08C }, {  267, 0x343DC015 } } },
+		{ KIND_ZERO,  65537, { {   99, 0xE99E8001 }, {   12, 0xC1B839C9 }, {  527, 0x80157F8C } } },
+		{ KIND_ZERO, 131072, { {  192, 0x1BCA8986 }, {   16, 0xD8D6AC87 }, {  530, 0xB1513B4F } } },
+		{ KIND_RUN,   65536, { {   97, 0xC821691B }, {   12, 0x6514C095 }, {  267, 0xD42F971C } } },
+		{ KIND_RUN,   65537, { {   99, 0xE52F9CF8 }, {   12, 0x1F7909D0 }, {  527, 0xE073A005 } } },
+		{ KIND_RUN,  131072, { {  193, 0x0F877B3B }, {   16, 0x3FAE4B48 }, {  530, 0x6468326F } } },
+		{ KIND_RUN,  200000, { {  295, 0x5245E820 }, {   16, 0x16D6773D }, { 1056, 0x79CE3B94 } } },
+	};
+	bytes data = (bytes)malloc(200000);
+	for (size_t i = 0; i < sizeof(expected) / sizeof(expected[0]); ++i)
+	{
+		const size_t len = expected[i].len;
+		generate(data, len, expected[i].kind);
+		for (size_t f = 0; f < sizeof(run_formats) / sizeof(run_formats[0]); ++f)
+		{
+			const MSCompFormat format = run_formats[f];
+			size_t comp_len;
+			ms_get_stats(NULL, true);
+			bytes comp = compress(format, data, len, &comp_len);
+			if (comp == NULL) { continue; }
+			const uint32_t crc = ms_crc32c(0, comp, comp_len);
+			CHECK(comp_len == expected[i].comp[f].len && crc == expected[i].comp[f].crc,
+				"%s: %s data of %zu bytes compressed to %zu bytes with CRC32C %08X instead of %zu bytes with %08X", format_names[format],
+				kind_names[expected[i].kind], len, comp_len, crc, expected[i].comp[f].len, expected[i].comp[f].crc);
+#ifdef MSCOMP_WITH_STATS
+			mscomp_stats stats;
+			ms_get_stats(&stats, true);
+			// the only Xpress Huffman chunk of 64 KB of run data ends with the different byte
+			const bool no_runs = format == MSCOMP_XPRESS || (format == MSCOMP_XPRESS_HUFF && expected[i].kind == KIND_RUN && len <= 0x10000);
+			CHECK(no_runs || stats.run_chunks != 0, "%s: %s data of %zu bytes had no run chunks", format_names[format], kind_names[expected[i].kind], len);
+#endif
+			free(comp);
+		}
+	}
+	free(data);
+}
+
+///// Regression Inputs /////
+static void test_lznt1_long_chunk()
+{
+	// A compressed chunk whose literals run past 4096 bytes: 'A', a match of 4090 bytes, then 30 more literals
+	// (the 16-bit fields are in the byte order the library reads on this platform, see internal.h)
+	static const byte chunk[] = { 0xB0, 0x24, 0x02, 'A', 0x0F, 0xF7, 'B', 'B', 'B', 'B', 'B', 'B',
+		0x00, 'C', 'C', 'C', 'C', 'C', 'C', 'C', 'C', 0x00, 'C', 'C', 'C', 'C', 'C', 'C', 'C', 'C', 0x00, 'C', 'C', 'C', 'C', 'C', 'C', 'C', 'C' };
+	const size_t buf_len = 0x2000 + MSCOMP_DECOMPRESS_SLACK;
+	bytes buf = (bytes)malloc(buf_len);
+	size_t out_len = 0x2000;
+	MSCompStatus status = ms_decompress(MSCOMP_LZNT1, chunk, sizeof(chunk), buf, &out_len);
+	CHECK(status == MSCOMP_DATA_ERROR, "lznt1: a chunk longer than 4096 bytes gave %d", status);
+	out_len = 0x2000;
+	status = ms_decompress_slack(MSCOMP_LZNT1, chunk, sizeof(chunk), buf, &out_len);
+	CHECK(status == MSCOMP_DATA_ERROR, "lznt1: slack with a chunk longer than 4096 bytes gave %d", status);
+	memcpy(buf + buf_len - sizeof(chunk), chunk, sizeof(chunk));
+	out_len = buf_len;
+	status = ms_decompress_inplace(MSCOMP_LZNT1, buf, sizeof(chunk), &out_len);
+	CHECK(status == MSCOMP_DATA_ERROR, "lznt1: in-place with a chunk longer than 4096 bytes gave %d", status);
+	free(buf);
+}
+
+int main()
+{
+	bytes data = (bytes)malloc(sizes[NUM_SIZES-1]);
+	for (size_t f = 0; f < NUM_FORMATS; ++f)
+	{
+		const MSCompFormat format = formats[f];
+		for (int k = 0; k < NUM_KINDS; ++k)
+		{
+			for (size_t s = 0; s < NUM_SIZES; ++s)
+			{
+				const size_t len = sizes[s];
+				const unsigned before = failures;
+				generate(data, len, (Kind)k);
+				size_t comp_len;
+				bytes comp = compress(format, data, len, &comp_len);
+				if (comp == NULL) { continue; }
+
+				// Plain round trip
+				bytes out = (bytes)malloc(len);
+				size_t out_len = len;
+				MSCompStatus status = ms_decompress(format, comp, comp_len, out, &out_len);
+				CHECK(status == MSCOMP_OK && out_len == len && memcmp(out, data, len) == 0, "%s: round trip of %zu bytes failed: %d", format_names[format], len, status);
+				free(out);
+
+				test_slack  (format, data, len, comp, comp_len);
+				test_inplace(format, data, len, comp, comp_len);
+				test_validate(format, data, len, comp, comp_len);
+				if (format != MSCOMP_XPRESS_HUFF) { test_stream(format, data, len, comp, comp_len); } // no Xpress Huffman streaming yet
+				test_reset(format, data, len, comp, comp_len);
+				test_checksum(format, data, len, comp, comp_len);
+				test_estimate(format, data, len, comp, comp_len);
+
+				if (failures != before) { printf("  (%s data of %zu bytes)\n", kind_names[k], len); }
+				free(comp);
+			}
+		}
+	}
+	free(data);
+
+	test_estimate_sampled();
+	test_auto();
+	test_context();
+	test_stats();
+	test_trace();
+	for (size_t f = 0; f < NUM_FORMATS; ++f) { test_batch(formats[f]); }
+	test_pool_allocator();
+	test_runs();
+	test_lznt1_long_chunk();
+	CHECK(ms_crc32c(0, (const_bytes)"123456789", 9) == 0xE3069283, "crc32c: wrong check value");
+
+	printf("mscomp_test: %u failures\n", failures);
+	return failures ? 1 : 0;
+}